@@ -8,13 +8,58 @@
 #include <regex>
 #include <chrono>
 #include <ctime>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <filesystem>
+#include <iterator>
+#include <string_view>
+#include <random>
+#include <cstring>
+#include <unordered_map>
+#include <future>
+#include <optional>
+#include <memory_resource>
+#include <unordered_set>
+#include <deque>
+#include <limits>
+#include <csignal>
+#include <charconv>
 
 #ifdef _WIN32
+#include <winsock2.h>
+#include <afunix.h>
 #include <Windows.h>
+#include <Psapi.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
 #endif
 
 #include <nlohmann/json.hpp>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ANIMI_SSE2
+#endif
+
 using namespace std;
 using json = nlohmann::json;
 
@@ -45,6 +90,7 @@ struct Anime {
     int duration;
     string description;
     vector<string> synonyms;
+    string updatedAt;
 };
 
 struct User {
@@ -57,6 +103,22 @@ struct User {
     string updatedAt;
 };
 
+struct HttpRequest {
+    string method = "GET";
+    string url;
+    string body;
+    vector<string> headers;
+};
+
+struct HttpResponse {
+    CURLcode code = CURLE_OK;
+    long status = 0;
+    string body;
+    string etag;
+    string lastModified;
+    bool reused = false;
+};
+
 /**
  * @brief Проверяет, что программа запущена на операционной системе Windows.
  *
@@ -93,6 +155,48 @@ void load_config() {
         config["app_version"] = "1.1";
         config["debug"] = false;
         config["developer"] = "riktikdev";
+        config["prefetch_depth"] = 4;
+        config["prefetch_refill"] = 2;
+        config["batch_concurrency"] = 8;
+        config["cache_dir"] = "cache";
+        config["cache_ttl"] = { {"/anime/search", 3600}, {"/users/", 600} };
+        config["cache_stale_seconds"] = 86400;
+        config["cache_max_bytes"] = 16 * 1024 * 1024;
+        config["offline"] = false;
+        config["catalog_file"] = "catalog.bin";
+        config["sync_page_size"] = 100;
+        config["sync_compact_ratio"] = 0.1;
+        config["search_top_k"] = 5;
+        config["search_page_max"] = 40;
+        config["search_page_window"] = 3;
+        config["search_page_target_ms"] = 250;
+        config["metrics_file"] = "metrics";
+        config["transport"] = "live";
+        config["transport_log"] = "traffic.bin";
+        config["replay_pace"] = false;
+        config["compression"] = true;
+        config["http_version"] = "2";
+        config["http2_max_streams"] = 100;
+        config["warmup"] = false;
+        config["coalesce_requests"] = true;
+        config["request_timeout_ms"] = 15000;
+        config["request_timeout_min_ms"] = 1000;
+        config["connect_timeout_ms"] = 5000;
+        config["hedge_requests"] = true;
+        config["retry_attempts"] = 2;
+        config["retry_base_ms"] = 100;
+        config["retry_max_ms"] = 2000;
+        config["log_level"] = "warning";
+        config["log_file"] = "animi.log";
+        config["log_max_bytes"] = 1024 * 1024;
+        config["log_files"] = 3;
+        config["log_console"] = false;
+        config["date_locale"] = "en";
+        config["daemon_socket"] = "animi.sock";
+        config["daemon_workers"] = 4;
+        config["daemon_io_timeout_ms"] = 2000;
+        config["avatar_dir"] = "avatars";
+        config["avatar_max_bytes"] = 64 * 1024 * 1024;
 
         ofstream newFile(configFile);
         newFile << setw(4) << config << endl;
@@ -105,42 +209,426 @@ void load_config() {
     }
 }
 
+enum class LogLevel { Debug, Info, Warning, Error, Off };
+
 /**
- * @brief Выводит информационное сообщение в консоль.
- *
- * @param message Сообщение для вывода.
+ * @brief Настройки журнала.
  */
-void log_info(const string& message) {
-    cout << "[DEBUG] " << message << endl;
-}
+struct LogOptions {
+    LogLevel level = LogLevel::Warning;
+    string path = "animi.log";
+    uint64_t maxBytes = 1024 * 1024;
+    int files = 3;
+    bool console = false;
+};
 
 /**
- * @brief Выводит сообщение об успешном выполнении операции в консоль.
- *
- * @param message Сообщение для вывода.
+ * @brief Запись журнала: уровень, время, номер потока, номер запроса и текст.
  */
-void log_success(const string& message) {
-    cout << COLOR_GREEN << "[DEBUG] " << message << COLOR_RESET << endl;
-}
+struct LogRecord {
+    LogLevel level = LogLevel::Info;
+    chrono::system_clock::time_point time;
+    uint32_t thread = 0;
+    uint64_t request = 0;
+    string message;
+};
 
 /**
- * @brief Выводит предупреждение в консоль.
+ * @brief Асинхронный журнал.
+ *
+ * Потоки кладут записи в кольцевой буфер без блокировок (очередь Вьюкова с номерами
+ * последовательности в ячейках), фоновый поток забирает их пачками и дописывает в файл строками
+ * JSON, сменяя файл по достижении maxBytes (animi.log -> animi.log.1 -> ...). Переполненный
+ * буфер не задерживает вызывающего: запись отбрасывается и учитывается в счетчике потерь.
  *
- * @param message Сообщение для вывода.
+ * Порог уровня задается один раз при запуске, поэтому выключенный вызов LOG_* стоит одного
+ * сравнения, а сообщение для него даже не собирается.
+ */
+class Logger {
+public:
+    explicit Logger(size_t capacity = 8192) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mask = size - 1;
+        slots.reset(new Slot[size]);
+        for (size_t i = 0; i < size; i++) {
+            slots[i].sequence.store(i, memory_order_relaxed);
+        }
+    }
+
+    ~Logger() {
+        stop();
+    }
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    /**
+     * @brief Применяет настройки и запускает фоновую запись (повторный вызов ничего не делает).
+     */
+    void start(const LogOptions& newOptions) {
+        if (writer.joinable()) {
+            return;
+        }
+        options = newOptions;
+        threshold.store((int)options.level, memory_order_relaxed);
+        if (options.level != LogLevel::Off) {
+            writer = thread(&Logger::write_loop, this);
+        }
+    }
+
+    /**
+     * @brief Дописывает оставшиеся записи и останавливает фоновый поток.
+     */
+    void stop() {
+        if (!writer.joinable()) {
+            return;
+        }
+        stopping.store(true);
+        wake.notify_one();
+        writer.join();
+    }
+
+    /**
+     * @brief Меняет порог уровня (например, чтобы отладочные записи не искажали замеры бенчмарков).
+     */
+    void set_level(LogLevel level) {
+        threshold.store((int)level, memory_order_relaxed);
+    }
+
+    bool enabled(LogLevel level) const {
+        return (int)level >= threshold.load(memory_order_relaxed);
+    }
+
+    /**
+     * @brief Ставит запись в очередь. Проверку уровня делают макросы LOG_*.
+     */
+    void write(LogLevel level, string message) {
+        LogRecord record;
+        record.level = level;
+        record.time = chrono::system_clock::now();
+        record.thread = thread_number();
+        record.request = current_request();
+        record.message = move(message);
+
+        if (!push(move(record))) {
+            dropped.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+        if (sleeping.load(memory_order_relaxed)) {
+            wake.notify_one();
+        }
+    }
+
+    uint64_t dropped_count() const {
+        return dropped.load();
+    }
+
+    /**
+     * @brief Номер запроса, к которому относятся записи текущего потока (0 — вне запроса).
+     */
+    static uint64_t& current_request() {
+        thread_local uint64_t request = 0;
+        return request;
+    }
+
+    static uint64_t next_request_id() {
+        static atomic<uint64_t> counter{ 0 };
+        return ++counter;
+    }
+
+    static const char* level_name(LogLevel level) {
+        static const char* names[] = { "debug", "info", "warning", "error", "off" };
+        return names[(int)level];
+    }
+
+    static LogLevel parse_level(const string& name) {
+        for (int level = 0; level <= (int)LogLevel::Off; level++) {
+            if (name == level_name((LogLevel)level)) {
+                return (LogLevel)level;
+            }
+        }
+        return LogLevel::Warning;
+    }
+
+private:
+    struct Slot {
+        atomic<size_t> sequence{ 0 };
+        LogRecord record;
+    };
+
+    unique_ptr<Slot[]> slots;
+    size_t mask = 0;
+    atomic<size_t> head{ 0 };
+    size_t tail = 0;
+
+    atomic<int> threshold{ (int)LogLevel::Off };
+    atomic<uint64_t> dropped{ 0 };
+    LogOptions options;
+
+    thread writer;
+    atomic<bool> stopping{ false };
+    atomic<bool> sleeping{ false };
+    mutex wakeMutex;
+    condition_variable wake;
+
+    ofstream file;
+    uint64_t fileBytes = 0;
+    time_t stampSeconds = -1;
+    char stamp[64] = {};
+
+    static uint32_t thread_number() {
+        static atomic<uint32_t> counter{ 0 };
+        thread_local uint32_t number = ++counter;
+        return number;
+    }
+
+    bool push(LogRecord&& record) {
+        size_t position = head.load(memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots[position & mask];
+            size_t sequence = slot.sequence.load(memory_order_acquire);
+            intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+            if (difference == 0) {
+                if (head.compare_exchange_weak(position, position + 1, memory_order_relaxed)) {
+                    slot.record = move(record);
+                    slot.sequence.store(position + 1, memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0) {
+                return false;
+            }
+            else {
+                position = head.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    // Забирает запись только фоновый поток, поэтому хвост очереди не атомарный
+    bool pop(LogRecord& record) {
+        Slot& slot = slots[tail & mask];
+        size_t sequence = slot.sequence.load(memory_order_acquire);
+        if ((intptr_t)sequence - (intptr_t)(tail + 1) < 0) {
+            return false;
+        }
+        record = move(slot.record);
+        slot.sequence.store(tail + mask + 1, memory_order_release);
+        tail++;
+        return true;
+    }
+
+    void write_loop() {
+        LogRecord record;
+        string batch;
+        string console;
+        uint64_t reportedDrops = 0;
+
+        while (true) {
+            bool finishing = stopping.load();
+            while (pop(record)) {
+                append(batch, console, record);
+                if (batch.size() >= 64 * 1024) {
+                    write_batch(batch, console);
+                }
+            }
+
+            uint64_t drops = dropped.load(memory_order_relaxed);
+            if (drops != reportedDrops) {
+                LogRecord lost;
+                lost.level = LogLevel::Warning;
+                lost.time = chrono::system_clock::now();
+                lost.message = "Буфер журнала переполнен, потеряно записей: " + to_string(drops - reportedDrops);
+                append(batch, console, lost);
+                reportedDrops = drops;
+            }
+            write_batch(batch, console);
+
+            if (finishing) {
+                break;
+            }
+
+            unique_lock<mutex> lock(wakeMutex);
+            sleeping.store(true);
+            // Уведомление может проскочить между проверкой очереди и ожиданием, поэтому ожидание ограничено
+            wake.wait_for(lock, chrono::milliseconds(50));
+            sleeping.store(false);
+        }
+        file.close();
+    }
+
+    void append(string& batch, string& console, const LogRecord& record) {
+        int64_t milliseconds = chrono::duration_cast<chrono::milliseconds>(record.time.time_since_epoch()).count();
+        time_t seconds = (time_t)(milliseconds / 1000);
+        // Записи идут пачками в пределах одной секунды, поэтому дата и время до секунд форматируются редко
+        if (seconds != stampSeconds) {
+            tm time = {};
+#ifdef _WIN32
+            gmtime_s(&time, &seconds);
+#else
+            gmtime_r(&seconds, &time);
+#endif
+            snprintf(stamp, sizeof(stamp), "%04d-%02d-%02dT%02d:%02d:%02d", time.tm_year + 1900, time.tm_mon + 1,
+                time.tm_mday, time.tm_hour, time.tm_min, time.tm_sec);
+            stampSeconds = seconds;
+        }
+        char fraction[8];
+        snprintf(fraction, sizeof(fraction), ".%03dZ", (int)(milliseconds % 1000));
+
+        batch += "{\"ts\":\"";
+        batch += stamp;
+        batch += fraction;
+        batch += "\",\"level\":\"";
+        batch += level_name(record.level);
+        batch += "\",\"thread\":" + to_string(record.thread);
+        if (record.request != 0) {
+            batch += ",\"request\":" + to_string(record.request);
+        }
+        batch += ",\"msg\":\"";
+        append_escaped(batch, record.message);
+        batch += "\"}\n";
+
+        if (options.console) {
+            static const char* colors[] = { "", COLOR_GREEN, COLOR_YELLOW, COLOR_RED, "" };
+            console += colors[(int)record.level];
+            console += "[" + string(level_name(record.level)) + "] " + record.message + COLOR_RESET + "\n";
+        }
+    }
+
+    /**
+     * @brief Дописывает текст как содержимое строки JSON (байты UTF-8 копируются как есть).
+     */
+    static void append_escaped(string& out, const string& text) {
+        for (char c : text) {
+            switch (c) {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\r':
+                out += "\\r";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default:
+                if ((unsigned char)c < 0x20) {
+                    char code[8];
+                    snprintf(code, sizeof(code), "\\u%04x", (unsigned char)c);
+                    out += code;
+                }
+                else {
+                    out += c;
+                }
+            }
+        }
+    }
+
+    void write_batch(string& batch, string& console) {
+        if (!console.empty()) {
+            cerr << console << flush;
+            console.clear();
+        }
+        if (batch.empty() || options.path.empty()) {
+            batch.clear();
+            return;
+        }
+
+        if (!file.is_open()) {
+            error_code error;
+            fileBytes = filesystem::exists(options.path, error) ? filesystem::file_size(options.path, error) : 0;
+            file.open(options.path, ios::binary | ios::app);
+        }
+        if (fileBytes > 0 && fileBytes + batch.size() > options.maxBytes) {
+            rotate();
+        }
+
+        file.write(batch.data(), batch.size());
+        file.flush();
+        fileBytes += batch.size();
+        batch.clear();
+    }
+
+    void rotate() {
+        file.close();
+
+        error_code error;
+        int files = max(options.files, 0);
+        if (files == 0) {
+            filesystem::remove(options.path, error);
+        }
+        else {
+            filesystem::remove(options.path + "." + to_string(files), error);
+            for (int i = files - 1; i >= 1; i--) {
+                filesystem::rename(options.path + "." + to_string(i), options.path + "." + to_string(i + 1), error);
+            }
+            filesystem::rename(options.path, options.path + ".1", error);
+        }
+
+        file.open(options.path, ios::binary | ios::trunc);
+        fileBytes = 0;
+    }
+};
+
+/**
+ * @brief Возвращает единственный на процесс журнал.
  */
-void log_warning(const string& message) {
-    cout << COLOR_YELLOW << "[DEBUG] " << message << COLOR_RESET << endl;
+Logger& logger() {
+    static Logger instance;
+    return instance;
 }
 
 /**
- * @brief Выводит сообщение об ошибке в консоль.
- *
- * @param message Сообщение для вывода.
+ * @brief Настройки журнала из config.json. В режиме отладки пишутся все уровни.
  */
-void log_error(const string& message) {
-    cout << COLOR_RED << "[DEBUG] " << message << COLOR_RESET << endl;
+LogOptions log_options() {
+    LogOptions options;
+    options.level = config["debug"] == true ? LogLevel::Debug : Logger::parse_level(config.value("log_level", string("warning")));
+    options.path = config.value("log_file", string("animi.log"));
+    options.maxBytes = config.value("log_max_bytes", (uint64_t)1024 * 1024);
+    options.files = config.value("log_files", 3);
+    options.console = config.value("log_console", false);
+    return options;
 }
 
+/**
+ * @brief Связывает записи журнала текущего потока с номером запроса на время жизни объекта.
+ */
+class LogRequestScope {
+public:
+    explicit LogRequestScope(uint64_t id = Logger::next_request_id())
+        : previous(Logger::current_request()) {
+        Logger::current_request() = id;
+    }
+
+    ~LogRequestScope() {
+        Logger::current_request() = previous;
+    }
+
+private:
+    uint64_t previous;
+};
+
+// Сообщение вычисляется, только если уровень включен
+#define LOG_TO(target, level, message) \
+    do { \
+        if ((target).enabled(level)) { \
+            (target).write(level, message); \
+        } \
+    } while (false)
+
+#define LOG_DEBUG(message) LOG_TO(logger(), LogLevel::Debug, message)
+#define LOG_INFO(message) LOG_TO(logger(), LogLevel::Info, message)
+#define LOG_WARNING(message) LOG_TO(logger(), LogLevel::Warning, message)
+#define LOG_ERROR(message) LOG_TO(logger(), LogLevel::Error, message)
+
 /**
  * @brief Инициализирует настройки приложения на основе загруженной конфигурации.
  *
@@ -148,167 +636,3449 @@ void log_error(const string& message) {
  */
 void load_settings() {
 #ifdef _WIN32
-    if (config["debug"] == true) {
-        log_info("Попытка установить заголовок консоли");
-    }
+    LOG_DEBUG("Попытка установить заголовок консоли");
 
     // Устанавливаем заголовок консоли
     string title = config["app_name"].get<string>() + " v" + config["app_version"].get<string>();
     bool success = SetConsoleTitleA(title.c_str());
 
-    if (config["debug"] == true) {
-        if (success) {
-            log_success("Заголовок консоли успешно установлен");
-        }
-        else {
-            log_error("Не удалось установить заголовок консоли");
-        }
+    if (success) {
+        LOG_INFO("Заголовок консоли успешно установлен");
+    }
+    else {
+        LOG_ERROR("Не удалось установить заголовок консоли");
     }
 #endif
 }
 
 /**
- * @brief Очищает консоли
+ * @brief Вывод экранов меню без запуска "cls"/"clear" через system().
+ *
+ * Устанавливается буфером cout: весь вывод экрана копится в памяти (endl больше не сбрасывает
+ * его в консоль), а на экран кадр попадает одной записью перед чтением из cin (cin связан
+ * с потоком, сброс которого вызывает present()). Новый кадр сравнивается построчно
+ * с предыдущим, и перерисовываются только изменившиеся строки с помощью ANSI-последовательностей.
+ * Если кадр не помещается в окно консоли, он выводится целиком после очистки экрана.
  */
-void clear_console() {
-    int result;
+class ScreenRenderer : public streambuf {
+public:
+    ScreenRenderer()
+        : presenter(this), presenterStream(&presenter) {
+    }
+
+    ~ScreenRenderer() {
+        uninstall();
+    }
+
+    /**
+     * @brief Подключает рендерер к cout и cin.
+     */
+    void install() {
+        if (installed) {
+            return;
+        }
+
+        cout.flush();
+        previousBuffer = cout.rdbuf(this);
+        cin.tie(&presenterStream);
+        installed = true;
 
 #ifdef _WIN32
-    result = system("cls");
-#else
-    result = system("clear");
+        // ANSI-последовательности в классической консоли работают только в режиме VT
+        HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE);
+        DWORD mode = 0;
+        if (GetConsoleMode(output, &mode)) {
+            SetConsoleMode(output, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+        }
 #endif
+    }
+
+    /**
+     * @brief Выводит остаток кадра и возвращает cout прежний буфер.
+     */
+    void uninstall() {
+        if (!installed) {
+            return;
+        }
 
-    if (result != 0 && config["debug"]) {
-        log_error("Ошибка при очистке консоли");
+        present();
+        cout.rdbuf(previousBuffer);
+        cin.tie(&cout);
+        installed = false;
     }
-}
 
-/**
-* @brief Функция обратного вызова для записи данных curl
-*/
-size_t write_callback(void* contents, size_t size, size_t nmemb, string* userp) {
-    size_t realsize = size * nmemb;
-    userp->append((char*)contents, realsize);
-    return size * nmemb;
-}
+    /**
+     * @brief Начинает новый кадр (замена очистки консоли).
+     */
+    void clear() {
+        lock_guard<mutex> lock(frameMutex);
 
-/**
- * @brief Преобразует дату и время из формата ISO 8601 в строку с форматированным выводом.
- *
- * @param isoDate Строка с датой и временем в формате ISO 8601 (например, "2024-05-31T23:10:39.588Z").
- * @return Строка с отформатированной датой в виде "дд мм. гггг" или "Invalid Date", если входная строка некорректна.
- */
-string format_iso_date(const string& isoDate) {
-    // Преобразование ISO 8601 строки в структуру времени
-    tm time = {};
-    stringstream ss(isoDate);
-    ss >> get_time(&time, "%Y-%m-%dT%H:%M:%S");
+        // Строки, в которых пользователь печатал ответ, на экране отличаются от кадра
+        previous = split_lines(frame);
+        for (size_t row : echoRows) {
+            if (row < previous.size()) {
+                previous[row] = "\x01";
+            }
+        }
+        previousValid = fits(previous);
 
-    if (ss.fail()) {
-        return "Недопустимая дата";
+        frame.clear();
+        echoRows.clear();
+        presented = 0;
+        newFrame = true;
+        awaitingInput = false;
     }
 
-    // Форматирование вывода даты в "дд мм. гггг"
-    stringstream formattedDate;
-    formattedDate << put_time(&time, "%d %b. %Y");
-    return formattedDate.str();
-}
+    /**
+     * @brief Выводит накопленную часть кадра одной записью.
+     *
+     * @param forInput Вывод перед чтением из cin: ввод пользователя с эхом займет строку,
+     * поэтому следующий вывод кадра начинается с новой строки.
+     */
+    void present(bool forInput = false) {
+        lock_guard<mutex> lock(frameMutex);
 
-/**
- * @brief Выполняет HTTP GET-запрос по указанному URL.
- *
- * Функция инициализирует CURL, устанавливает URL для запроса GET,
- * назначает функцию обратного вызова для записи полученных данных в строку,
- * выполняет запрос и возвращает полученную строку.
- *
- * @param url URL-адрес для выполнения GET-запроса.
- * @return Строка с данными, полученными в результате GET-запроса.
- */
-string http_get_request(const string& url) {
-    CURL* curl;
-    CURLcode res;
-    string readBuffer;
+        // Несколько чтений подряд без вывода между ними (cin >> a >> b) — это одна строка ввода
+        if (forInput && awaitingInput && presented == frame.size()) {
+            return;
+        }
 
-    curl = curl_easy_init();
-    if (curl) {
-        // Устанавливаем URL для запроса
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        string out;
+        if (newFrame) {
+            vector<string> lines = split_lines(frame);
+            if (previousValid && fits(lines)) {
+                out = diff(lines);
+            }
+            else {
+                out = "\033[H\033[2J\033[3J" + frame;
+            }
+            newFrame = false;
+        }
+        else {
+            out = frame.substr(presented);
+        }
 
-        // Назначаем функцию обратного вызова для записи полученных данных в строку
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
+        if (forInput) {
+            echoRows.push_back((size_t)count(frame.begin(), frame.end(), '\n'));
+            frame.push_back('\n');
+        }
+        presented = frame.size();
+        awaitingInput = forInput;
 
-        // Выполняем запрос
-        res = curl_easy_perform(curl);
+        write_out(out);
+    }
 
-        // Проверяем результат выполнения запроса
-        if (res != CURLE_OK && config["debug"] == true) {
-            cerr << "curl_easy_perform() failed: " << curl_easy_strerror(res) << endl;
+    /**
+     * @brief Записывает строку в консоль одним системным вызовом.
+     */
+    static void write_out(const string& data) {
+        if (data.empty()) {
+            return;
         }
 
-        // Освобождаем ресурсы curl
-        curl_easy_cleanup(curl);
+#ifdef _WIN32
+        DWORD written = 0;
+        WriteFile(GetStdHandle(STD_OUTPUT_HANDLE), data.data(), (DWORD)data.size(), &written, NULL);
+#else
+        size_t offset = 0;
+        while (offset < data.size()) {
+            ssize_t written = ::write(STDOUT_FILENO, data.data() + offset, data.size() - offset);
+            if (written <= 0) {
+                break;
+            }
+            offset += written;
+        }
+#endif
     }
 
-    return readBuffer;
-}
+protected:
+    int_type overflow(int_type c) override {
+        if (c != traits_type::eof()) {
+            lock_guard<mutex> lock(frameMutex);
+            frame.push_back(traits_type::to_char_type(c));
+        }
+        return c;
+    }
 
-/**
- * @brief Выполняет HTTP POST-запрос по указанному URL.
- *
- * Функция инициализирует CURL, устанавливает URL для запроса POST,
- * назначает функцию обратного вызова для записи полученных данных в строку,
- * выполняет запрос и возвращает полученную строку.
- *
- * @param url URL-адрес для выполнения POST-запроса.
- * @param body Данные передаваемые в запрос
- * @return Строка с данными, полученными в результате POST-запроса.
- */
-string http_post_request(const string& url, const string& query) {
-    CURL* curl;
-    CURLcode res;
-    string readBuffer;
+    streamsize xsputn(const char* data, streamsize count) override {
+        lock_guard<mutex> lock(frameMutex);
+        frame.append(data, (size_t)count);
+        return count;
+    }
+
+    int sync() override {
+        // endl и flush не выводят кадр: это делает present() перед вводом
+        return 0;
+    }
 
-    curl = curl_easy_init();
-    if (curl) {
-        const string data = "{\"query\": \"" + query + "\", \"take\": 5}";
+private:
+    /**
+     * @brief Буфер потока, связанного с cin: его сброс перед чтением выводит кадр.
+     */
+    class Presenter : public streambuf {
+    public:
+        explicit Presenter(ScreenRenderer* owner)
+            : owner(owner) {
+        }
 
-        // Устанавливаем URL для запроса
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    protected:
+        int sync() override {
+            owner->present(true);
+            return 0;
+        }
 
-        // Устанавливаем метод POST
-        curl_easy_setopt(curl, CURLOPT_POST, 1L);
-        // Устанавливаем передаваемые даанные
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data.c_str());
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, data.length());
+    private:
+        ScreenRenderer* owner;
+    };
 
-        // Устанавливаем обратный вызов записи для обработки ответа
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
+    Presenter presenter;
+    ostream presenterStream;
+    streambuf* previousBuffer = nullptr;
+    bool installed = false;
 
-        // Устанавливаем HTTP Headers
-        struct curl_slist* headers = NULL;
-        headers = curl_slist_append(headers, "Content-Type: application/json");
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    mutex frameMutex;
+    string frame;
+    size_t presented = 0;
+    bool newFrame = true;
+    bool awaitingInput = false;
+    vector<size_t> echoRows;
+    vector<string> previous;
+    bool previousValid = false;
+
+    static vector<string> split_lines(const string& text) {
+        vector<string> lines;
+        size_t start = 0;
+        while (true) {
+            size_t end = text.find('\n', start);
+            if (end == string::npos) {
+                lines.push_back(text.substr(start));
+                return lines;
+            }
+            lines.push_back(text.substr(start, end - start));
+            start = end + 1;
+        }
+    }
+
+    /**
+     * @brief Ширина строки на экране: без ANSI-последовательностей, в символах.
+     */
+    static size_t display_width(const string& line) {
+        size_t width = 0;
+        for (size_t i = 0; i < line.size(); i++) {
+            unsigned char c = line[i];
+            if (c == '\033') {
+                while (i + 1 < line.size() && !isalpha((unsigned char)line[i + 1])) {
+                    i++;
+                }
+                i++;
+                continue;
+            }
+#ifdef _WIN32
+            // Консоль в кодировке 1251: один байт — один символ
+            width++;
+#else
+            if ((c & 0xC0) != 0x80) {
+                width++;
+            }
+#endif
+        }
+        return width;
+    }
 
-        res = curl_easy_perform(curl);
-        if (res != CURLE_OK && config["debug"] == true) {
-            log_error("При отправке запроса произошла ошибка");
+    /**
+     * @brief Помещается ли кадр в окно без переносов и прокрутки (только тогда строки можно адресовать).
+     */
+    static bool fits(const vector<string>& lines) {
+        int rows = 0;
+        int columns = 0;
+#ifdef _WIN32
+        CONSOLE_SCREEN_BUFFER_INFO info;
+        if (GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info)) {
+            rows = info.srWindow.Bottom - info.srWindow.Top + 1;
+            columns = info.srWindow.Right - info.srWindow.Left + 1;
         }
-        else if (config["debug"] == true) {
-            log_success("Запрос успешно отправлен");
+#else
+        winsize size{};
+        if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0) {
+            rows = size.ws_row;
+            columns = size.ws_col;
         }
+#endif
 
-        curl_slist_free_all(headers);
-        curl_easy_cleanup(curl);
+        if (rows <= 0 || columns <= 0 || lines.size() > (size_t)rows) {
+            return false;
+        }
+        for (const auto& line : lines) {
+            if (display_width(line) >= (size_t)columns) {
+                return false;
+            }
+        }
+        return true;
     }
 
-    return readBuffer;
-}
+    /**
+     * @brief Последовательность, превращающая предыдущий кадр на экране в новый.
+     *
+     * Последняя строка выводится всегда, чтобы курсор остался в ее конце (там, где ждет ввод).
+     */
+    string diff(const vector<string>& lines) const {
+        string out;
+        if (previous.size() > lines.size()) {
+            out += "\033[" + to_string(lines.size() + 1) + ";1H\033[J";
+        }
 
-//string http_post_request(const string& url, const json& body) {
-//    CURL* curl;
+        for (size_t row = 0; row + 1 < lines.size(); row++) {
+            if (row < previous.size() && previous[row] == lines[row]) {
+                continue;
+            }
+            out += "\033[" + to_string(row + 1) + ";1H" + lines[row] + "\033[K";
+        }
+
+        out += "\033[" + to_string(lines.size()) + ";1H" + lines.back() + "\033[K";
+        return out;
+    }
+};
+
+/**
+ * @brief Возвращает рендерер экранов интерактивного режима.
+ */
+ScreenRenderer& screen_renderer() {
+    static ScreenRenderer renderer;
+    return renderer;
+}
+
+/**
+ * @brief Очищает консоль: начинает новый кадр рендерера.
+ *
+ * Раньше очистка запускала "cls"/"clear" через system() на каждый экран.
+ */
+void clear_console() {
+    screen_renderer().clear();
+}
+
+/**
+* @brief Функция обратного вызова для записи данных curl
+*/
+size_t write_callback(void* contents, size_t size, size_t nmemb, string* userp) {
+    size_t realsize = size * nmemb;
+    userp->append((char*)contents, realsize);
+    return size * nmemb;
+}
+
+/**
+* @brief Функция обратного вызова для заголовков ответа curl (сохраняет ETag и Last-Modified)
+*/
+size_t header_callback(char* buffer, size_t size, size_t nitems, HttpResponse* response) {
+    size_t realsize = size * nitems;
+    string line(buffer, realsize);
+
+    size_t colon = line.find(':');
+    if (colon != string::npos) {
+        string name = line.substr(0, colon);
+        transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return (char)tolower(c); });
+
+        size_t begin = line.find_first_not_of(" \t", colon + 1);
+        size_t end = line.find_last_not_of(" \t\r\n");
+        string value = begin == string::npos || end < begin ? "" : line.substr(begin, end - begin + 1);
+
+        if (name == "etag") {
+            response->etag = value;
+        }
+        else if (name == "last-modified") {
+            response->lastModified = value;
+        }
+    }
+    return realsize;
+}
+
+// Метка времени, которую не удалось разобрать
+const int64_t invalidTimestamp = (numeric_limits<int64_t>::min)();
+
+/**
+ * @brief Номер дня от 1970-01-01 для даты григорианского календаря (алгоритм Говарда Хиннанта).
+ */
+int64_t days_from_civil(int64_t year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    unsigned yearOfEra = (unsigned)(year - era * 400);
+    unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + (int64_t)dayOfEra - 719468;
+}
+
+/**
+ * @brief Дата по номеру дня от 1970-01-01 (обратное к days_from_civil).
+ */
+void civil_from_days(int64_t days, int& year, unsigned& month, unsigned& day) {
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    unsigned dayOfEra = (unsigned)(days - era * 146097);
+    unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    unsigned shifted = (5 * dayOfYear + 2) / 153;
+    day = dayOfYear - (153 * shifted + 2) / 5 + 1;
+    month = shifted < 10 ? shifted + 3 : shifted - 9;
+    year = (int)(yearOfEra + era * 400 + (month <= 2));
+}
+
+/**
+ * @brief Разбирает count десятичных цифр, начиная с position.
+ *
+ * @return Число или -1, если символов не хватает или среди них есть не цифра.
+ */
+int iso_digits(string_view text, size_t position, size_t count) {
+    if (position + count > text.size()) {
+        return -1;
+    }
+    int value = 0;
+    for (size_t i = position; i < position + count; i++) {
+        unsigned digit = (unsigned char)text[i] - '0';
+        if (digit > 9) {
+            return -1;
+        }
+        value = value * 10 + (int)digit;
+    }
+    return value;
+}
+
+/**
+ * @brief Общее окончание разбора после "YYYY-MM-DDTHH:MM": секунды, доли секунды, зона и проверка диапазонов.
+ */
+bool iso_finish(string_view text, size_t position, int year, int month, int day, int hour, int minute, int64_t& epochMs) {
+    int second = 0;
+    int milliseconds = 0;
+    if (position < text.size() && text[position] == ':') {
+        second = iso_digits(text, position + 1, 2);
+        if (second < 0) {
+            return false;
+        }
+        position += 3;
+
+        // Доли секунды любой длины, учитываются первые три цифры
+        if (position < text.size() && (text[position] == '.' || text[position] == ',')) {
+            size_t digits = 0;
+            for (position++; position < text.size() && (unsigned)((unsigned char)text[position] - '0') <= 9; position++, digits++) {
+                if (digits < 3) {
+                    milliseconds = milliseconds * 10 + (text[position] - '0');
+                }
+            }
+            if (digits == 0) {
+                return false;
+            }
+            for (; digits < 3; digits++) {
+                milliseconds *= 10;
+            }
+        }
+    }
+
+    // Без зоны время считается UTC
+    int offsetMinutes = 0;
+    if (position < text.size()) {
+        char sign = text[position];
+        if (sign == 'Z' || sign == 'z') {
+            position++;
+        }
+        else if (sign == '+' || sign == '-') {
+            int offsetHours = iso_digits(text, position + 1, 2);
+            position += 3;
+            int offsetRest = 0;
+            if (position < text.size()) {
+                position += text[position] == ':' ? 1 : 0;
+                offsetRest = iso_digits(text, position, 2);
+                position += 2;
+            }
+            if (offsetHours < 0 || offsetHours > 23 || offsetRest < 0 || offsetRest > 59) {
+                return false;
+            }
+            offsetMinutes = (offsetHours * 60 + offsetRest) * (sign == '-' ? -1 : 1);
+        }
+        if (position != text.size()) {
+            return false;
+        }
+    }
+
+    static const unsigned char monthDays[12] = { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    bool leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+    if (month < 1 || month > 12 || day < 1 || day > monthDays[month - 1] || (month == 2 && day == 29 && !leap)
+        || hour > 23 || minute > 59 || second > 60) {
+        return false;
+    }
+
+    int64_t seconds = days_from_civil(year, (unsigned)month, (unsigned)day) * 86400
+        + hour * 3600 + minute * 60 + second - offsetMinutes * 60;
+    epochMs = seconds * 1000 + milliseconds;
+    return true;
+}
+
+/**
+ * @brief Разбирает метку времени ISO 8601 в миллисекунды от начала эпохи (UTC) без выделения памяти.
+ *
+ * Понимает "YYYY-MM-DD", "YYYY-MM-DDTHH:MM[:SS[.доли]]" с разделителем 'T', 't' или пробелом
+ * и зону "Z", "+HH:MM", "+HHMM" или "+HH" (без зоны время считается UTC).
+ *
+ * @return false, если строка не является корректной меткой времени.
+ */
+bool parse_iso8601(string_view text, int64_t& epochMs) {
+    int year = iso_digits(text, 0, 4);
+    int month = iso_digits(text, 5, 2);
+    int day = iso_digits(text, 8, 2);
+    if (year < 0 || month < 0 || day < 0 || text[4] != '-' || text[7] != '-') {
+        return false;
+    }
+    if (text.size() == 10) {
+        return iso_finish(text, 10, year, month, day, 0, 0, epochMs);
+    }
+
+    char separator = text[10];
+    if (separator != 'T' && separator != 't' && separator != ' ') {
+        return false;
+    }
+    int hour = iso_digits(text, 11, 2);
+    int minute = iso_digits(text, 14, 2);
+    if (hour < 0 || minute < 0 || text[13] != ':') {
+        return false;
+    }
+    return iso_finish(text, 16, year, month, day, hour, minute, epochMs);
+}
+
+/**
+ * @brief Разбирает столбец меток времени, неразобранные получают invalidTimestamp.
+ *
+ * При наличии SSE2 префикс "YYYY-MM-DDTHH:MM" самого частого вида проверяется и переводится
+ * в числа за один проход по 16 байтам: цифры и разделители сверяются масками, пары цифр
+ * сворачиваются умножением со сложением. Остальные виды разбираются parse_iso8601.
+ *
+ * @return Количество успешно разобранных меток.
+ */
+size_t parse_iso8601_batch(const string_view* texts, size_t count, int64_t* out) {
+    size_t parsed = 0;
+
+#ifdef ANIMI_SSE2
+    // Позиции разделителей в "YYYY-MM-DDTHH:MM" и ожидаемые в них символы
+    const __m128i separatorMask = _mm_setr_epi8(0, 0, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0);
+    const __m128i separators = _mm_setr_epi8(0, 0, 0, 0, '-', 0, 0, '-', 0, 0, 'T', 0, 0, ':', 0, 0);
+    const __m128i zeros = _mm_set1_epi8('0');
+    const __m128i nine = _mm_set1_epi8(9);
+    // Множители пар: Y*10+Y, Y*10+Y, M*10, M, D*10+D, H*10, H, M*10+M
+    const __m128i lowWeights = _mm_setr_epi16(10, 1, 10, 1, 0, 10, 1, 0);
+    const __m128i highWeights = _mm_setr_epi16(10, 1, 0, 10, 1, 0, 10, 1);
+#endif
+
+    for (size_t i = 0; i < count; i++) {
+        string_view text = texts[i];
+        bool ok = false;
+
+#ifdef ANIMI_SSE2
+        if (text.size() >= 16) {
+            __m128i bytes = _mm_loadu_si128((const __m128i*)text.data());
+            __m128i digits = _mm_sub_epi8(bytes, zeros);
+            __m128i isDigit = _mm_cmpeq_epi8(_mm_max_epu8(digits, nine), nine);
+            __m128i isSeparator = _mm_cmpeq_epi8(bytes, separators);
+            __m128i valid = _mm_or_si128(_mm_andnot_si128(separatorMask, isDigit), _mm_and_si128(separatorMask, isSeparator));
+
+            if (_mm_movemask_epi8(valid) == 0xFFFF) {
+                __m128i numbers = _mm_andnot_si128(separatorMask, digits);
+                __m128i low = _mm_madd_epi16(_mm_unpacklo_epi8(numbers, _mm_setzero_si128()), lowWeights);
+                __m128i high = _mm_madd_epi16(_mm_unpackhi_epi8(numbers, _mm_setzero_si128()), highWeights);
+
+                alignas(16) int32_t lanes[8];
+                _mm_store_si128((__m128i*)lanes, low);
+                _mm_store_si128((__m128i*)(lanes + 4), high);
+                ok = iso_finish(text, 16, lanes[0] * 100 + lanes[1], lanes[2] + lanes[3], lanes[4],
+                    lanes[5] + lanes[6], lanes[7], out[i]);
+            }
+            else {
+                ok = parse_iso8601(text, out[i]);
+            }
+        }
+        else {
+            ok = parse_iso8601(text, out[i]);
+        }
+#else
+        ok = parse_iso8601(text, out[i]);
+#endif
+
+        if (ok) {
+            parsed++;
+        }
+        else {
+            out[i] = invalidTimestamp;
+        }
+    }
+    return parsed;
+}
+
+/**
+ * @brief Записывает value десятичными цифрами ровно в width символов (с ведущими нулями).
+ */
+char* put_digits(char* out, unsigned value, int width) {
+    for (int i = width - 1; i >= 0; i--) {
+        out[i] = (char)('0' + value % 10);
+        value /= 10;
+    }
+    return out + width;
+}
+
+enum class DateLocale { English, Russian };
+
+/**
+ * @brief Язык названий месяцев из ключа "date_locale" ("en" или "ru"), читается один раз.
+ */
+DateLocale date_locale() {
+    static const DateLocale locale = config.value("date_locale", string("en")) == "ru" ? DateLocale::Russian : DateLocale::English;
+    return locale;
+}
+
+/**
+ * @brief Записывает дату метки времени (UTC) в buffer без выделения памяти:
+ * "31 May. 2024" (как прежний put_time с "%d %b. %Y") или "31 мая 2024".
+ *
+ * @return Длина текста без завершающего нуля или 0, если буфер мал или год вне 0..9999.
+ */
+size_t format_date(int64_t epochMs, char* buffer, size_t size, DateLocale locale) {
+    static const char* englishMonths[12] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+    static const char* russianMonths[12] = {
+        "января", "февраля", "марта", "апреля", "мая", "июня", "июля", "августа", "сентября", "октября", "ноября", "декабря"
+    };
+
+    int64_t days = epochMs / 86400000 - (epochMs % 86400000 < 0 ? 1 : 0);
+    int year = 0;
+    unsigned month = 0, day = 0;
+    civil_from_days(days, year, month, day);
+    if (year < 0 || year > 9999) {
+        return 0;
+    }
+
+    const char* name = locale == DateLocale::Russian ? russianMonths[month - 1] : englishMonths[month - 1];
+    size_t nameLength = strlen(name);
+    size_t length = 2 + 1 + nameLength + (locale == DateLocale::Russian ? 0 : 1) + 1 + 4;
+    if (length >= size) {
+        return 0;
+    }
+
+    char* out = put_digits(buffer, day, 2);
+    *out++ = ' ';
+    memcpy(out, name, nameLength);
+    out += nameLength;
+    if (locale == DateLocale::English) {
+        *out++ = '.';
+    }
+    *out++ = ' ';
+    out = put_digits(out, (unsigned)year, 4);
+    *out = '\0';
+    return length;
+}
+
+/**
+ * @brief Записывает метку времени в buffer в виде "YYYY-MM-DDTHH:MM:SS.mmmZ".
+ *
+ * @return Длина текста без завершающего нуля или 0, если буфер мал или год вне 0..9999.
+ */
+size_t format_iso8601(int64_t epochMs, char* buffer, size_t size) {
+    int64_t days = epochMs / 86400000 - (epochMs % 86400000 < 0 ? 1 : 0);
+    int64_t rest = epochMs - days * 86400000;
+    int year = 0;
+    unsigned month = 0, day = 0;
+    civil_from_days(days, year, month, day);
+
+    const size_t length = 24;
+    if (year < 0 || year > 9999 || length >= size) {
+        return 0;
+    }
+
+    char* out = put_digits(buffer, (unsigned)year, 4);
+    *out++ = '-';
+    out = put_digits(out, month, 2);
+    *out++ = '-';
+    out = put_digits(out, day, 2);
+    *out++ = 'T';
+    out = put_digits(out, (unsigned)(rest / 3600000), 2);
+    *out++ = ':';
+    out = put_digits(out, (unsigned)(rest / 60000 % 60), 2);
+    *out++ = ':';
+    out = put_digits(out, (unsigned)(rest / 1000 % 60), 2);
+    *out++ = '.';
+    out = put_digits(out, (unsigned)(rest % 1000), 3);
+    *out++ = 'Z';
+    *out = '\0';
+    return length;
+}
+
+/**
+ * @brief Преобразует дату и время из формата ISO 8601 в строку с форматированным выводом.
+ *
+ * @param isoDate Строка с датой и временем в формате ISO 8601 (например, "2024-05-31T23:10:39.588Z").
+ * @return Строка с датой (UTC) в виде "дд мм. гггг" или "Недопустимая дата", если входная строка некорректна.
+ */
+string format_iso_date(const string& isoDate) {
+    int64_t epochMs = 0;
+    char buffer[48];
+    size_t length = parse_iso8601(isoDate, epochMs) ? format_date(epochMs, buffer, sizeof(buffer), date_locale()) : 0;
+    return length > 0 ? string(buffer, length) : "Недопустимая дата";
+}
+
+/**
+ * @brief Возвращает базовый адрес REST-API.
+ *
+ * По умолчанию используется https://api.animi.club, но его можно переопределить ключом "api_url"
+ * в config.json (например, чтобы направить клиент на локальный тестовый сервер).
+ */
+string api_url(const string& path) {
+    return config.value("api_url", string("https://api.animi.club")) + path;
+}
+
+/**
+ * @brief Возвращает адрес файла в хранилище аватаров (ключ "avatar_url" в config.json).
+ */
+string avatar_url(const string& path) {
+    return config.value("avatar_url", string("https://animi-s3.s3.aeza.cloud/")) + path;
+}
+
+/**
+ * @brief Момент запуска программы. Первый вызов делается в самом начале main.
+ */
+chrono::steady_clock::time_point process_started() {
+    static const chrono::steady_clock::time_point started = chrono::steady_clock::now();
+    return started;
+}
+
+/**
+ * @brief Гистограмма задержек в стиле HDR: логарифмически-линейные корзины с точностью около 1.5%.
+ *
+ * Значения в микросекундах. До 128 мкс каждая корзина шириной 1 мкс, дальше каждый
+ * диапазон [2^k, 2^(k+1)) делится на 64 равные корзины. Память фиксирована и не зависит
+ * от числа записанных значений.
+ */
+class LatencyHistogram {
+public:
+    void record(uint64_t micros) {
+        micros = min(micros, maxValue);
+        counts[bucket_of(micros)]++;
+        total++;
+        sum += micros;
+        maxRecorded = max(maxRecorded, micros);
+    }
+
+    uint64_t count() const {
+        return total;
+    }
+
+    double mean() const {
+        return total > 0 ? (double)sum / total : 0;
+    }
+
+    uint64_t max_value() const {
+        return maxRecorded;
+    }
+
+    uint64_t sum_value() const {
+        return sum;
+    }
+
+    /**
+     * @brief Значение перцентиля p (0..1): верхняя граница корзины, в которую он попал.
+     */
+    uint64_t percentile(double p) const {
+        if (total == 0) {
+            return 0;
+        }
+
+        uint64_t rank = (uint64_t)(p * total + 0.5);
+        rank = max<uint64_t>(rank, 1);
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bucketCount; i++) {
+            seen += counts[i];
+            if (seen >= rank) {
+                return min(upper_bound_of(i), maxRecorded);
+            }
+        }
+        return maxRecorded;
+    }
+
+private:
+    static const size_t linearBuckets = 128;
+    static const size_t subBuckets = 64;
+    static const size_t bucketCount = linearBuckets + 32 * subBuckets;
+    static constexpr uint64_t maxValue = ((uint64_t)1 << 38) - 1;
+
+    uint32_t counts[bucketCount] = {};
+    uint64_t total = 0;
+    uint64_t sum = 0;
+    uint64_t maxRecorded = 0;
+
+    static size_t bucket_of(uint64_t value) {
+        if (value < linearBuckets) {
+            return (size_t)value;
+        }
+
+        int msb = 63;
+        while (!(value >> msb)) {
+            msb--;
+        }
+        int shift = msb - 6;
+        return linearBuckets + (shift - 1) * subBuckets + (size_t)((value >> shift) - subBuckets);
+    }
+
+    static uint64_t upper_bound_of(size_t bucket) {
+        if (bucket < linearBuckets) {
+            return bucket;
+        }
+
+        size_t shift = (bucket - linearBuckets) / subBuckets + 1;
+        uint64_t sub = (bucket - linearBuckets) % subBuckets + subBuckets;
+        return ((sub + 1) << shift) - 1;
+    }
+};
+
+/**
+ * @brief Нормализованное имя эндпоинта для метрик: путь без адреса API и параметров,
+ * с заменой имени пользователя на ":name".
+ */
+string endpoint_of(const string& url) {
+    string path = url;
+    string base = api_url("");
+    if (path.compare(0, base.size(), base) == 0) {
+        path = path.substr(base.size());
+    }
+    else {
+        size_t scheme = path.find("://");
+        size_t slash = path.find('/', scheme == string::npos ? 0 : scheme + 3);
+        path = slash == string::npos ? "/" : path.substr(slash);
+    }
+
+    path = path.substr(0, path.find('?'));
+    if (path.compare(0, 7, "/users/") == 0) {
+        return "/users/:name";
+    }
+    // Аватары — по файлу на пользователя, в метриках они собираются в одну строку
+    string avatars = avatar_url("");
+    if (url.compare(0, avatars.size(), avatars) == 0) {
+        return "avatar";
+    }
+    return path;
+}
+
+/**
+ * @brief Метрики HTTP-запросов по эндпоинтам.
+ *
+ * Для каждого сетевого запроса сохраняются фазы из CURLINFO_*_TIME_T (DNS, TCP, TLS, ожидание
+ * первого байта, полное время), размер ответа на проводе и после распаковки и время разбора JSON. Фазы установки соединения
+ * учитываются только для новых соединений: у переиспользованных они нулевые и лишь размыли бы картину.
+ *
+ * Отдельно по CURLINFO_CONN_ID ведется учет соединений: версия HTTP, число запросов и наибольшее
+ * число одновременных потоков на соединении (для HTTP/1.1 оно всегда 1).
+ *
+ * Этапы запуска: длительность прогрева соединений и время от старта программы до первого ответа API.
+ *
+ * По перцентилям полного времени ответа подбираются таймауты и задержка перед дублирующим
+ * запросом; сами дубли, победы дублей и повторы после ошибок считаются по эндпоинтам.
+ */
+class RequestMetrics {
+public:
+    enum Phase { Dns, Connect, Tls, FirstByte, Total, Parse, PhaseCount };
+
+    /**
+     * @brief Учитывает завершенную передачу по данным easy-хендла.
+     *
+     * @param decodedBytes Размер тела после распаковки (CURLINFO_SIZE_DOWNLOAD_T считает байты на проводе).
+     * @param connectionId Идентификатор соединения, если он известен заранее: у завершенной передачи,
+     *                     шедшей потоком HTTP/2, CURLINFO_CONN_ID уже возвращает -1.
+     */
+    void record_transfer(const string& url, CURL* handle, const HttpResponse& response, uint64_t decodedBytes,
+        curl_off_t connectionId = -1) {
+        curl_off_t namelookup = 0, connect = 0, appconnect = 0, starttransfer = 0, total = 0, size = 0;
+        curl_easy_getinfo(handle, CURLINFO_NAMELOOKUP_TIME_T, &namelookup);
+        curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME_T, &connect);
+        curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME_T, &appconnect);
+        curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME_T, &starttransfer);
+        curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME_T, &total);
+        curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &size);
+
+        long version = 0;
+        if (connectionId < 0) {
+            curl_easy_getinfo(handle, CURLINFO_CONN_ID, &connectionId);
+        }
+        curl_easy_getinfo(handle, CURLINFO_HTTP_VERSION, &version);
+
+        lock_guard<mutex> lock(metricsMutex);
+        if (response.code == CURLE_OK && !startup.count("first_result")) {
+            startup["first_result"] = chrono::duration<double>(chrono::steady_clock::now() - process_started()).count();
+        }
+        if (response.code == CURLE_OK && connectionId >= 0) {
+            Connection& connection = connections[connectionId];
+            connection.version = version;
+            connection.requests++;
+            connection.peakStreams = max<uint32_t>(connection.peakStreams, 1);
+        }
+
+        Endpoint& endpoint = endpoints[endpoint_of(url)];
+        endpoint.requests++;
+        if (response.code != CURLE_OK || response.status >= 400) {
+            endpoint.errors++;
+        }
+        if (response.code != CURLE_OK) {
+            return;
+        }
+
+        endpoint.wireBytes += (uint64_t)size;
+        endpoint.decodedBytes += decodedBytes;
+        if (!response.reused) {
+            endpoint.phases[Dns].record((uint64_t)namelookup);
+            endpoint.phases[Connect].record((uint64_t)max<curl_off_t>(connect - namelookup, 0));
+            if (appconnect > 0) {
+                endpoint.phases[Tls].record((uint64_t)(appconnect - connect));
+            }
+        }
+        curl_off_t ready = max(appconnect, connect);
+        endpoint.phases[FirstByte].record((uint64_t)max<curl_off_t>(starttransfer - ready, 0));
+        endpoint.phases[Total].record((uint64_t)total);
+    }
+
+    /**
+     * @brief Учитывает время разбора ответа эндпоинта.
+     */
+    void record_parse(const string& endpoint, double seconds) {
+        lock_guard<mutex> lock(metricsMutex);
+        endpoints[endpoint].phases[Parse].record((uint64_t)(seconds * 1e6));
+    }
+
+    /**
+     * @brief Учитывает запрос, объединенный с таким же уже идущим (сеть для него не использовалась).
+     */
+    void record_collapsed(const string& url) {
+        lock_guard<mutex> lock(metricsMutex);
+        endpoints[endpoint_of(url)].collapsed++;
+    }
+
+    /**
+     * @brief Учитывает дублирующий запрос, отправленный из-за долгого ответа.
+     *
+     * @param won Дубль ответил раньше исходного запроса.
+     */
+    void record_hedge(const string& url, bool won) {
+        lock_guard<mutex> lock(metricsMutex);
+        Endpoint& endpoint = endpoints[endpoint_of(url)];
+        endpoint.hedged++;
+        if (won) {
+            endpoint.hedgeWins++;
+        }
+    }
+
+    /**
+     * @brief Учитывает повтор запроса после ошибки.
+     */
+    void record_retry(const string& url) {
+        lock_guard<mutex> lock(metricsMutex);
+        endpoints[endpoint_of(url)].retries++;
+    }
+
+    /**
+     * @brief Перцентиль p (0..1) полного времени ответа эндпоинта в миллисекундах.
+     *
+     * @return 0, пока успешных ответов меньше minSamples: по паре замеров перцентили ничего не говорят.
+     */
+    double total_percentile(const string& url, double p, uint64_t minSamples = 20) {
+        lock_guard<mutex> lock(metricsMutex);
+        auto found = endpoints.find(endpoint_of(url));
+        if (found == endpoints.end() || found->second.phases[Total].count() < minSamples) {
+            return 0;
+        }
+        return found->second.phases[Total].percentile(p) / 1000.0;
+    }
+
+    /**
+     * @brief Учитывает длительность этапа запуска (сохраняется первое значение).
+     */
+    void record_startup(const string& stage, double seconds) {
+        lock_guard<mutex> lock(metricsMutex);
+        startup.emplace(stage, seconds);
+    }
+
+    /**
+     * @brief Учитывает число передач, одновременно идущих по соединению.
+     */
+    void record_streams(curl_off_t connectionId, uint32_t streams) {
+        lock_guard<mutex> lock(metricsMutex);
+        Connection& connection = connections[connectionId];
+        connection.peakStreams = max(connection.peakStreams, streams);
+    }
+
+    bool empty() {
+        lock_guard<mutex> lock(metricsMutex);
+        return endpoints.empty();
+    }
+
+    /**
+     * @brief Сводка по соединениям.
+     */
+    struct ConnectionSummary {
+        uint64_t total = 0;
+        uint64_t http2 = 0;
+        uint64_t http1 = 0;
+        uint64_t requests = 0;
+        uint64_t maxRequests = 0;
+        uint32_t peakStreams = 0;
+
+        double requests_per_connection() const {
+            return total > 0 ? (double)requests / total : 0;
+        }
+    };
+
+    ConnectionSummary connection_summary() {
+        lock_guard<mutex> lock(metricsMutex);
+        return summarize_connections();
+    }
+
+    /**
+     * @brief Таблица для вывода в консоль (времена в миллисекундах).
+     */
+    string table() {
+        lock_guard<mutex> lock(metricsMutex);
+
+        ostringstream out;
+        out << fixed << setprecision(2);
+
+        ConnectionSummary summary = summarize_connections();
+        if (summary.total > 0) {
+            out << "соединений " << summary.total << " (HTTP/2: " << summary.http2 << ", HTTP/1.x: " << summary.http1
+                << "), запросов на соединение " << summary.requests_per_connection() << " (макс. " << summary.maxRequests
+                << "), одновременных потоков до " << summary.peakStreams << '\n';
+        }
+        if (!startup.empty()) {
+            out << "запуск:";
+            if (startup.count("warmup")) {
+                out << " прогрев " << startup.at("warmup") * 1000 << " мс" << (startup.size() > 1 ? "," : "");
+            }
+            if (startup.count("first_result")) {
+                out << " первый ответ через " << startup.at("first_result") * 1000 << " мс после старта";
+            }
+            out << '\n';
+        }
+
+        for (const auto& item : endpoints) {
+            const Endpoint& endpoint = item.second;
+            out << item.first << ": запросов " << endpoint.requests << ", ошибок " << endpoint.errors
+                << ", получено " << endpoint.wireBytes << " Б (после распаковки " << endpoint.decodedBytes << " Б)";
+            if (endpoint.collapsed > 0) {
+                out << ", объединено " << endpoint.collapsed;
+            }
+            if (endpoint.hedged > 0) {
+                out << ", дублей " << endpoint.hedged << " (выиграли " << endpoint.hedgeWins << ")";
+            }
+            if (endpoint.retries > 0) {
+                out << ", повторов " << endpoint.retries;
+            }
+            out << '\n';
+            // setw считает байты, а не символы, поэтому кириллический заголовок выравнивается вручную
+            out << "    фаза        " << right << setw(8) << "n" << setw(10) << "p50"
+                << setw(10) << "p90" << setw(10) << "p99" << setw(10) << "max" << '\n';
+
+            for (int phase = 0; phase < PhaseCount; phase++) {
+                const LatencyHistogram& histogram = endpoint.phases[phase];
+                if (histogram.count() == 0) {
+                    continue;
+                }
+                out << "    " << left << setw(12) << phaseNames[phase] << right << setw(8) << histogram.count()
+                    << setw(10) << histogram.percentile(0.50) / 1000.0 << setw(10) << histogram.percentile(0.90) / 1000.0
+                    << setw(10) << histogram.percentile(0.99) / 1000.0 << setw(10) << histogram.max_value() / 1000.0 << '\n';
+            }
+        }
+        return out.str();
+    }
+
+    json to_json() {
+        lock_guard<mutex> lock(metricsMutex);
+
+        json result = json::object();
+        for (const auto& item : endpoints) {
+            const Endpoint& endpoint = item.second;
+            json& entry = result[item.first];
+            entry["requests"] = endpoint.requests;
+            entry["errors"] = endpoint.errors;
+            entry["wire_bytes"] = endpoint.wireBytes;
+            entry["decoded_bytes"] = endpoint.decodedBytes;
+            entry["collapsed"] = endpoint.collapsed;
+            entry["hedged"] = endpoint.hedged;
+            entry["hedge_wins"] = endpoint.hedgeWins;
+            entry["retries"] = endpoint.retries;
+
+            for (int phase = 0; phase < PhaseCount; phase++) {
+                const LatencyHistogram& histogram = endpoint.phases[phase];
+                if (histogram.count() == 0) {
+                    continue;
+                }
+                entry["phases"][phaseNames[phase]] = {
+                    { "count", histogram.count() },
+                    { "mean_ms", histogram.mean() / 1000.0 },
+                    { "p50_ms", histogram.percentile(0.50) / 1000.0 },
+                    { "p90_ms", histogram.percentile(0.90) / 1000.0 },
+                    { "p99_ms", histogram.percentile(0.99) / 1000.0 },
+                    { "max_ms", histogram.max_value() / 1000.0 }
+                };
+            }
+        }
+
+        ConnectionSummary summary = summarize_connections();
+        if (summary.total > 0) {
+            result["connections"] = {
+                { "total", summary.total },
+                { "http2", summary.http2 },
+                { "http1", summary.http1 },
+                { "requests_per_connection", summary.requests_per_connection() },
+                { "max_requests_per_connection", summary.maxRequests },
+                { "peak_streams_per_connection", summary.peakStreams }
+            };
+        }
+        for (const auto& item : startup) {
+            result["startup"][item.first + "_ms"] = item.second * 1000;
+        }
+        return result;
+    }
+
+    /**
+     * @brief Метрики в текстовом формате Prometheus (фазы — summary с квантилями, в секундах).
+     */
+    string to_prometheus() {
+        lock_guard<mutex> lock(metricsMutex);
+
+        ostringstream out;
+        out << "# TYPE animi_requests_total counter\n";
+        for (const auto& item : endpoints) {
+            out << "animi_requests_total{endpoint=\"" << item.first << "\"} " << item.second.requests << '\n';
+        }
+        out << "# TYPE animi_request_errors_total counter\n";
+        for (const auto& item : endpoints) {
+            out << "animi_request_errors_total{endpoint=\"" << item.first << "\"} " << item.second.errors << '\n';
+        }
+        out << "# TYPE animi_requests_collapsed_total counter\n";
+        for (const auto& item : endpoints) {
+            out << "animi_requests_collapsed_total{endpoint=\"" << item.first << "\"} " << item.second.collapsed << '\n';
+        }
+        out << "# TYPE animi_requests_hedged_total counter\n";
+        for (const auto& item : endpoints) {
+            out << "animi_requests_hedged_total{endpoint=\"" << item.first << "\"} " << item.second.hedged << '\n';
+        }
+        out << "# TYPE animi_hedge_wins_total counter\n";
+        for (const auto& item : endpoints) {
+            out << "animi_hedge_wins_total{endpoint=\"" << item.first << "\"} " << item.second.hedgeWins << '\n';
+        }
+        out << "# TYPE animi_request_retries_total counter\n";
+        for (const auto& item : endpoints) {
+            out << "animi_request_retries_total{endpoint=\"" << item.first << "\"} " << item.second.retries << '\n';
+        }
+        out << "# TYPE animi_response_wire_bytes_total counter\n";
+        for (const auto& item : endpoints) {
+            out << "animi_response_wire_bytes_total{endpoint=\"" << item.first << "\"} " << item.second.wireBytes << '\n';
+        }
+        out << "# TYPE animi_response_decoded_bytes_total counter\n";
+        for (const auto& item : endpoints) {
+            out << "animi_response_decoded_bytes_total{endpoint=\"" << item.first << "\"} " << item.second.decodedBytes << '\n';
+        }
+
+        ConnectionSummary summary = summarize_connections();
+        out << "# TYPE animi_connections_total counter\n";
+        out << "animi_connections_total{http_version=\"2\"} " << summary.http2 << '\n';
+        out << "animi_connections_total{http_version=\"1.1\"} " << summary.http1 << '\n';
+        out << "# TYPE animi_connection_requests_max gauge\n";
+        out << "animi_connection_requests_max " << summary.maxRequests << '\n';
+        out << "# TYPE animi_connection_streams_peak gauge\n";
+        out << "animi_connection_streams_peak " << summary.peakStreams << '\n';
+        out << "# TYPE animi_startup_seconds gauge\n";
+        for (const auto& item : startup) {
+            out << "animi_startup_seconds{stage=\"" << item.first << "\"} " << item.second << '\n';
+        }
+
+        out << "# TYPE animi_request_phase_seconds summary\n";
+        for (const auto& item : endpoints) {
+            for (int phase = 0; phase < PhaseCount; phase++) {
+                const LatencyHistogram& histogram = item.second.phases[phase];
+                if (histogram.count() == 0) {
+                    continue;
+                }
+
+                string labels = "endpoint=\"" + item.first + "\",phase=\"" + phaseNames[phase] + "\"";
+                for (double quantile : { 0.5, 0.9, 0.99 }) {
+                    out << "animi_request_phase_seconds{" << labels << ",quantile=\"" << quantile << "\"} "
+                        << histogram.percentile(quantile) / 1e6 << '\n';
+                }
+                out << "animi_request_phase_seconds_sum{" << labels << "} " << histogram.sum_value() / 1e6 << '\n';
+                out << "animi_request_phase_seconds_count{" << labels << "} " << histogram.count() << '\n';
+            }
+        }
+        return out.str();
+    }
+
+    /**
+     * @brief Записывает метрики в <base>.json и <base>.prom.
+     */
+    bool write(const string& base) {
+        ofstream jsonFile(base + ".json", ios::trunc);
+        jsonFile << to_json().dump(4);
+
+        ofstream promFile(base + ".prom", ios::trunc);
+        promFile << to_prometheus();
+
+        return jsonFile.good() && promFile.good();
+    }
+
+private:
+    struct Endpoint {
+        uint64_t requests = 0;
+        uint64_t errors = 0;
+        uint64_t wireBytes = 0;
+        uint64_t decodedBytes = 0;
+        uint64_t collapsed = 0;
+        uint64_t hedged = 0;
+        uint64_t hedgeWins = 0;
+        uint64_t retries = 0;
+        LatencyHistogram phases[PhaseCount];
+    };
+
+    struct Connection {
+        long version = 0;
+        uint64_t requests = 0;
+        uint32_t peakStreams = 0;
+    };
+
+    static constexpr const char* phaseNames[PhaseCount] = { "dns", "connect", "tls", "first_byte", "total", "parse" };
+
+    mutex metricsMutex;
+    map<string, Endpoint> endpoints;
+    map<curl_off_t, Connection> connections;
+    map<string, double> startup;
+
+    ConnectionSummary summarize_connections() const {
+        ConnectionSummary summary;
+        for (const auto& item : connections) {
+            const Connection& connection = item.second;
+            if (connection.requests == 0) {
+                continue;
+            }
+
+            summary.total++;
+            if (connection.version >= CURL_HTTP_VERSION_2_0) {
+                summary.http2++;
+            }
+            else {
+                summary.http1++;
+            }
+            summary.requests += connection.requests;
+            summary.maxRequests = max(summary.maxRequests, connection.requests);
+            summary.peakStreams = max(summary.peakStreams, connection.peakStreams);
+        }
+        return summary;
+    }
+};
+
+/**
+ * @brief Возвращает единственный на процесс набор метрик запросов.
+ */
+RequestMetrics& request_metrics() {
+    static RequestMetrics metrics;
+    return metrics;
+}
+
+/**
+ * @brief Замеряет время разбора ответа от создания до разрушения и записывает его в метрики эндпоинта.
+ */
+class ParseTimer {
+public:
+    explicit ParseTimer(string endpoint)
+        : endpoint(move(endpoint)), started(chrono::steady_clock::now()) {
+    }
+
+    ~ParseTimer() {
+        request_metrics().record_parse(endpoint, chrono::duration<double>(chrono::steady_clock::now() - started).count());
+    }
+
+private:
+    string endpoint;
+    chrono::steady_clock::time_point started;
+};
+
+/**
+ * @brief Таймаут запроса к эндпоинту в миллисекундах.
+ *
+ * Пока ответов мало, используется "request_timeout_ms". Дальше таймаут равен четырем p99 полного
+ * времени ответа, но не меньше "request_timeout_min_ms" и не больше "request_timeout_ms": зависший
+ * запрос обрывается и повторяется, а не держит пользователя 15 секунд.
+ */
+long adaptive_timeout_ms(const string& url) {
+    long ceiling = config.value("request_timeout_ms", 15000L);
+    double p99 = request_metrics().total_percentile(url, 0.99);
+    if (p99 <= 0) {
+        return ceiling;
+    }
+    long floor = min(config.value("request_timeout_min_ms", 1000L), ceiling);
+    return clamp((long)(p99 * 4), floor, ceiling);
+}
+
+/**
+ * @brief Через сколько миллисекунд без ответа отправлять дублирующий запрос: p95 эндпоинта.
+ *
+ * @return 0, если дубли выключены или замеров еще недостаточно.
+ */
+long hedge_delay_ms(const string& url) {
+    if (!config.value("hedge_requests", true)) {
+        return 0;
+    }
+    double p95 = request_metrics().total_percentile(url, 0.95);
+    return p95 > 0 ? max(1L, (long)(p95 + 0.5)) : 0;
+}
+
+/**
+ * @brief Можно ли продублировать запрос: только идемпотентные GET случайного аниме и профиля.
+ */
+bool hedgeable(const HttpRequest& request) {
+    if (request.method != "GET" || !config.value("hedge_requests", true)) {
+        return false;
+    }
+    string endpoint = endpoint_of(request.url);
+    return endpoint == "/anime/random" || endpoint == "/users/:name";
+}
+
+/**
+ * @brief Общий HTTP-клиент процесса.
+ *
+ * Хранит пул переиспользуемых curl easy-хендлов и curl_share, через который все запросы делят
+ * кэш DNS, кэш TLS-сессий и кэш соединений. Благодаря этому повторные запросы к api.animi.club
+ * не платят заново за DNS, TCP и TLS рукопожатия.
+ *
+ * Таймауты подстраиваются под наблюдаемые задержки эндпоинта, временные ошибки повторяются
+ * с экспоненциальной задержкой, а медленные идемпотентные GET дублируются.
+ */
+class HttpClient {
+public:
+    HttpClient() {
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+
+        share = curl_share_init();
+        curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lock_share);
+        curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlock_share);
+        curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+
+        httpVersion = resolve_http_version();
+
+        if (config.value("compression", true)) {
+            LOG_DEBUG("Поддерживаемое сжатие ответов:" + supported_encodings());
+        }
+    }
+
+    ~HttpClient() {
+        join_warmup();
+        for (CURL* handle : pool) {
+            curl_easy_cleanup(handle);
+        }
+        curl_share_cleanup(share);
+        curl_global_cleanup();
+    }
+
+    HttpClient(const HttpClient&) = delete;
+    HttpClient& operator=(const HttpClient&) = delete;
+
+    /**
+     * @brief Берет из пула готовый easy-хендл (или создает новый), подключенный к общему curl_share.
+     */
+    CURL* acquire() {
+        wait_warmup();
+
+        CURL* handle = nullptr;
+        {
+            lock_guard<mutex> lock(poolMutex);
+            if (!pool.empty()) {
+                handle = pool.back();
+                pool.pop_back();
+            }
+        }
+
+        if (!handle) {
+            handle = curl_easy_init();
+        }
+        if (handle) {
+            configure(handle);
+        }
+        return handle;
+    }
+
+    /**
+     * @brief Возвращает хендл в пул. Соединение остается в кэше curl_share и будет переиспользовано.
+     */
+    void release(CURL* handle) {
+        if (!handle) {
+            return;
+        }
+
+        curl_easy_reset(handle);
+
+        lock_guard<mutex> lock(poolMutex);
+        if (pool.size() < maxPooledHandles) {
+            pool.push_back(handle);
+            return;
+        }
+        curl_easy_cleanup(handle);
+    }
+
+    /**
+     * @brief Учитывает, было ли для завершенного запроса открыто новое соединение или переиспользовано старое.
+     *
+     * @return true, если соединение было переиспользовано.
+     */
+    bool count_connection(CURL* handle) {
+        long connects = 0;
+        curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &connects);
+
+        if (connects == 0) {
+            reusedConnections++;
+            return true;
+        }
+        openedConnections += connects;
+        return false;
+    }
+
+    /**
+     * @brief Выполняет запрос на хендле из пула.
+     *
+     * Обрывы, таймауты, ответы 5xx и 429 повторяются до "retry_attempts" раз. Перед повтором
+     * выдерживается случайная пауза от нуля до min("retry_max_ms", "retry_base_ms" * 2^(n-1)),
+     * чтобы клиенты после сбоя не возвращались к серверу все разом. Запросы API только читают
+     * данные, поэтому повторять можно и POST поиска.
+     */
+    HttpResponse perform(const HttpRequest& request) {
+        LogRequestScope scope;
+        long attempts = max(config.value("retry_attempts", 2L), 0L) + 1;
+
+        for (long attempt = 1;; attempt++) {
+            long hedgeDelay = hedgeable(request) ? hedge_delay_ms(request.url) : 0;
+            HttpResponse response = hedgeDelay > 0 ? perform_hedged(request, hedgeDelay) : perform_once(request);
+            if (attempt >= attempts || !retryable(response)) {
+                return response;
+            }
+
+            long pause = retry_backoff_ms(attempt);
+            request_metrics().record_retry(request.url);
+            LOG_WARNING("Повтор запроса " + request.url + " через " + to_string(pause) + " мс: "
+                + (response.code != CURLE_OK ? string(curl_easy_strerror(response.code)) : "HTTP " + to_string(response.status)));
+            this_thread::sleep_for(chrono::milliseconds(pause));
+        }
+    }
+
+    CURLSH* shared() const {
+        return share;
+    }
+
+    /**
+     * @brief Кодировки сжатия, с которыми собран libcurl (через пробел).
+     */
+    static string supported_encodings() {
+        curl_version_info_data* info = curl_version_info(CURLVERSION_NOW);
+
+        string encodings;
+        if (info->features & CURL_VERSION_LIBZ) {
+            encodings += " gzip deflate";
+        }
+#ifdef CURL_VERSION_BROTLI
+        if (info->features & CURL_VERSION_BROTLI) {
+            encodings += " br";
+        }
+#endif
+#ifdef CURL_VERSION_ZSTD
+        if (info->features & CURL_VERSION_ZSTD) {
+            encodings += " zstd";
+        }
+#endif
+        return encodings.empty() ? " нет" : encodings;
+    }
+
+    uint64_t connections_opened() const {
+        return openedConnections;
+    }
+
+    /**
+     * @brief Запускает прогрев в фоновом потоке (повторный вызов ничего не делает).
+     *
+     * Имена хостов API и хранилища аватаров разрешаются параллельно. К API отправляется HEAD,
+     * после которого keep-alive соединение (и TLS-сессия) остается в кэше curl_share и достается
+     * первому настоящему запросу; к хранилищу только устанавливается соединение, чтобы в общем
+     * кэше оказались адрес и TLS-сессия. Пока HEAD к API не завершился, запросы ждут его в acquire(),
+     * а не открывают второе соединение.
+     */
+    void start_warmup(const string& apiUrl, const string& avatarUrl) {
+        lock_guard<mutex> lock(warmupMutex);
+        if (warmer.joinable()) {
+            return;
+        }
+        warmupPending = true;
+        warmer = thread(&HttpClient::warm_up, this, apiUrl, avatarUrl);
+    }
+
+    /**
+     * @brief Дожидается окончания прогрева (не дольше его таймаута в 10 секунд).
+     */
+    void join_warmup() {
+        if (warmer.joinable()) {
+            warmer.join();
+        }
+    }
+
+    /**
+     * @brief Итог прогрева для отладочного вывода (пустая строка, если прогрева не было).
+     */
+    string warmup_status() {
+        lock_guard<mutex> lock(warmupMutex);
+        return warmupStatus;
+    }
+
+    /**
+     * @brief Перечитывает "http_version" из конфигурации для следующих запросов.
+     */
+    void reload_http_version() {
+        httpVersion = resolve_http_version();
+    }
+
+    uint64_t connections_reused() const {
+        return reusedConnections;
+    }
+
+    /**
+     * @brief Пауза перед повтором номер attempt (с 1): "полный разброс" от нуля до экспоненциальной границы.
+     */
+    static long retry_backoff_ms(long attempt) {
+        thread_local mt19937 generator(random_device{}());
+
+        long base = max(config.value("retry_base_ms", 100L), 1L);
+        long ceiling = max(config.value("retry_max_ms", 2000L), base);
+        long bound = attempt > 20 ? ceiling : min(ceiling, base << (attempt - 1));
+        return uniform_int_distribution<long>(0, bound)(generator);
+    }
+
+private:
+    static const size_t maxPooledHandles = 16;
+
+    CURLSH* share = nullptr;
+    mutex shareLocks[CURL_LOCK_DATA_LAST];
+
+    mutex poolMutex;
+    vector<CURL*> pool;
+
+    atomic<uint64_t> openedConnections{ 0 };
+    atomic<uint64_t> reusedConnections{ 0 };
+
+    long httpVersion = CURL_HTTP_VERSION_1_1;
+
+    thread warmer;
+    mutex warmupMutex;
+    condition_variable warmupDone;
+    bool warmupPending = false;
+    string warmupStatus;
+
+    /**
+     * @brief Ошибки, после которых запрос стоит повторить: сбой сети, таймаут, перегрузка сервера.
+     */
+    static bool retryable(const HttpResponse& response) {
+        switch (response.code) {
+        case CURLE_OK:
+            return response.status >= 500 || response.status == 429;
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_GOT_NOTHING:
+        case CURLE_PARTIAL_FILE:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static struct curl_slist* request_headers(const HttpRequest& request) {
+        struct curl_slist* headers = NULL;
+        for (const auto& header : request.headers) {
+            headers = curl_slist_append(headers, header.c_str());
+        }
+        return headers;
+    }
+
+    /**
+     * @brief Настраивает хендл из пула на запрос, ответ пишется в response.
+     */
+    static void prepare(CURL* handle, const HttpRequest& request, HttpResponse& response, struct curl_slist* headers) {
+        curl_easy_setopt(handle, CURLOPT_URL, request.url.c_str());
+        curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, write_callback);
+        curl_easy_setopt(handle, CURLOPT_WRITEDATA, &response.body);
+        curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, header_callback);
+        curl_easy_setopt(handle, CURLOPT_HEADERDATA, &response);
+        curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, adaptive_timeout_ms(request.url));
+        if (request.method == "POST") {
+            curl_easy_setopt(handle, CURLOPT_POST, 1L);
+            curl_easy_setopt(handle, CURLOPT_POSTFIELDS, request.body.c_str());
+            curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE, (long)request.body.length());
+        }
+        if (headers) {
+            curl_easy_setopt(handle, CURLOPT_HTTPHEADER, headers);
+        }
+    }
+
+    /**
+     * @brief Одна попытка запроса.
+     */
+    HttpResponse perform_once(const HttpRequest& request) {
+        HttpResponse response;
+
+        CURL* handle = acquire();
+        if (!handle) {
+            response.code = CURLE_FAILED_INIT;
+            return response;
+        }
+
+        struct curl_slist* headers = request_headers(request);
+        prepare(handle, request, response, headers);
+
+        response.code = curl_easy_perform(handle);
+        if (response.code == CURLE_OK) {
+            curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &response.status);
+            response.reused = count_connection(handle);
+        }
+        request_metrics().record_transfer(request.url, handle, response, response.body.size());
+
+        curl_slist_free_all(headers);
+        release(handle);
+
+        return response;
+    }
+
+    /**
+     * @brief Одна попытка с дублем: если за delayMs ответа нет, тот же запрос отправляется еще раз
+     * (по HTTP/2 вторым потоком, иначе по второму соединению). Берется первый успешный ответ,
+     * второй запрос отменяется. Если исходный запрос упал до отправки дубля, ошибка возвращается сразу.
+     */
+    HttpResponse perform_hedged(const HttpRequest& request, long delayMs) {
+        HttpResponse responses[2];
+        CURL* handles[2] = { acquire(), nullptr };
+        bool finished[2] = { false, false };
+        if (!handles[0]) {
+            responses[0].code = CURLE_FAILED_INIT;
+            return responses[0];
+        }
+
+        CURLM* multi = curl_multi_init();
+        if (!multi) {
+            release(handles[0]);
+            return perform_once(request);
+        }
+
+        struct curl_slist* headers = request_headers(request);
+        prepare(handles[0], request, responses[0], headers);
+        curl_multi_add_handle(multi, handles[0]);
+
+        auto deadline = chrono::steady_clock::now() + chrono::milliseconds(delayMs);
+        int winner = -1;
+        while (winner < 0) {
+            int running = 0;
+            curl_multi_perform(multi, &running);
+
+            int queued = 0;
+            while (CURLMsg* message = curl_multi_info_read(multi, &queued)) {
+                if (message->msg != CURLMSG_DONE) {
+                    continue;
+                }
+                int index = message->easy_handle == handles[0] ? 0 : 1;
+                finished[index] = true;
+                responses[index].code = message->data.result;
+                if (message->data.result == CURLE_OK && winner < 0) {
+                    winner = index;
+                }
+            }
+            if (winner >= 0) {
+                break;
+            }
+            if (finished[0] && (!handles[1] || finished[1])) {
+                winner = handles[1] ? 1 : 0;
+                break;
+            }
+
+            auto now = chrono::steady_clock::now();
+            if (!handles[1] && now >= deadline) {
+                handles[1] = acquire();
+                if (handles[1]) {
+                    prepare(handles[1], request, responses[1], headers);
+                    curl_multi_add_handle(multi, handles[1]);
+                    continue;
+                }
+                // Хендл под дубль взять не удалось: просто ждем исходный запрос
+                deadline = (chrono::steady_clock::time_point::max)();
+            }
+
+            int wait = 1000;
+            if (!handles[1] && deadline != (chrono::steady_clock::time_point::max)()) {
+                wait = (int)max<int64_t>(chrono::duration_cast<chrono::milliseconds>(deadline - now).count(), 1);
+            }
+            curl_multi_poll(multi, NULL, 0, min(wait, 1000), NULL);
+        }
+
+        HttpResponse& response = responses[winner];
+        if (response.code == CURLE_OK) {
+            curl_easy_getinfo(handles[winner], CURLINFO_RESPONSE_CODE, &response.status);
+            response.reused = count_connection(handles[winner]);
+        }
+        request_metrics().record_transfer(request.url, handles[winner], response, response.body.size());
+        if (handles[1]) {
+            request_metrics().record_hedge(request.url, winner == 1);
+        }
+
+        // Снятие незавершенной передачи с multi отменяет ее
+        for (CURL* handle : handles) {
+            if (handle) {
+                curl_multi_remove_handle(multi, handle);
+                release(handle);
+            }
+        }
+        curl_multi_cleanup(multi);
+        curl_slist_free_all(headers);
+
+        return move(response);
+    }
+
+    void wait_warmup() {
+        unique_lock<mutex> lock(warmupMutex);
+        warmupDone.wait(lock, [this] { return !warmupPending; });
+    }
+
+    void warm_up(string apiUrl, string avatarUrl) {
+        auto begin = chrono::steady_clock::now();
+
+        CURL* prime = curl_easy_init();
+        CURL* resolve = curl_easy_init();
+        CURLM* multi = curl_multi_init();
+        if (!prime || !resolve || !multi) {
+            curl_easy_cleanup(prime);
+            curl_easy_cleanup(resolve);
+            curl_multi_cleanup(multi);
+            lock_guard<mutex> lock(warmupMutex);
+            warmupPending = false;
+            warmupDone.notify_all();
+            return;
+        }
+
+        configure(prime);
+        curl_easy_setopt(prime, CURLOPT_URL, apiUrl.c_str());
+        curl_easy_setopt(prime, CURLOPT_NOBODY, 1L);
+        curl_easy_setopt(prime, CURLOPT_TIMEOUT, 10L);
+
+        configure(resolve);
+        curl_easy_setopt(resolve, CURLOPT_URL, avatarUrl.c_str());
+        curl_easy_setopt(resolve, CURLOPT_CONNECT_ONLY, 1L);
+        curl_easy_setopt(resolve, CURLOPT_TIMEOUT, 10L);
+
+        curl_multi_add_handle(multi, prime);
+        curl_multi_add_handle(multi, resolve);
+
+        string apiStatus, avatarStatus;
+        int running = 1;
+        while (running > 0) {
+            curl_multi_perform(multi, &running);
+
+            int queued = 0;
+            while (CURLMsg* message = curl_multi_info_read(multi, &queued)) {
+                if (message->msg != CURLMSG_DONE) {
+                    continue;
+                }
+
+                bool isApi = message->easy_handle == prime;
+                double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+                ostringstream line;
+                line << (message->data.result == CURLE_OK ? "" : string(curl_easy_strerror(message->data.result)) + ", ")
+                    << fixed << setprecision(1) << seconds * 1000 << " мс";
+                (isApi ? apiStatus : avatarStatus) = line.str();
+
+                if (isApi) {
+                    lock_guard<mutex> lock(warmupMutex);
+                    warmupPending = false;
+                    warmupDone.notify_all();
+                }
+            }
+
+            if (running > 0) {
+                curl_multi_poll(multi, NULL, 0, 1000, NULL);
+            }
+        }
+
+        curl_multi_remove_handle(multi, prime);
+        curl_multi_remove_handle(multi, resolve);
+        curl_multi_cleanup(multi);
+        // Соединение с API остается в общем кэше, соединение CONNECT_ONLY закрывается вместе с хендлом
+        curl_easy_cleanup(prime);
+        curl_easy_cleanup(resolve);
+
+        request_metrics().record_startup("warmup", chrono::duration<double>(chrono::steady_clock::now() - begin).count());
+
+        lock_guard<mutex> lock(warmupMutex);
+        warmupStatus = "API " + apiStatus + ", аватары " + avatarStatus;
+    }
+
+    /**
+     * @brief Версия HTTP из настройки "http_version": "2" (HTTP/2 через ALPN с откатом на HTTP/1.1),
+     * "2-prior-knowledge" (HTTP/2 без TLS, сервер обязан его понимать) или "1.1".
+     *
+     * Если libcurl собран без nghttp2, используется HTTP/1.1 с keep-alive.
+     */
+    static long resolve_http_version() {
+        string wanted = config.value("http_version", string("2"));
+        if (wanted == "1.1") {
+            return CURL_HTTP_VERSION_1_1;
+        }
+
+        if (!(curl_version_info(CURLVERSION_NOW)->features & CURL_VERSION_HTTP2)) {
+            LOG_INFO("libcurl собран без HTTP/2, запросы пойдут по HTTP/1.1");
+            return CURL_HTTP_VERSION_1_1;
+        }
+        return wanted == "2-prior-knowledge" ? CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE : CURL_HTTP_VERSION_2TLS;
+    }
+
+    /**
+     * @brief Общие для всех запросов настройки хендла.
+     */
+    void configure(CURL* handle) {
+        curl_easy_setopt(handle, CURLOPT_SHARE, share);
+        curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, httpVersion);
+        curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT_MS, config.value("connect_timeout_ms", 5000L));
+
+        // Пустая строка: curl предлагает все поддерживаемые сборкой кодировки (gzip, br, zstd)
+        // и распаковывает ответ по частям прямо в обработчик записи
+        if (config.value("compression", true)) {
+            curl_easy_setopt(handle, CURLOPT_ACCEPT_ENCODING, "");
+        }
+
+        // Сертификат для локального HTTPS-стенда
+        string caFile = config.value("ca_file", string());
+        if (!caFile.empty()) {
+            curl_easy_setopt(handle, CURLOPT_CAINFO, caFile.c_str());
+        }
+    }
+
+    static void lock_share(CURL*, curl_lock_data data, curl_lock_access, void* userptr) {
+        static_cast<HttpClient*>(userptr)->shareLocks[data].lock();
+    }
+
+    static void unlock_share(CURL*, curl_lock_data data, void* userptr) {
+        static_cast<HttpClient*>(userptr)->shareLocks[data].unlock();
+    }
+};
+
+/**
+ * @brief Возвращает единственный на процесс экземпляр HTTP-клиента.
+ */
+HttpClient& http_client() {
+    static HttpClient client;
+    return client;
+}
+
+/**
+ * @brief Транспорт, через который выполняются запросы к API.
+ *
+ * Позволяет подменить сеть: живой curl, запись трафика в журнал или воспроизведение журнала.
+ * Выбирается ключом "transport" в config.json ("live", "record", "replay").
+ */
+class Transport {
+public:
+    virtual ~Transport() = default;
+
+    /**
+     * @brief Выполняет запрос и возвращает ответ.
+     */
+    virtual HttpResponse perform(const HttpRequest& request) = 0;
+
+    /**
+     * @brief Идут ли запросы в сеть. Только тогда пакетный исполнитель и потоковый разбор
+     * могут работать с curl напрямую, иначе они обращаются к perform().
+     */
+    virtual bool live() const {
+        return true;
+    }
+
+    /**
+     * @brief Сохраняет запрос, выполненный в обход perform() (пакетом или потоково).
+     */
+    virtual void record(const HttpRequest&, const HttpResponse&, double) {
+    }
+
+    /**
+     * @brief Нужно ли передавать в record() тело ответа (потоковый разбор его иначе не сохраняет).
+     */
+    virtual bool recording() const {
+        return false;
+    }
+};
+
+/**
+ * @brief Живой транспорт: запросы выполняются общим HTTP-клиентом.
+ */
+class LiveTransport : public Transport {
+public:
+    HttpResponse perform(const HttpRequest& request) override {
+        return http_client().perform(request);
+    }
+};
+
+/**
+ * @brief Формат журнала трафика.
+ *
+ * Файл начинается с "AMTL" и версии (uint32), дальше идут записи: длина записи (uint32),
+ * смещение от начала записи журнала и длительность запроса в микросекундах (uint64, uint32),
+ * код curl и HTTP-статус (uint32), затем строки method, url, body, etag, last_modified и тело ответа,
+ * каждая с префиксом длины (uint32). Все числа little-endian.
+ */
+const char trafficMagic[4] = { 'A', 'M', 'T', 'L' };
+const uint32_t trafficVersion = 1;
+
+void put_u32(string& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back((char)(value >> (i * 8)));
+    }
+}
+
+void put_u64(string& out, uint64_t value) {
+    put_u32(out, (uint32_t)value);
+    put_u32(out, (uint32_t)(value >> 32));
+}
+
+void put_string(string& out, const string& value) {
+    put_u32(out, (uint32_t)value.size());
+    out += value;
+}
+
+/**
+ * @brief Последовательно читает поля записи журнала; при выходе за границы выставляет ok = false.
+ */
+struct TrafficReader {
+    const char* data;
+    size_t size;
+    size_t offset = 0;
+    bool ok = true;
+
+    uint32_t u32() {
+        if (offset + 4 > size) {
+            ok = false;
+            return 0;
+        }
+        uint32_t value = 0;
+        for (int i = 0; i < 4; i++) {
+            value |= (uint32_t)(unsigned char)data[offset + i] << (i * 8);
+        }
+        offset += 4;
+        return value;
+    }
+
+    uint64_t u64() {
+        uint64_t low = u32();
+        return low | (uint64_t)u32() << 32;
+    }
+
+    string text() {
+        uint32_t length = u32();
+        if (!ok || offset + length > size) {
+            ok = false;
+            return string();
+        }
+        string value(data + offset, length);
+        offset += length;
+        return value;
+    }
+};
+
+/**
+ * @brief Запись журнала: запрос, ответ и тайминги.
+ */
+struct TrafficRecord {
+    HttpRequest request;
+    HttpResponse response;
+    uint64_t offsetMicros = 0;
+    uint32_t durationMicros = 0;
+};
+
+/**
+ * @brief Транспорт, который выполняет запросы по сети и дописывает их в журнал.
+ */
+class RecordingTransport : public Transport {
+public:
+    explicit RecordingTransport(const string& path)
+        : started(chrono::steady_clock::now()) {
+        bool exists = filesystem::exists(path);
+        file.open(path, ios::binary | ios::app);
+        if (!exists) {
+            string header(trafficMagic, 4);
+            put_u32(header, trafficVersion);
+            file << header;
+        }
+    }
+
+    HttpResponse perform(const HttpRequest& request) override {
+        auto begin = chrono::steady_clock::now();
+        HttpResponse response = http_client().perform(request);
+        record(request, response, chrono::duration<double>(chrono::steady_clock::now() - begin).count());
+        return response;
+    }
+
+    void record(const HttpRequest& request, const HttpResponse& response, double seconds) override {
+        string payload;
+        put_u64(payload, chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - started).count());
+        put_u32(payload, (uint32_t)(seconds * 1e6));
+        put_u32(payload, (uint32_t)response.code);
+        put_u32(payload, (uint32_t)response.status);
+        put_string(payload, request.method);
+        put_string(payload, request.url);
+        put_string(payload, request.body);
+        put_string(payload, response.etag);
+        put_string(payload, response.lastModified);
+        put_string(payload, response.body);
+
+        string length;
+        put_u32(length, (uint32_t)payload.size());
+
+        lock_guard<mutex> lock(fileMutex);
+        file << length << payload;
+        file.flush();
+    }
+
+    bool recording() const override {
+        return true;
+    }
+
+private:
+    mutex fileMutex;
+    ofstream file;
+    chrono::steady_clock::time_point started;
+};
+
+/**
+ * @brief Транспорт, который отвечает из журнала без обращения к сети.
+ *
+ * Ответы подбираются по методу, URL и телу запроса. Если одинаковых запросов в журнале
+ * несколько, они отдаются по кругу в порядке записи, поэтому прогон детерминирован.
+ * При paced каждый ответ задерживается на записанную длительность запроса.
+ */
+class ReplayTransport : public Transport {
+public:
+    ReplayTransport(const string& path, bool paced)
+        : paced(paced) {
+        ifstream file(path, ios::binary);
+        string data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+        TrafficReader reader{ data.data(), data.size() };
+        if (data.compare(0, 4, string(trafficMagic, 4)) != 0) {
+            return;
+        }
+        reader.offset = 4;
+        if (reader.u32() != trafficVersion) {
+            return;
+        }
+
+        while (reader.offset < data.size()) {
+            uint32_t length = reader.u32();
+            if (!reader.ok || reader.offset + length > data.size()) {
+                break;
+            }
+
+            TrafficReader entry{ data.data() + reader.offset, length };
+            reader.offset += length;
+
+            TrafficRecord record;
+            record.offsetMicros = entry.u64();
+            record.durationMicros = entry.u32();
+            record.response.code = (CURLcode)entry.u32();
+            record.response.status = entry.u32();
+            record.request.method = entry.text();
+            record.request.url = entry.text();
+            record.request.body = entry.text();
+            record.response.etag = entry.text();
+            record.response.lastModified = entry.text();
+            record.response.body = entry.text();
+            if (!entry.ok) {
+                break;
+            }
+
+            string key = record.request.method + " " + record.request.url + " " + record.request.body;
+            records[key].responses.push_back(move(record));
+            count++;
+        }
+    }
+
+    HttpResponse perform(const HttpRequest& request) override {
+        const TrafficRecord* record = nullptr;
+        {
+            lock_guard<mutex> lock(recordsMutex);
+            auto it = records.find(request.method + " " + request.url + " " + request.body);
+            if (it != records.end()) {
+                Slot& slot = it->second;
+                record = &slot.responses[slot.next++ % slot.responses.size()];
+            }
+        }
+
+        if (!record) {
+            LOG_ERROR("В журнале нет ответа на " + request.method + " " + request.url);
+            HttpResponse missing;
+            missing.code = CURLE_COULDNT_CONNECT;
+            return missing;
+        }
+
+        if (paced) {
+            this_thread::sleep_for(chrono::microseconds(record->durationMicros));
+        }
+        return record->response;
+    }
+
+    bool live() const override {
+        return false;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+private:
+    struct Slot {
+        vector<TrafficRecord> responses;
+        size_t next = 0;
+    };
+
+    bool paced;
+    size_t count = 0;
+    mutex recordsMutex;
+    map<string, Slot> records;
+};
+
+/**
+ * @brief Возвращает транспорт, выбранный в config.json ("transport", "transport_log", "replay_pace").
+ */
+Transport& transport() {
+    static unique_ptr<Transport> instance = []() -> unique_ptr<Transport> {
+        string mode = config.value("transport", string("live"));
+        string path = config.value("transport_log", string("traffic.bin"));
+
+        if (mode == "record") {
+            LOG_INFO("Трафик записывается в " + path);
+            return make_unique<RecordingTransport>(path);
+        }
+        if (mode == "replay") {
+            auto replay = make_unique<ReplayTransport>(path, config.value("replay_pace", false));
+            LOG_INFO("Воспроизводится журнал " + path + ": записей " + to_string(replay->size()));
+            return replay;
+        }
+        return make_unique<LiveTransport>();
+    }();
+    return *instance;
+}
+
+/**
+ * @brief Возвращает текущее время в секундах Unix.
+ */
+int64_t unix_now() {
+    return chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Хэш FNV-1a (64 бита) строки.
+ */
+uint64_t fnv1a_hash(const string& data) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief SHA-256 (FIPS 180-4) строки в шестнадцатеричном виде.
+ */
+string sha256_hex(const string& data) {
+    static const uint32_t constants[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+    uint32_t state[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    auto rotate = [](uint32_t value, int bits) {
+        return (value >> bits) | (value << (32 - bits));
+    };
+
+    // Последний блок с дополнением: 0x80, нули и длина сообщения в битах (big-endian)
+    size_t tailStart = data.size() / 64 * 64;
+    string tail = data.substr(tailStart);
+    tail.push_back((char)0x80);
+    tail.append((tail.size() <= 56 ? 56 : 120) - tail.size(), '\0');
+    uint64_t bits = (uint64_t)data.size() * 8;
+    for (int i = 7; i >= 0; i--) {
+        tail.push_back((char)(bits >> (i * 8)));
+    }
+
+    auto compress = [&](const unsigned char* block) {
+        uint32_t words[64];
+        for (int i = 0; i < 16; i++) {
+            words[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 | (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotate(words[i - 15], 7) ^ rotate(words[i - 15], 18) ^ (words[i - 15] >> 3);
+            uint32_t s1 = rotate(words[i - 2], 17) ^ rotate(words[i - 2], 19) ^ (words[i - 2] >> 10);
+            words[i] = words[i - 16] + s0 + words[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = h + (rotate(e, 6) ^ rotate(e, 11) ^ rotate(e, 25)) + ((e & f) ^ (~e & g)) + constants[i] + words[i];
+            uint32_t t2 = (rotate(a, 2) ^ rotate(a, 13) ^ rotate(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    };
+
+    for (size_t offset = 0; offset < tailStart; offset += 64) {
+        compress((const unsigned char*)data.data() + offset);
+    }
+    for (size_t offset = 0; offset < tail.size(); offset += 64) {
+        compress((const unsigned char*)tail.data() + offset);
+    }
+
+    stringstream digest;
+    digest << hex << setfill('0');
+    for (uint32_t word : state) {
+        digest << setw(8) << word;
+    }
+    return digest.str();
+}
+
+/**
+ * @brief Постоянный кэш HTTP-ответов на диске.
+ *
+ * Ответы хранятся в каталоге "cache_dir" (по умолчанию ./cache), по файлу на ключ
+ * (метод + URL + тело запроса). Время жизни задается для каждого эндпоинта в "cache_ttl"
+ * (префикс пути → секунды). Устаревшие записи еще "cache_stale_seconds" секунд отдаются сразу,
+ * а в фоне перепроверяются условным запросом с If-None-Match/If-Modified-Since.
+ * Суммарный размер ограничен "cache_max_bytes", при превышении удаляются давно не читанные записи.
+ */
+class ResponseCache {
+public:
+    struct Entry {
+        HttpResponse response;
+        int64_t storedAt = 0;
+    };
+
+    ResponseCache() {
+        directory = config.value("cache_dir", string("cache"));
+        maxBytes = config.value("cache_max_bytes", (uint64_t)16 * 1024 * 1024);
+        staleSeconds = config.value("cache_stale_seconds", (int64_t)86400);
+
+        // При записи и воспроизведении трафика каждый запрос должен дойти до транспорта
+        enabled = config.value("transport", string("live")) == "live";
+
+        if (config.contains("cache_ttl") && config["cache_ttl"].is_object()) {
+            for (const auto& item : config["cache_ttl"].items()) {
+                ttls.emplace_back(item.key(), item.value().get<int64_t>());
+            }
+        }
+        else {
+            ttls.emplace_back("/anime/search", 3600);
+            ttls.emplace_back("/users/", 600);
+        }
+
+        error_code error;
+        filesystem::create_directories(directory, error);
+        for (const auto& file : filesystem::directory_iterator(directory, error)) {
+            if (!file.is_regular_file()) {
+                continue;
+            }
+            // Недописанная запись от прерванного процесса
+            if (file.path().extension() == ".tmp") {
+                filesystem::remove(file.path(), error);
+                continue;
+            }
+            uint64_t size = file.file_size(error);
+            files[file.path().filename().string()] = { size, accessCounter++ };
+            totalBytes += size;
+        }
+    }
+
+    /**
+     * @brief Время жизни ответа для запроса в секундах (0 — запрос не кэшируется).
+     */
+    int64_t ttl_for(const HttpRequest& request) const {
+        if (!enabled) {
+            return 0;
+        }
+
+        string base = api_url("");
+        if (request.url.compare(0, base.size(), base) != 0) {
+            return 0;
+        }
+
+        string path = request.url.substr(base.size());
+        for (const auto& ttl : ttls) {
+            if (path.compare(0, ttl.first.size(), ttl.first) == 0) {
+                return ttl.second;
+            }
+        }
+        return 0;
+    }
+
+    int64_t stale_seconds() const {
+        return staleSeconds;
+    }
+
+    /**
+     * @brief Включает или отключает кэш (например, для нагрузочного прогона).
+     */
+    void set_enabled(bool value) {
+        enabled = value;
+    }
+
+    /**
+     * @brief Загружает запись из кэша.
+     *
+     * @return true, если запись найдена.
+     */
+    bool load(const HttpRequest& request, Entry& entry) {
+        string name = file_name(request);
+
+        ifstream file(directory + "/" + name, ios::binary);
+        if (!file.good()) {
+            return false;
+        }
+
+        string header;
+        getline(file, header);
+        try {
+            json meta = json::parse(header);
+            if (meta.value("method", "") != request.method || meta.value("url", "") != request.url
+                || meta.value("body", "") != request.body) {
+                return false;
+            }
+
+            entry.response.status = meta.value("status", 0L);
+            entry.response.etag = meta.value("etag", "");
+            entry.response.lastModified = meta.value("last_modified", "");
+            entry.storedAt = meta.value("stored_at", (int64_t)0);
+        }
+        catch (const json::exception&) {
+            return false;
+        }
+
+        entry.response.body.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        bytesRead += header.size() + 1 + entry.response.body.size();
+
+        lock_guard<mutex> lock(filesMutex);
+        auto it = files.find(name);
+        if (it != files.end()) {
+            it->second.lastAccess = accessCounter++;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Сохраняет ответ в кэш и при необходимости вытесняет старые записи.
+     */
+    void store(const HttpRequest& request, const HttpResponse& response) {
+        json meta;
+        meta["method"] = request.method;
+        meta["url"] = request.url;
+        meta["body"] = request.body;
+        meta["status"] = response.status;
+        meta["etag"] = response.etag;
+        meta["last_modified"] = response.lastModified;
+        meta["stored_at"] = unix_now();
+
+        string name = file_name(request);
+        string header = meta.dump();
+
+        // Запись готовится во временном файле и подменяется целиком: load из других потоков
+        // видит либо прежнюю запись, либо новую, но не обрезанную. Имя временного файла
+        // уникально, потому что один и тот же ответ могут сохранять несколько потоков и процессов сразу
+        string path = directory + "/" + name;
+        string temporary = path + "." + temporaryPrefix + to_string(temporaryCounter++) + ".tmp";
+        {
+            ofstream file(temporary, ios::binary | ios::trunc);
+            file << header << '\n' << response.body;
+            if (!file.good()) {
+                file.close();
+                error_code error;
+                filesystem::remove(temporary, error);
+                return;
+            }
+        }
+
+        error_code error;
+        filesystem::rename(temporary, path, error);
+        if (error) {
+            filesystem::remove(temporary, error);
+            return;
+        }
+
+        uint64_t size = header.size() + 1 + response.body.size();
+        bytesWritten += size;
+
+        lock_guard<mutex> lock(filesMutex);
+        auto it = files.find(name);
+        if (it != files.end()) {
+            totalBytes -= it->second.size;
+        }
+        files[name] = { size, accessCounter++ };
+        totalBytes += size;
+
+        evict();
+    }
+
+    void count_hit() {
+        hits++;
+    }
+
+    void count_stale_hit() {
+        staleHits++;
+    }
+
+    void count_miss() {
+        misses++;
+    }
+
+    void count_revalidation() {
+        revalidations++;
+    }
+
+    /**
+     * @brief Строка со статистикой кэша для отладочного вывода.
+     */
+    string stats() const {
+        return "попаданий " + to_string(hits) + ", устаревших " + to_string(staleHits)
+            + ", промахов " + to_string(misses) + ", подтверждено 304: " + to_string(revalidations)
+            + ", прочитано " + to_string(bytesRead) + " Б, записано " + to_string(bytesWritten)
+            + " Б, вытеснено " + to_string(evictions) + ", размер " + to_string(totalBytes) + " Б";
+    }
+
+private:
+    struct FileInfo {
+        uint64_t size;
+        uint64_t lastAccess;
+    };
+
+    string directory;
+    bool enabled = true;
+    uint64_t maxBytes;
+    int64_t staleSeconds;
+    vector<pair<string, int64_t>> ttls;
+
+    mutex filesMutex;
+    map<string, FileInfo> files;
+    uint64_t totalBytes = 0;
+    uint64_t accessCounter = 0;
+
+    atomic<uint64_t> hits{ 0 };
+    atomic<uint64_t> staleHits{ 0 };
+    atomic<uint64_t> misses{ 0 };
+    atomic<uint64_t> revalidations{ 0 };
+    atomic<uint64_t> bytesRead{ 0 };
+    atomic<uint64_t> bytesWritten{ 0 };
+    atomic<uint64_t> evictions{ 0 };
+    string temporaryPrefix = to_string(random_device{}()) + "-";
+    atomic<uint64_t> temporaryCounter{ 0 };
+
+    static string file_name(const HttpRequest& request) {
+        stringstream name;
+        name << hex << setw(16) << setfill('0') << fnv1a_hash(request.method + '\n' + request.url + '\n' + request.body);
+        return name.str();
+    }
+
+    // Вызывается под filesMutex
+    void evict() {
+        while (totalBytes > maxBytes && !files.empty()) {
+            auto oldest = files.begin();
+            for (auto it = files.begin(); it != files.end(); ++it) {
+                if (it->second.lastAccess < oldest->second.lastAccess) {
+                    oldest = it;
+                }
+            }
+
+            error_code error;
+            filesystem::remove(directory + "/" + oldest->first, error);
+            totalBytes -= oldest->second.size;
+            files.erase(oldest);
+            evictions++;
+        }
+    }
+};
+
+/**
+ * @brief Возвращает общий кэш ответов.
+ */
+ResponseCache& response_cache() {
+    static ResponseCache cache;
+    return cache;
+}
+
+// Фоновые перепроверки кэша выполняет один поток с очередью: он запускается при первой
+// устаревшей записи и останавливается в wait_revalidations
+mutex revalidationMutex;
+condition_variable revalidationReady;
+set<string> revalidatingUrls;
+deque<pair<HttpRequest, ResponseCache::Entry>> revalidationQueue;
+thread revalidationThread;
+bool revalidationStopping = false;
+
+/**
+ * @brief Выполняет условный запрос и обновляет кэш.
+ *
+ * Если сервер ответил 304, в кэше обновляется только время сохранения.
+ *
+ * @return Актуальный ответ: из кэша при 304, иначе полученный от сервера.
+ */
+HttpResponse revalidate(const HttpRequest& request, const ResponseCache::Entry* entry) {
+    HttpRequest conditional = request;
+    if (entry) {
+        if (!entry->response.etag.empty()) {
+            conditional.headers.push_back("If-None-Match: " + entry->response.etag);
+        }
+        if (!entry->response.lastModified.empty()) {
+            conditional.headers.push_back("If-Modified-Since: " + entry->response.lastModified);
+        }
+    }
+
+    HttpResponse response = transport().perform(conditional);
+    if (response.code != CURLE_OK) {
+        return entry ? entry->response : response;
+    }
+
+    if (response.status == 304 && entry) {
+        response_cache().count_revalidation();
+        response_cache().store(request, entry->response);
+        return entry->response;
+    }
+    if (response.status == 200) {
+        response_cache().store(request, response);
+    }
+    return response;
+}
+
+/**
+ * @brief Поток перепроверок: выполняет запросы из очереди, пока wait_revalidations не остановит его.
+ */
+void revalidation_worker() {
+    unique_lock<mutex> lock(revalidationMutex);
+    while (true) {
+        revalidationReady.wait(lock, []() { return revalidationStopping || !revalidationQueue.empty(); });
+        // Перед остановкой очередь дорабатывается до конца
+        if (revalidationQueue.empty()) {
+            return;
+        }
+
+        pair<HttpRequest, ResponseCache::Entry> job = move(revalidationQueue.front());
+        revalidationQueue.pop_front();
+        lock.unlock();
+        revalidate(job.first, &job.second);
+        lock.lock();
+        revalidatingUrls.erase(job.first.method + job.first.url + job.first.body);
+    }
+}
+
+/**
+ * @brief Выполняет запрос с учетом дискового кэша.
+ *
+ * Свежая запись отдается без обращения к сети. Устаревшая, но попадающая в окно
+ * stale-while-revalidate запись отдается сразу, а перепроверка выполняется в фоновом потоке.
+ */
+HttpResponse cached_perform(const HttpRequest& request) {
+    ResponseCache& cache = response_cache();
+
+    int64_t ttl = cache.ttl_for(request);
+    if (ttl <= 0) {
+        return transport().perform(request);
+    }
+
+    ResponseCache::Entry entry;
+    if (!cache.load(request, entry)) {
+        cache.count_miss();
+        return revalidate(request, nullptr);
+    }
+
+    int64_t age = unix_now() - entry.storedAt;
+    if (age < ttl) {
+        cache.count_hit();
+        return entry.response;
+    }
+
+    if (age < ttl + cache.stale_seconds()) {
+        cache.count_stale_hit();
+
+        lock_guard<mutex> lock(revalidationMutex);
+        if (!revalidationStopping && revalidatingUrls.insert(request.method + request.url + request.body).second) {
+            revalidationQueue.emplace_back(request, entry);
+            if (!revalidationThread.joinable()) {
+                revalidationThread = thread(revalidation_worker);
+            }
+            revalidationReady.notify_one();
+        }
+        return entry.response;
+    }
+
+    cache.count_miss();
+    return revalidate(request, &entry);
+}
+
+/**
+ * @brief Дожидается завершения поставленных в очередь перепроверок кэша и останавливает их поток.
+ */
+void wait_revalidations() {
+    {
+        lock_guard<mutex> lock(revalidationMutex);
+        revalidationStopping = true;
+        revalidationReady.notify_all();
+    }
+    if (revalidationThread.joinable()) {
+        revalidationThread.join();
+    }
+}
+
+/**
+ * @brief Формирует тело POST-запроса поиска аниме.
+ *
+ * @param query Поисковый запрос.
+ * @param take Количество записей на странице.
+ * @param skip Сколько записей пропустить от начала выдачи.
+ * @return JSON-строка с экранированным запросом.
+ */
+string search_request_body(const string& query, int take = 5, int skip = 0) {
+    json body;
+    body["query"] = query;
+    body["take"] = take;
+    if (skip > 0) {
+        body["skip"] = skip;
+    }
+    return body.dump();
+}
+
+/**
+ * @brief Запрос случайного аниме (GET /anime/random).
+ */
+HttpRequest random_anime_request() {
+    HttpRequest request;
+    request.url = api_url("/anime/random");
+    return request;
+}
+
+/**
+ * @brief Запрос поиска аниме по названию (POST /anime/search).
+ */
+HttpRequest search_anime_request(const string& query) {
+    HttpRequest request;
+    request.method = "POST";
+    request.url = api_url("/anime/search");
+    request.body = search_request_body(query, config.value("search_top_k", 5));
+    request.headers.push_back("Content-Type: application/json");
+    return request;
+}
+
+/**
+ * @brief Запрос информации о пользователе (GET /users/<name>).
+ */
+HttpRequest user_request(const string& username) {
+    HttpRequest request;
+    request.url = api_url("/users/" + username);
+    return request;
+}
+
+/**
+ * @brief Объединение одновременных одинаковых вызовов (singleflight).
+ *
+ * Первый вызов с данным ключом (ведущий) выполняет работу, остальные вызовы с тем же ключом,
+ * пришедшие до ее окончания, ждут и получают тот же результат через shared_ptr, без копий.
+ * После завершения ключ освобождается: следующий вызов снова выполняет работу.
+ * Исключение ведущего вызова получают все ожидающие.
+ */
+template <class T>
+class SingleFlight {
+public:
+    /**
+     * @brief Выполняет produce() или присоединяется к уже идущему вызову с тем же ключом.
+     *
+     * @param joined Если не nullptr, получает true, когда вызов присоединился к чужому.
+     */
+    shared_ptr<const T> run(const string& key, const function<T()>& produce, bool* joined = nullptr) {
+        unique_lock<mutex> lock(flightsMutex);
+        auto found = flights.find(key);
+        if (joined) {
+            *joined = found != flights.end();
+        }
+        if (found != flights.end()) {
+            shared_future<shared_ptr<const T>> flight = found->second;
+            lock.unlock();
+
+            collapsed++;
+            return flight.get();
+        }
+
+        promise<shared_ptr<const T>> result;
+        flights.emplace(key, result.get_future().share());
+        lock.unlock();
+
+        leaders++;
+        try {
+            result.set_value(make_shared<const T>(produce()));
+        }
+        catch (...) {
+            result.set_exception(current_exception());
+        }
+
+        lock.lock();
+        shared_future<shared_ptr<const T>> flight = flights[key];
+        flights.erase(key);
+        lock.unlock();
+
+        return flight.get();
+    }
+
+    /**
+     * @brief Сколько вызовов выполнили работу сами.
+     */
+    uint64_t leader_count() const {
+        return leaders;
+    }
+
+    /**
+     * @brief Сколько вызовов присоединились к чужому и не выполняли работу.
+     */
+    uint64_t collapsed_count() const {
+        return collapsed;
+    }
+
+private:
+    mutex flightsMutex;
+    unordered_map<string, shared_future<shared_ptr<const T>>> flights;
+
+    atomic<uint64_t> leaders{ 0 };
+    atomic<uint64_t> collapsed{ 0 };
+};
+
+/**
+ * @brief Нормализованный ключ запроса: метод, адрес и тело. JSON-тело приводится к каноническому
+ * виду (ключи по порядку, без пробелов), чтобы одинаковые поиски с разным форматированием совпадали.
+ */
+string request_key(const HttpRequest& request) {
+    string body = request.body;
+    if (!body.empty()) {
+        json parsed = json::parse(body, nullptr, false);
+        if (!parsed.is_discarded()) {
+            body = parsed.dump();
+        }
+    }
+    return request.method + '\n' + request.url + '\n' + body;
+}
+
+/**
+ * @brief Можно ли объединять одинаковые одновременные запросы. Случайное аниме нельзя:
+ * каждый вызов должен получить свою запись.
+ */
+bool coalescable(const HttpRequest& request) {
+    return endpoint_of(request.url) != "/anime/random";
+}
+
+/**
+ * @brief Общий на процесс singleflight для ответов API.
+ */
+SingleFlight<HttpResponse>& request_flights() {
+    static SingleFlight<HttpResponse> flights;
+    return flights;
+}
+
+/**
+ * @brief Выполняет запрос через дисковый кэш, объединяя его с таким же запросом, уже идущим
+ * в другом потоке.
+ */
+shared_ptr<const HttpResponse> coalesced_perform(const HttpRequest& request) {
+    if (!coalescable(request)) {
+        return make_shared<const HttpResponse>(cached_perform(request));
+    }
+
+    bool joined = false;
+    shared_ptr<const HttpResponse> response = request_flights().run(request_key(request), [&request]() {
+        return cached_perform(request);
+    }, &joined);
+    if (joined) {
+        request_metrics().record_collapsed(request.url);
+    }
+    return response;
+}
+
+/**
+ * @brief Выполняет HTTP GET-запрос по указанному URL.
+ *
+ * Функция берет хендл из общего пула HTTP-клиента, устанавливает URL для запроса GET,
+ * выполняет запрос и возвращает полученную строку. Соединение остается открытым
+ * и переиспользуется следующими запросами.
+ *
+ * @param url URL-адрес для выполнения GET-запроса.
+ * @return Строка с данными, полученными в результате GET-запроса.
+ */
+string http_get_request(const string& url) {
+    HttpRequest request;
+    request.url = url;
+
+    shared_ptr<const HttpResponse> response = coalesced_perform(request);
+
+    // Проверяем результат выполнения запроса
+    if (response->code != CURLE_OK) {
+        LOG_ERROR(string("curl_easy_perform() failed: ") + curl_easy_strerror(response->code));
+    }
+
+    return response->body;
+}
+
+/**
+ * @brief Выполняет HTTP POST-запрос по указанному URL.
+ *
+ * Функция берет хендл из общего пула HTTP-клиента, устанавливает URL для запроса POST,
+ * передает тело поиска, выполняет запрос и возвращает полученную строку.
+ *
+ * @param url URL-адрес для выполнения POST-запроса.
+ * @param query Поисковый запрос.
+ * @param take Сколько записей вернуть.
+ * @param skip Сколько записей пропустить от начала результатов.
+ * @return Строка с данными, полученными в результате POST-запроса.
+ */
+string http_post_request(const string& url, const string& query, int take, int skip) {
+    HttpRequest request;
+    request.method = "POST";
+    request.url = url;
+    request.body = search_request_body(query, take, skip);
+    request.headers.push_back("Content-Type: application/json");
+
+    shared_ptr<const HttpResponse> response = coalesced_perform(request);
+    if (response->code != CURLE_OK) {
+        LOG_ERROR("При отправке запроса произошла ошибка: " + string(curl_easy_strerror(response->code)));
+    }
+    else {
+        LOG_DEBUG("Запрос успешно отправлен");
+    }
+
+    return response->body;
+}
+
+/**
+ * @brief Результат одного запроса из пакета.
+ */
+struct BatchResult {
+    size_t index;
+    HttpRequest request;
+    shared_ptr<const HttpResponse> response;
+    double seconds;
+    // Сколько результатов пакета получили этот же ответ (больше 1, если одинаковые запросы объединены)
+    size_t shares = 1;
+};
+
+/**
+ * @brief Пакетный исполнитель запросов на базе curl_multi.
+ *
+ * Выполняет набор запросов одновременно в одном потоке, держа в работе не больше
+ * maxInFlight передач. Результаты отдаются в обработчик по мере завершения, а не в порядке добавления.
+ * Хендлы берутся из пула общего HTTP-клиента, поэтому пакет делит с ним кэш DNS, TLS и соединений.
+ *
+ * Запрос, совпадающий (по request_key) с уже идущей передачей, не отправляется: он ждет ее
+ * и получает тот же ответ через shared_ptr. Отключается через set_coalescing(false).
+ */
+class BatchClient {
+public:
+    explicit BatchClient(size_t maxInFlight)
+        : maxInFlight(maxInFlight > 0 ? maxInFlight : 1), coalescing(config.value("coalesce_requests", true)) {
+    }
+
+    /**
+     * @brief Включает или отключает объединение одинаковых одновременных запросов.
+     */
+    void set_coalescing(bool enabled) {
+        coalescing = enabled;
+    }
+
+    /**
+     * @brief Сколько запросов за время жизни клиента были объединены с уже идущими.
+     */
+    uint64_t collapsed_count() const {
+        return collapsed;
+    }
+
+    /**
+     * @brief Добавляет запрос в пакет.
+     *
+     * @return Порядковый номер запроса в пакете.
+     */
+    size_t submit(HttpRequest request) {
+        pending.push_back(move(request));
+        return pending.size() - 1;
+    }
+
+    size_t size() const {
+        return pending.size();
+    }
+
+    /**
+     * @brief Выполняет все добавленные запросы и вызывает onComplete для каждого завершенного.
+     */
+    void run(const function<void(BatchResult&)>& onComplete) {
+        CURLM* multi = curl_multi_init();
+        curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)maxInFlight);
+        // По HTTP/2 передачи к одному хосту идут потоками одного соединения, а не отдельными соединениями
+        curl_multi_setopt(multi, CURLMOPT_PIPELINING, (long)CURLPIPE_MULTIPLEX);
+        curl_multi_setopt(multi, CURLMOPT_MAX_CONCURRENT_STREAMS, config.value("http2_max_streams", 100L));
+
+        vector<Transfer> transfers(pending.size());
+        size_t next = 0;
+        size_t active = 0;
+        // Ключ идущей передачи -> номера запросов, ждущих ее ответа
+        unordered_map<string, vector<size_t>> inFlight;
+
+        auto start_next = [&]() {
+            while (active < maxInFlight && next < pending.size()) {
+                Transfer& transfer = transfers[next];
+                transfer.result.index = next;
+                transfer.result.request = move(pending[next]);
+                next++;
+
+                // Свежий ответ из дискового кэша не требует передачи
+                ResponseCache::Entry entry;
+                const HttpRequest& request = transfer.result.request;
+                int64_t ttl = response_cache().ttl_for(request);
+                if (ttl > 0) {
+                    if (response_cache().load(request, entry) && unix_now() - entry.storedAt < ttl) {
+                        response_cache().count_hit();
+                        transfer.result.response = make_shared<const HttpResponse>(move(entry.response));
+                        onComplete(transfer.result);
+                        continue;
+                    }
+                    response_cache().count_miss();
+                }
+
+                // Без сети (воспроизведение журнала) запрос выполняется транспортом сразу
+                if (!transport().live()) {
+                    auto begin = chrono::steady_clock::now();
+                    transfer.result.response = make_shared<const HttpResponse>(transport().perform(request));
+                    transfer.result.seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+                    onComplete(transfer.result);
+                    continue;
+                }
+
+                // Такой же запрос уже в работе: ждем его ответа вместо новой передачи
+                if (coalescing && coalescable(request)) {
+                    transfer.key = request_key(request);
+                    auto leader = inFlight.find(transfer.key);
+                    if (leader != inFlight.end()) {
+                        leader->second.push_back(transfer.result.index);
+                        transfer.started = chrono::steady_clock::now();
+                        collapsed++;
+                        request_metrics().record_collapsed(request.url);
+                        continue;
+                    }
+                }
+
+                if (!start(multi, transfer)) {
+                    transfer.result.response = make_shared<const HttpResponse>(move(transfer.response));
+                    onComplete(transfer.result);
+                    continue;
+                }
+                if (!transfer.key.empty()) {
+                    inFlight[transfer.key];
+                }
+                active++;
+            }
+        };
+
+        start_next();
+
+        while (active > 0) {
+            int running = 0;
+            curl_multi_perform(multi, &running);
+
+            int queued = 0;
+            while (CURLMsg* message = curl_multi_info_read(multi, &queued)) {
+                if (message->msg != CURLMSG_DONE) {
+                    continue;
+                }
+
+                Transfer* transfer = nullptr;
+                curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, (char**)&transfer);
+                finish(multi, *transfer, message->data.result);
+                active--;
+
+                vector<size_t> followers;
+                if (!transfer->key.empty()) {
+                    followers = move(inFlight[transfer->key]);
+                    inFlight.erase(transfer->key);
+                }
+
+                shared_ptr<const HttpResponse> response = transfer->result.response;
+                transfer->result.shares = followers.size() + 1;
+                onComplete(transfer->result);
+                *transfer = Transfer();
+
+                for (size_t index : followers) {
+                    Transfer& follower = transfers[index];
+                    follower.result.response = response;
+                    follower.result.shares = followers.size() + 1;
+                    follower.result.seconds = chrono::duration<double>(chrono::steady_clock::now() - follower.started).count();
+                    onComplete(follower.result);
+                    follower = Transfer();
+                }
+            }
+
+            // Завершенные передачи уже отпустили хендлы и не считаются
+            sample_streams(transfers);
+            start_next();
+
+            if (active > 0) {
+                curl_multi_poll(multi, NULL, 0, 1000, NULL);
+            }
+        }
+
+        curl_multi_cleanup(multi);
+        pending.clear();
+    }
+
+private:
+    struct Transfer {
+        BatchResult result{};
+        // Ответ, который curl заполняет во время передачи
+        HttpResponse response;
+        string key;
+        CURL* handle = nullptr;
+        struct curl_slist* headers = NULL;
+        chrono::steady_clock::time_point started;
+        curl_off_t connection = -1;
+    };
+
+    size_t maxInFlight;
+    vector<HttpRequest> pending;
+    bool coalescing;
+    uint64_t collapsed = 0;
+
+    /**
+     * @brief Вызывается curl, когда передача получила соединение и вот-вот отправит запрос.
+     */
+    static int connection_ready(void* clientp, char*, char*, int, int) {
+        Transfer* transfer = static_cast<Transfer*>(clientp);
+        curl_easy_getinfo(transfer->handle, CURLINFO_CONN_ID, &transfer->connection);
+        return CURL_PREREQFUNC_OK;
+    }
+
+    /**
+     * @brief Считает, сколько передач сейчас идет по каждому соединению, и отдает это в метрики.
+     */
+    void sample_streams(const vector<Transfer>& transfers) {
+        map<curl_off_t, uint32_t> streams;
+        for (const Transfer& transfer : transfers) {
+            if (transfer.handle && transfer.connection >= 0) {
+                streams[transfer.connection]++;
+            }
+        }
+        for (const auto& item : streams) {
+            request_metrics().record_streams(item.first, item.second);
+        }
+    }
+
+    bool start(CURLM* multi, Transfer& transfer) {
+        const HttpRequest& request = transfer.result.request;
+
+        transfer.handle = http_client().acquire();
+        if (!transfer.handle) {
+            transfer.response.code = CURLE_FAILED_INIT;
+            return false;
+        }
+
+        for (const auto& header : request.headers) {
+            transfer.headers = curl_slist_append(transfer.headers, header.c_str());
+        }
+
+        curl_easy_setopt(transfer.handle, CURLOPT_URL, request.url.c_str());
+        curl_easy_setopt(transfer.handle, CURLOPT_WRITEFUNCTION, write_callback);
+        curl_easy_setopt(transfer.handle, CURLOPT_WRITEDATA, &transfer.response.body);
+        curl_easy_setopt(transfer.handle, CURLOPT_HEADERFUNCTION, header_callback);
+        curl_easy_setopt(transfer.handle, CURLOPT_HEADERDATA, &transfer.response);
+        curl_easy_setopt(transfer.handle, CURLOPT_PRIVATE, &transfer);
+        curl_easy_setopt(transfer.handle, CURLOPT_TIMEOUT_MS, adaptive_timeout_ms(request.url));
+        // Пока первое соединение не договорилось о версии, остальные передачи ждут его, а не открывают свои
+        curl_easy_setopt(transfer.handle, CURLOPT_PIPEWAIT, 1L);
+        curl_easy_setopt(transfer.handle, CURLOPT_PREREQFUNCTION, connection_ready);
+        curl_easy_setopt(transfer.handle, CURLOPT_PREREQDATA, &transfer);
+        if (request.method == "POST") {
+            curl_easy_setopt(transfer.handle, CURLOPT_POST, 1L);
+            curl_easy_setopt(transfer.handle, CURLOPT_POSTFIELDS, request.body.c_str());
+            curl_easy_setopt(transfer.handle, CURLOPT_POSTFIELDSIZE, (long)request.body.length());
+        }
+        if (transfer.headers) {
+            curl_easy_setopt(transfer.handle, CURLOPT_HTTPHEADER, transfer.headers);
+        }
+
+        transfer.started = chrono::steady_clock::now();
+        curl_multi_add_handle(multi, transfer.handle);
+        return true;
+    }
+
+    void finish(CURLM* multi, Transfer& transfer, CURLcode code) {
+        HttpResponse& response = transfer.response;
+        response.code = code;
+        if (code == CURLE_OK) {
+            curl_easy_getinfo(transfer.handle, CURLINFO_RESPONSE_CODE, &response.status);
+            response.reused = http_client().count_connection(transfer.handle);
+            request_metrics().record_transfer(transfer.result.request.url, transfer.handle, response, response.body.size(), transfer.connection);
+
+            if (response.status == 200 && response_cache().ttl_for(transfer.result.request) > 0) {
+                response_cache().store(transfer.result.request, response);
+            }
+        }
+        else {
+            request_metrics().record_transfer(transfer.result.request.url, transfer.handle, response, response.body.size(), transfer.connection);
+        }
+        transfer.result.seconds = chrono::duration<double>(chrono::steady_clock::now() - transfer.started).count();
+        transport().record(transfer.result.request, response, transfer.result.seconds);
+
+        curl_multi_remove_handle(multi, transfer.handle);
+        curl_slist_free_all(transfer.headers);
+        transfer.headers = NULL;
+        http_client().release(transfer.handle);
+        transfer.handle = nullptr;
+        transfer.connection = -1;
+
+        transfer.result.response = make_shared<const HttpResponse>(move(response));
+    }
+};
+
+/**
+ * @brief Локальное хранилище аватаров с адресацией по содержимому.
+ *
+ * Каждая картинка лежит в каталоге хранилища один раз, в файле с именем из SHA-256 содержимого,
+ * поэтому одинаковые аватары разных пользователей занимают место однажды. Индекс index.json
+ * связывает адрес аватара с хэшем и ETag ответа: повторная загрузка идет условным запросом
+ * с If-None-Match, и неизменившийся аватар приходит ответом 304 без тела. Суммарный размер
+ * файлов ограничен, при превышении удаляются давно не использованные.
+ */
+class AvatarStore {
+public:
+    /**
+     * @brief Итог загрузки одного аватара.
+     */
+    struct Result {
+        string url;
+        string hash;
+        uint64_t size = 0;
+        // "downloaded" — новый файл, "duplicate" — такой файл уже был, "not_modified" — ответ 304;
+        // при ошибке status пуст, а причина в error
+        string status;
+        string error;
+    };
+
+    AvatarStore(const string& directory, uint64_t maxBytes)
+        : directory(directory), maxBytes(maxBytes) {
+        error_code error;
+        filesystem::create_directories(directory, error);
+
+        json index;
+        ifstream file(directory + "/index.json");
+        if (file.good()) {
+            index = json::parse(file, nullptr, false);
+        }
+        json accessed = index.is_object() ? index.value("blobs", json::object()) : json::object();
+
+        // Файлы берутся с диска: записанный, но не попавший в индекс файл тоже учитывается в размере
+        for (const auto& entry : filesystem::directory_iterator(directory, error)) {
+            string name = entry.path().filename().string();
+            if (!entry.is_regular_file() || name.size() != 64 || name.find_first_not_of("0123456789abcdef") != string::npos) {
+                continue;
+            }
+            uint64_t size = entry.file_size(error);
+            uint64_t lastAccess = accessed.value(name, (uint64_t)0);
+            blobs[name] = { size, lastAccess };
+            totalBytes += size;
+            accessCounter = max(accessCounter, lastAccess + 1);
+        }
+
+        if (index.is_object() && index.contains("sources") && index["sources"].is_object()) {
+            for (const auto& item : index["sources"].items()) {
+                string hash = item.value().value("sha256", string());
+                if (blobs.count(hash)) {
+                    sources[item.key()] = { hash, item.value().value("etag", string()) };
+                }
+            }
+        }
+    }
+
+    AvatarStore(const AvatarStore&) = delete;
+    AvatarStore& operator=(const AvatarStore&) = delete;
+
+    /**
+     * @brief Загружает аватары по адресам одновременно (не больше concurrency передач).
+     *
+     * @return Результаты в порядке адресов.
+     */
+    vector<Result> fetch(const vector<string>& urls, size_t concurrency) {
+        vector<Result> results(urls.size());
+        BatchClient batch(concurrency);
+        for (size_t i = 0; i < urls.size(); i++) {
+            results[i].url = urls[i];
+
+            HttpRequest request;
+            request.url = urls[i];
+            {
+                lock_guard<mutex> lock(indexMutex);
+                auto source = sources.find(urls[i]);
+                if (source != sources.end() && !source->second.etag.empty()) {
+                    request.headers.push_back("If-None-Match: " + source->second.etag);
+                }
+            }
+            batch.submit(move(request));
+        }
+
+        batch.run([&](BatchResult& result) {
+            store(results[result.index], *result.response);
+        });
+
+        lock_guard<mutex> lock(indexMutex);
+        evict();
+        save();
+
+        // Если пакет не уместился в бюджет, его первые файлы уже вытеснены
+        for (auto& result : results) {
+            if (!result.hash.empty() && !blobs.count(result.hash)) {
+                result.error = "файл вытеснен: пакет не помещается в хранилище";
+                result.status.clear();
+            }
+        }
+        return results;
+    }
+
+    string blob_path(const string& hash) const {
+        return directory + "/" + hash;
+    }
+
+    /**
+     * @brief Запрещает вытеснять файл hash, пока он передается клиенту. Каждому успешному
+     * вызову соответствует вызов unpin.
+     *
+     * @return false, если файла уже нет в хранилище.
+     */
+    bool pin(const string& hash) {
+        lock_guard<mutex> lock(indexMutex);
+        if (!blobs.count(hash)) {
+            return false;
+        }
+        pinned[hash]++;
+        return true;
+    }
+
+    void unpin(const string& hash) {
+        lock_guard<mutex> lock(indexMutex);
+        auto pin = pinned.find(hash);
+        if (pin != pinned.end() && --pin->second == 0) {
+            pinned.erase(pin);
+        }
+    }
+
+    uint64_t total_bytes() {
+        lock_guard<mutex> lock(indexMutex);
+        return totalBytes;
+    }
+
+    size_t blob_count() {
+        lock_guard<mutex> lock(indexMutex);
+        return blobs.size();
+    }
+
+    uint64_t bytes_downloaded() const {
+        return bytesDownloaded;
+    }
+
+    /**
+     * @brief Строка со статистикой хранилища.
+     */
+    string stats() {
+        lock_guard<mutex> lock(indexMutex);
+        return "файлов " + to_string(blobs.size()) + ", " + to_string(totalBytes / 1024) + " КБ из "
+            + to_string(maxBytes / 1024) + " КБ; загружено " + to_string(downloaded) + " (" + to_string(bytesDownloaded / 1024)
+            + " КБ), дубликатов " + to_string(duplicates) + ", без изменений (304) " + to_string(notModified)
+            + ", ошибок " + to_string(failed) + ", вытеснено " + to_string(evictions);
+    }
+
+private:
+    struct Source {
+        string hash;
+        string etag;
+    };
+
+    struct Blob {
+        uint64_t size;
+        uint64_t lastAccess;
+    };
+
+    string directory;
+    uint64_t maxBytes;
+
+    mutex indexMutex;
+    map<string, Source> sources;
+    map<string, Blob> blobs;
+    map<string, size_t> pinned;
+    uint64_t totalBytes = 0;
+    uint64_t accessCounter = 1;
+
+    atomic<uint64_t> downloaded{ 0 };
+    atomic<uint64_t> duplicates{ 0 };
+    atomic<uint64_t> notModified{ 0 };
+    atomic<uint64_t> failed{ 0 };
+    atomic<uint64_t> evictions{ 0 };
+    atomic<uint64_t> bytesDownloaded{ 0 };
+
+    void store(Result& result, const HttpResponse& response) {
+        if (response.code != CURLE_OK || (response.status != 200 && response.status != 304)) {
+            result.error = response.code != CURLE_OK ? curl_easy_strerror(response.code) : "HTTP " + to_string(response.status);
+            failed++;
+            return;
+        }
+
+        // Хэш считается до захвата индекса: загрузки могут завершаться в нескольких потоках сервера
+        string hash = response.status == 200 ? sha256_hex(response.body) : string();
+
+        lock_guard<mutex> lock(indexMutex);
+        if (response.status == 304) {
+            auto source = sources.find(result.url);
+            auto blob = source != sources.end() ? blobs.find(source->second.hash) : blobs.end();
+            if (blob == blobs.end()) {
+                result.error = "ответ 304 на аватар, которого нет в хранилище";
+                failed++;
+                return;
+            }
+            blob->second.lastAccess = accessCounter++;
+            result.hash = blob->first;
+            result.size = blob->second.size;
+            result.status = "not_modified";
+            notModified++;
+            return;
+        }
+
+        bytesDownloaded += response.body.size();
+        auto blob = blobs.find(hash);
+        if (blob != blobs.end()) {
+            blob->second.lastAccess = accessCounter++;
+            result.status = "duplicate";
+            duplicates++;
+        }
+        else {
+            if (!write_blob(hash, response.body)) {
+                result.error = "не удалось записать " + blob_path(hash);
+                failed++;
+                return;
+            }
+            blobs[hash] = { response.body.size(), accessCounter++ };
+            totalBytes += response.body.size();
+            result.status = "downloaded";
+            downloaded++;
+        }
+        sources[result.url] = { hash, response.etag };
+        result.hash = hash;
+        result.size = response.body.size();
+    }
+
+    bool write_blob(const string& hash, const string& data) {
+        string temporary = blob_path(hash) + ".tmp";
+        {
+            ofstream file(temporary, ios::binary | ios::trunc);
+            file.write(data.data(), data.size());
+            if (!file.good()) {
+                return false;
+            }
+        }
+
+        error_code error;
+        filesystem::rename(temporary, blob_path(hash), error);
+        return !error;
+    }
+
+    // Вызывается под indexMutex
+    void evict() {
+        if (totalBytes <= maxBytes) {
+            return;
+        }
+
+        vector<pair<uint64_t, string>> order;
+        for (const auto& blob : blobs) {
+            order.emplace_back(blob.second.lastAccess, blob.first);
+        }
+        sort(order.begin(), order.end());
+
+        for (size_t i = 0; i < order.size() && totalBytes > maxBytes; i++) {
+            // Передаваемый клиенту файл остается до следующего вытеснения
+            if (pinned.count(order[i].second)) {
+                continue;
+            }
+            error_code error;
+            filesystem::remove(blob_path(order[i].second), error);
+            totalBytes -= blobs[order[i].second].size;
+            blobs.erase(order[i].second);
+            evictions++;
+        }
+        for (auto it = sources.begin(); it != sources.end();) {
+            it = blobs.count(it->second.hash) ? next(it) : sources.erase(it);
+        }
+    }
+
+    // Вызывается под indexMutex
+    void save() {
+        json index;
+        index["sources"] = json::object();
+        for (const auto& source : sources) {
+            index["sources"][source.first] = { { "sha256", source.second.hash }, { "etag", source.second.etag } };
+        }
+        index["blobs"] = json::object();
+        for (const auto& blob : blobs) {
+            index["blobs"][blob.first] = blob.second.lastAccess;
+        }
+
+        string path = directory + "/index.json";
+        {
+            ofstream file(path + ".tmp", ios::trunc);
+            file << index.dump();
+            if (!file.good()) {
+                return;
+            }
+        }
+        error_code error;
+        filesystem::rename(path + ".tmp", path, error);
+    }
+};
+
+/**
+ * @brief Возвращает общее хранилище аватаров ("avatar_dir", "avatar_max_bytes").
+ */
+AvatarStore& avatar_store() {
+    static AvatarStore store(config.value("avatar_dir", string("avatars")), config.value("avatar_max_bytes", (uint64_t)64 * 1024 * 1024));
+    return store;
+}
+
+//string http_post_request(const string& url, const json& body) {
+//    CURL* curl;
 //    CURLcode res;
 //    string readBuffer;
 //
@@ -358,601 +4128,5700 @@ string http_post_request(const string& url, const string& query) {
 //}
 
 /**
- * @brief Выполняет запрос на случайное аниме через API и выводит информацию на консоль.
+ * @brief Скалярное значение JSON, переданное SAX-парсером.
+ */
+struct JsonScalar {
+    enum Kind { Null, Boolean, Integer, Float, String } kind = Null;
+    bool boolean = false;
+    int64_t integer = 0;
+    double number = 0;
+    string* text = nullptr;
+
+    bool is_number() const {
+        return kind == Integer || kind == Float;
+    }
+
+    int to_int() const {
+        return kind == Integer ? (int)integer : (int)number;
+    }
+};
+
+/**
+ * @brief Описание одного поля структуры для привязки к ключу JSON.
+ *
+ * Хранит указатель на член структуры (используется только тот, что соответствует kind),
+ * ключ JSON, значение по умолчанию и необязательное преобразование строки (например, format_iso_date).
+ */
+template <class T>
+struct FieldDescriptor {
+    enum Kind { Int, String, Bool, StringList };
+
+    Kind kind;
+    const char* key;
+    int T::* intMember;
+    string T::* stringMember;
+    bool T::* boolMember;
+    vector<string> T::* listMember;
+    int intDefault;
+    const char* stringDefault;
+    string(*transform)(const string&);
+    bool logMissing;
+};
+
+template <class T>
+constexpr FieldDescriptor<T> int_field(const char* key, int T::* member, bool logMissing = true) {
+    return { FieldDescriptor<T>::Int, key, member, nullptr, nullptr, nullptr, 0, nullptr, nullptr, logMissing };
+}
+
+template <class T>
+constexpr FieldDescriptor<T> string_field(const char* key, string T::* member, const char* defaultValue,
+    string(*transform)(const string&) = nullptr, bool logMissing = true) {
+    return { FieldDescriptor<T>::String, key, nullptr, member, nullptr, nullptr, 0, defaultValue, transform, logMissing };
+}
+
+template <class T>
+constexpr FieldDescriptor<T> bool_field(const char* key, bool T::* member) {
+    return { FieldDescriptor<T>::Bool, key, nullptr, nullptr, member, nullptr, 0, nullptr, nullptr, false };
+}
+
+template <class T>
+constexpr FieldDescriptor<T> list_field(const char* key, vector<string> T::* member, const char* defaultValue) {
+    return { FieldDescriptor<T>::StringList, key, nullptr, nullptr, nullptr, member, 0, defaultValue, nullptr, true };
+}
+
+/**
+ * @brief Таблица полей структуры (специализируется для каждой структуры ответа API).
+ */
+template <class T>
+struct Schema;
+
+template <>
+struct Schema<Anime> {
+    static constexpr FieldDescriptor<Anime> fields[] = {
+        int_field("id", &Anime::id, false),
+        int_field("shikimoriId", &Anime::shikimoriId, false),
+        int_field("myAnimeListId", &Anime::myAnimeListId, false),
+        string_field("name", &Anime::name, "Нет"),
+        string_field("russian", &Anime::russian, "Нет"),
+        string_field("english", &Anime::english, "Нет"),
+        int_field("episodes", &Anime::episodes),
+        int_field("episodesAired", &Anime::episodesAired),
+        int_field("duration", &Anime::duration),
+        string_field("description", &Anime::description, "Нет"),
+        list_field("synonyms", &Anime::synonyms, "Нет"),
+        string_field("updatedAt", &Anime::updatedAt, "", nullptr, false),
+    };
+};
+
+template <>
+struct Schema<User> {
+    static constexpr FieldDescriptor<User> fields[] = {
+        int_field("id", &User::id, false),
+        string_field("globalName", &User::globalName, "Нет", nullptr, false),
+        string_field("avatar", &User::avatar, "Нет", nullptr, false),
+        bool_field("verified", &User::verified),
+        string_field("createdAt", &User::createdAt, "Нет данных", format_iso_date, false),
+        string_field("updatedAt", &User::updatedAt, "Нет данных", format_iso_date, false),
+    };
+};
+
+/**
+ * @brief Находит индекс поля по ключу JSON.
+ *
+ * @return Индекс в Schema<T>::fields или -1, если ключ не относится к структуре.
+ */
+template <class T>
+int field_index(const string& key) {
+    const auto& fields = Schema<T>::fields;
+    for (size_t i = 0; i < size(fields); i++) {
+        if (key == fields[i].key) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Записывает скалярное значение в поле с индексом index, если тип значения подходит.
+ *
+ * @param seen Битовая маска полей, которые получили корректное значение.
+ */
+template <class T>
+void bind_field(T& record, uint32_t& seen, int index, JsonScalar& value) {
+    if (index < 0) {
+        return;
+    }
+
+    const FieldDescriptor<T>& field = Schema<T>::fields[index];
+    switch (field.kind) {
+    case FieldDescriptor<T>::Int:
+        if (!value.is_number()) {
+            return;
+        }
+        record.*field.intMember = value.to_int();
+        break;
+    case FieldDescriptor<T>::String:
+        if (value.kind != JsonScalar::String) {
+            return;
+        }
+        if (field.transform) {
+            record.*field.stringMember = field.transform(*value.text);
+        }
+        else {
+            record.*field.stringMember = move(*value.text);
+        }
+        break;
+    case FieldDescriptor<T>::Bool:
+        if (value.kind == JsonScalar::Null || value.kind == JsonScalar::String) {
+            return;
+        }
+        record.*field.boolMember = value.kind == JsonScalar::Boolean ? value.boolean : value.to_int() != 0;
+        break;
+    case FieldDescriptor<T>::StringList:
+        return;
+    }
+    seen |= 1u << index;
+}
+
+/**
+ * @brief Возвращает поле-список строк с индексом index или nullptr.
+ */
+template <class T>
+vector<string>* list_member(T& record, uint32_t& seen, int index) {
+    if (index < 0 || Schema<T>::fields[index].kind != FieldDescriptor<T>::StringList) {
+        return nullptr;
+    }
+    seen |= 1u << index;
+    return &(record.*Schema<T>::fields[index].listMember);
+}
+
+/**
+ * @brief Заполняет значениями по умолчанию поля, которые отсутствуют или имеют неверный тип.
+ */
+template <class T>
+void finish_record(T& record, uint32_t seen) {
+    const auto& fields = Schema<T>::fields;
+    for (size_t i = 0; i < size(fields); i++) {
+        const FieldDescriptor<T>& field = fields[i];
+
+        bool missing = !(seen & (1u << i));
+        if (field.kind == FieldDescriptor<T>::StringList) {
+            missing = (record.*field.listMember).empty();
+        }
+        if (!missing) {
+            continue;
+        }
+
+        switch (field.kind) {
+        case FieldDescriptor<T>::Int:
+            record.*field.intMember = field.intDefault;
+            break;
+        case FieldDescriptor<T>::String:
+            record.*field.stringMember = field.stringDefault;
+            break;
+        case FieldDescriptor<T>::Bool:
+            record.*field.boolMember = false;
+            break;
+        case FieldDescriptor<T>::StringList:
+            record.*field.listMember = { field.stringDefault };
+            break;
+        }
+
+        if (field.logMissing && logger().enabled(LogLevel::Debug)) {
+            string key = field.key;
+            LOG_DEBUG(field.kind == FieldDescriptor<T>::Int ? "Значение '" + key + "' не является числом"
+                : field.kind == FieldDescriptor<T>::StringList ? "Значение '" + key + "' пусто или не массивом"
+                : "Значение '" + key + "' пусто или не является строкой");
+        }
+    }
+}
+
+/**
+ * @brief Заполняет структуру из уже разобранного JSON-объекта за один проход по его ключам.
+ */
+template <class T>
+T decode_object(const json& object) {
+    T record{};
+    uint32_t seen = 0;
+
+    for (auto it = object.begin(); it != object.end(); ++it) {
+        int index = field_index<T>(it.key());
+        if (index < 0) {
+            continue;
+        }
+
+        const json& item = it.value();
+        if (vector<string>* list = list_member(record, seen, index)) {
+            if (item.is_array()) {
+                list->reserve(item.size());
+                for (const auto& element : item) {
+                    if (element.is_string()) {
+                        list->push_back(element.get<string>());
+                    }
+                }
+            }
+            continue;
+        }
+
+        const FieldDescriptor<T>& field = Schema<T>::fields[index];
+        if (item.is_string()) {
+            // Строку копируем из DOM один раз, сразу в поле
+            if (field.kind == FieldDescriptor<T>::String) {
+                const string& text = item.get_ref<const string&>();
+                if (field.transform) {
+                    record.*field.stringMember = field.transform(text);
+                }
+                else {
+                    record.*field.stringMember = text;
+                }
+                seen |= 1u << index;
+            }
+            continue;
+        }
+
+        JsonScalar value;
+        if (item.is_number_integer()) {
+            value.kind = JsonScalar::Integer;
+            value.integer = item.get<int64_t>();
+        }
+        else if (item.is_number()) {
+            value.kind = JsonScalar::Float;
+            value.number = item.get<double>();
+        }
+        else if (item.is_boolean()) {
+            value.kind = JsonScalar::Boolean;
+            value.boolean = item.get<bool>();
+        }
+        bind_field(record, seen, index, value);
+    }
+
+    finish_record(record, seen);
+    return record;
+}
+
+void from_json(const json& object, Anime& anime) {
+    anime = decode_object<Anime>(object);
+}
+
+void from_json(const json& object, User& user) {
+    user = decode_object<User>(object);
+}
+
+/**
+ * @brief Собирает JSON-объект из структуры по таблице ее полей.
+ */
+template <class T>
+json encode_object(const T& record) {
+    json object = json::object();
+    for (const auto& field : Schema<T>::fields) {
+        switch (field.kind) {
+        case FieldDescriptor<T>::Int:
+            object[field.key] = record.*field.intMember;
+            break;
+        case FieldDescriptor<T>::String:
+            object[field.key] = record.*field.stringMember;
+            break;
+        case FieldDescriptor<T>::Bool:
+            object[field.key] = record.*field.boolMember;
+            break;
+        case FieldDescriptor<T>::StringList:
+            object[field.key] = record.*field.listMember;
+            break;
+        }
+    }
+    return object;
+}
+
+void to_json(json& object, const Anime& anime) {
+    object = encode_object(anime);
+}
+
+void to_json(json& object, const User& user) {
+    object = encode_object(user);
+    object["username"] = user.username;
+}
+
+class AnimeTable;
+
+/**
+ * @brief Добавляет разобранную запись в вектор: строки записи переходят к нему.
+ */
+template <class Record>
+void append_record(vector<Record>& records, Record& record) {
+    records.push_back(move(record));
+}
+
+/**
+ * @brief Копирует разобранную запись в таблицу (определена вместе с AnimeTable).
+ */
+void append_record(AnimeTable& table, Anime& record);
+
+/**
+ * @brief Готовит запись к разбору следующего объекта.
+ */
+template <class Record>
+void reset_record(Record& record) {
+    record = Record();
+}
+
+/**
+ * @brief Для Anime строки очищаются, а не освобождаются: при разборе в AnimeTable запись
+ * не отдает свою память, и следующий объект заполняется без новых выделений.
+ */
+void reset_record(Anime& anime) {
+    anime.id = anime.shikimoriId = anime.myAnimeListId = 0;
+    anime.episodes = anime.episodesAired = anime.duration = 0;
+    anime.name.clear();
+    anime.russian.clear();
+    anime.english.clear();
+    anime.description.clear();
+    anime.synonyms.clear();
+    anime.updatedAt.clear();
+}
+
+/**
+ * @brief SAX-обработчик, заполняющий структуры Anime/User напрямую, без построения DOM.
+ *
+ * Понимает как одиночный объект, так и массив объектов (ответ поиска). Ключ "error" верхнего уровня
+ * сохраняется как сообщение об ошибке API. Ключи сопоставляются с полями по таблице Schema<Record>
+ * один раз, вложенные объекты и массивы, кроме списков строк (например, synonyms), пропускаются.
+ *
+ * Записи складываются в Sink через append_record: в вектор или в AnimeTable.
+ */
+template <class Record, class Sink = vector<Record>>
+class RecordDecoder {
+public:
+    explicit RecordDecoder(Sink& records)
+        : records(records) {
+    }
+
+    std::string error;
+    std::string rootType = "null";
+
+    bool null() {
+        JsonScalar value;
+        return scalar(value);
+    }
+
+    bool boolean(bool flag) {
+        JsonScalar value;
+        value.kind = JsonScalar::Boolean;
+        value.boolean = flag;
+        return scalar(value);
+    }
+
+    bool number_integer(int64_t number) {
+        JsonScalar value;
+        value.kind = JsonScalar::Integer;
+        value.integer = number;
+        return scalar(value);
+    }
+
+    bool number_unsigned(uint64_t number) {
+        return number_integer((int64_t)number);
+    }
+
+    bool number_float(double number, const string&) {
+        JsonScalar value;
+        value.kind = JsonScalar::Float;
+        value.number = number;
+        return scalar(value);
+    }
+
+    bool string(std::string& text) {
+        if (list && depth == recordDepth + 1) {
+            // Копия, а не перенос: перенос забрал бы буфер лексера, и тот заново наращивал бы его
+            // для следующей строки (синонимы обычно короткие и копируются без выделения памяти)
+            list->push_back(text);
+            return true;
+        }
+
+        JsonScalar value;
+        value.kind = JsonScalar::String;
+        value.text = &text;
+        return scalar(value);
+    }
+
+    bool binary(json::binary_t&) {
+        return true;
+    }
+
+    bool start_object(size_t) {
+        depth++;
+        if (depth == 1) {
+            rootType = "object";
+        }
+
+        if (depth == (rootIsArray ? 2u : 1u)) {
+            recordDepth = depth;
+            reset_record(current);
+            seen = 0;
+        }
+        return true;
+    }
+
+    bool key(std::string& name) {
+        if (depth == recordDepth) {
+            currentField = field_index<Record>(name);
+        }
+        if (depth == 1) {
+            errorKey = name == "error";
+        }
+        return true;
+    }
+
+    bool end_object() {
+        if (depth == recordDepth) {
+            finish_record(current, seen);
+            append_record(records, current);
+            recordDepth = 0;
+        }
+        depth--;
+        return true;
+    }
+
+    bool start_array(size_t) {
+        depth++;
+        if (depth == 1) {
+            rootType = "array";
+            rootIsArray = true;
+        }
+        else if (recordDepth && depth == recordDepth + 1) {
+            list = list_member(current, seen, currentField);
+            if (list) {
+                list->clear();
+            }
+        }
+        return true;
+    }
+
+    bool end_array() {
+        if (list && depth == recordDepth + 1) {
+            list = nullptr;
+        }
+        depth--;
+        return true;
+    }
+
+    template <class Exception>
+    bool parse_error(size_t, const std::string&, const Exception& ex) {
+        throw ex;
+    }
+
+private:
+    Sink& records;
+    Record current{};
+    uint32_t seen = 0;
+    int currentField = -1;
+    bool errorKey = false;
+    size_t depth = 0;
+    size_t recordDepth = 0;
+    bool rootIsArray = false;
+    vector<std::string>* list = nullptr;
+
+    bool scalar(JsonScalar& value) {
+        if (depth == 0) {
+            rootType = value.kind == JsonScalar::String ? "string"
+                : value.kind == JsonScalar::Null ? "null"
+                : value.kind == JsonScalar::Boolean ? "boolean" : "number";
+            return true;
+        }
+
+        if (depth == 1 && !rootIsArray && errorKey) {
+            error = value.kind == JsonScalar::String ? *value.text : "неизвестная ошибка";
+        }
+        if (depth == recordDepth) {
+            bind_field(current, seen, currentField, value);
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief Разбирает тело ответа в список записей без построения DOM.
+ *
+ * @param body Тело ответа (объект или массив объектов).
+ * @param records Вектор или AnimeTable, в который добавляются записи.
+ * @param error Сообщение об ошибке API, если ответ содержит ключ "error".
+ * @return Тип корневого значения JSON ("object", "array", ...).
+ * @throws json::parse_error если тело не является корректным JSON.
+ */
+template <class Sink>
+string decode_records(const string& body, Sink& records, string& error) {
+    RecordDecoder<typename Sink::value_type, Sink> decoder(records);
+    json::sax_parse(body, &decoder);
+    error = decoder.error;
+    return decoder.rootType;
+}
+
+/**
+ * @brief Разбирает JSON из потока (например, файла дампа) в список записей без построения DOM.
+ */
+template <class Sink>
+string decode_records(istream& input, Sink& records, string& error) {
+    RecordDecoder<typename Sink::value_type, Sink> decoder(records);
+    json::sax_parse(input, &decoder);
+    error = decoder.error;
+    return decoder.rootType;
+}
+
+/**
+ * @brief Потоковый буфер, который отдает тело ответа по мере его получения от curl.
+ *
+ * Передача выполняется через curl_multi прямо из underflow(): пока парсеру нужны новые байты,
+ * буфер продвигает передачу, поэтому в памяти одновременно находится только последний
+ * полученный фрагмент, а не все тело ответа.
+ */
+class CurlStreamBuf : public streambuf {
+public:
+    explicit CurlStreamBuf(const HttpRequest& request)
+        : url(request.url), keepBody(transport().recording()) {
+        multi = curl_multi_init();
+        handle = http_client().acquire();
+        if (!handle) {
+            response.code = CURLE_FAILED_INIT;
+            done = true;
+            return;
+        }
+
+        for (const auto& header : request.headers) {
+            headers = curl_slist_append(headers, header.c_str());
+        }
+
+        curl_easy_setopt(handle, CURLOPT_URL, request.url.c_str());
+        curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, on_data);
+        curl_easy_setopt(handle, CURLOPT_WRITEDATA, this);
+        curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, adaptive_timeout_ms(request.url));
+        curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, header_callback);
+        curl_easy_setopt(handle, CURLOPT_HEADERDATA, &response);
+        if (request.method == "POST") {
+            curl_easy_setopt(handle, CURLOPT_POST, 1L);
+            curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE, (long)request.body.length());
+            curl_easy_setopt(handle, CURLOPT_COPYPOSTFIELDS, request.body.c_str());
+        }
+        if (headers) {
+            curl_easy_setopt(handle, CURLOPT_HTTPHEADER, headers);
+        }
+
+        curl_multi_add_handle(multi, handle);
+    }
+
+    ~CurlStreamBuf() {
+        if (handle) {
+            curl_multi_remove_handle(multi, handle);
+            http_client().release(handle);
+        }
+        curl_slist_free_all(headers);
+        curl_multi_cleanup(multi);
+    }
+
+    /**
+     * @brief Результат передачи (код curl и HTTP-статус). Тело сохраняется только при записи трафика.
+     */
+    const HttpResponse& result() const {
+        return response;
+    }
+
+    /**
+     * @brief Количество полученных байт тела.
+     */
+    uint64_t received() const {
+        return bytes;
+    }
+
+    /**
+     * @brief Сколько секунд разбор простоял в ожидании данных из сети.
+     */
+    double waited_seconds() const {
+        return waiting;
+    }
+
+protected:
+    int_type underflow() override {
+        if (gptr() < egptr()) {
+            return traits_type::to_int_type(*gptr());
+        }
+
+        chunk.clear();
+        auto waitStarted = chrono::steady_clock::now();
+        while (chunk.empty() && !done) {
+            int running = 0;
+            curl_multi_perform(multi, &running);
+
+            int queued = 0;
+            while (CURLMsg* message = curl_multi_info_read(multi, &queued)) {
+                if (message->msg == CURLMSG_DONE) {
+                    response.code = message->data.result;
+                    if (response.code == CURLE_OK) {
+                        curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &response.status);
+                        response.reused = http_client().count_connection(handle);
+                    }
+                    request_metrics().record_transfer(url, handle, response, bytes);
+                    done = true;
+                }
+            }
+
+            if (chunk.empty() && !done) {
+                curl_multi_poll(multi, NULL, 0, 1000, NULL);
+            }
+        }
+
+        waiting += chrono::duration<double>(chrono::steady_clock::now() - waitStarted).count();
+        if (chunk.empty()) {
+            return traits_type::eof();
+        }
+
+        setg(&chunk[0], &chunk[0], &chunk[0] + chunk.size());
+        return traits_type::to_int_type(*gptr());
+    }
+
+private:
+    std::string url;
+    CURLM* multi = nullptr;
+    CURL* handle = nullptr;
+    struct curl_slist* headers = NULL;
+    HttpResponse response;
+    std::string chunk;
+    uint64_t bytes = 0;
+    double waiting = 0;
+    bool keepBody;
+    bool done = false;
+
+    static size_t on_data(void* contents, size_t size, size_t nmemb, void* userp) {
+        CurlStreamBuf* self = static_cast<CurlStreamBuf*>(userp);
+        self->chunk.append((char*)contents, size * nmemb);
+        self->bytes += size * nmemb;
+        if (self->keepBody) {
+            self->response.body.append((char*)contents, size * nmemb);
+        }
+        return size * nmemb;
+    }
+};
+
+/**
+ * @brief Выполняет запрос и разбирает ответ потоково, по мере поступления байт.
+ *
+ * @param response Код curl и HTTP-статус выполненного запроса.
+ * @return Тип корневого значения JSON ("object", "array", ...).
+ * @throws json::parse_error если тело не является корректным JSON.
+ */
+template <class Record>
+string stream_records(const HttpRequest& request, vector<Record>& records, string& error, HttpResponse& response) {
+    // Без сети разбирать по мере поступления нечего: ответ целиком приходит из транспорта.
+    // Дублируемый запрос тоже читается целиком: победителя заранее не знать, а разбирать два потока сразу незачем
+    if (!transport().live() || (hedgeable(request) && hedge_delay_ms(request.url) > 0)) {
+        response = transport().perform(request);
+        if (response.body.empty()) {
+            return "null";
+        }
+
+        ParseTimer timer(endpoint_of(request.url));
+        return decode_records(response.body, records, error);
+    }
+
+    auto transferStarted = chrono::steady_clock::now();
+    CurlStreamBuf buffer(request);
+    istream input(&buffer);
+
+    RecordDecoder<Record> decoder(records);
+    bool parsed = false;
+    auto started = chrono::steady_clock::now();
+    try {
+        parsed = json::sax_parse(input, &decoder);
+    }
+    catch (const json::parse_error&) {
+        // Пустой ответ (например, при обрыве соединения) не считается ошибкой формата
+        if (buffer.received() > 0) {
+            throw;
+        }
+    }
+
+    // Разбор идет вперемешку с приемом, поэтому из общего времени вычитается ожидание сети
+    if (buffer.received() > 0) {
+        double total = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        request_metrics().record_parse(endpoint_of(request.url), max(total - buffer.waited_seconds(), 0.0));
+    }
+
+    response = buffer.result();
+    transport().record(request, response, chrono::duration<double>(chrono::steady_clock::now() - transferStarted).count());
+    error = decoder.error;
+    return parsed ? decoder.rootType : "null";
+}
+
+/**
+ * @brief Запрашивает случайное аниме у API и разбирает ответ.
+ *
+ * Ответ не кэшируется, поэтому разбирается потоково, прямо по мере получения. Пустой ответ
+ * повторяется до "retry_attempts" раз с той же паузой, что и у HTTP-клиента.
+ *
+ * @param anime Структура, в которую будет записан результат.
+ * @param error Сообщение об ошибке от API, если она была.
+ * @param pause Ожидание перед повтором; возвращает false, если повторять больше не нужно
+ *              (например, программа завершается). По умолчанию просто спит.
+ * @return true, если аниме успешно получено.
+ * @throws json::exception если ответ не удалось разобрать.
+ */
+bool fetch_random_anime(Anime& anime, string& error, const function<bool(chrono::milliseconds)>& pause = nullptr) {
+    vector<Anime> records;
+    HttpResponse response;
+
+    long attempts = max(config.value("retry_attempts", 2L), 0L) + 1;
+    for (long attempt = 1;; attempt++) {
+        stream_records(random_anime_request(), records, error, response);
+        if (!records.empty() || !error.empty() || attempt >= attempts) {
+            break;
+        }
+
+        chrono::milliseconds delay(HttpClient::retry_backoff_ms(attempt));
+        if (pause) {
+            if (!pause(delay)) {
+                break;
+            }
+        }
+        else {
+            this_thread::sleep_for(delay);
+        }
+    }
+
+    if (!error.empty()) {
+        return false;
+    }
+    if (records.empty()) {
+        error = response.code != CURLE_OK ? curl_easy_strerror(response.code) : "пустой ответ сервера";
+        return false;
+    }
+
+    anime = move(records.front());
+    return true;
+}
+
+/**
+ * @brief Возвращает объем физической памяти, занятой процессом (RSS), в байтах.
+ */
+uint64_t current_rss_bytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = {};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.WorkingSetSize;
+    }
+    return 0;
+#else
+    uint64_t pages = 0, resident = 0;
+    ifstream statm("/proc/self/statm");
+    statm >> pages >> resident;
+    return resident * (uint64_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+/**
+ * @brief Заголовок файла локального каталога аниме.
+ *
+ * Файл состоит из заголовка, столбцов фиксированной ширины (int32 на запись) для числовых полей,
+ * столбцов ссылок (смещение, длина) на строки в общей куче и самой кучи строк.
+ * Одинаковые строки хранятся в куче один раз. Все смещения отсчитываются от начала файла.
+ */
+struct CatalogHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t synonymCount;
+    uint64_t numberColumns[6];
+    uint64_t textColumns[4];
+    uint64_t synonymSpans;
+    uint64_t synonymRefs;
+    uint64_t heap;
+    uint64_t heapSize;
+};
+
+/**
+ * @brief Ссылка на строку в куче каталога.
+ */
+struct CatalogString {
+    uint32_t offset;
+    uint32_t length;
+};
+
+const char catalogMagic[4] = { 'A', 'M', 'C', 'T' };
+const uint32_t catalogVersion = 1;
+
+// Числовые столбцы каталога в порядке CatalogHeader::numberColumns
+int Anime::* const catalogNumbers[6] = {
+    &Anime::id, &Anime::shikimoriId, &Anime::myAnimeListId, &Anime::episodes, &Anime::episodesAired, &Anime::duration
+};
+
+// Строковые столбцы каталога в порядке CatalogHeader::textColumns
+string Anime::* const catalogTexts[4] = {
+    &Anime::name, &Anime::russian, &Anime::english, &Anime::description
+};
+
+/**
+ * @brief Отметка синхронизации каталога: время изменения (мс UTC) и id последней полученной записи.
+ *
+ * Изменения выбираются по возрастанию пары (updatedAt, id) строго после отметки, поэтому записи
+ * с одинаковым временем изменения не теряются на границе страниц и не приходят повторно.
+ */
+struct SyncMark {
+    int64_t updatedAt = 0;
+    int id = 0;
+
+    bool operator<(const SyncMark& other) const {
+        return updatedAt != other.updatedAt ? updatedAt < other.updatedAt : id < other.id;
+    }
+
+    /**
+     * @brief Сдвигает отметку на запись, если та изменена позже (записи без updatedAt не учитываются).
+     */
+    void advance(const Anime& anime) {
+        SyncMark candidate;
+        if (parse_iso8601(anime.updatedAt, candidate.updatedAt)) {
+            candidate.id = anime.id;
+            if (*this < candidate) {
+                *this = candidate;
+            }
+        }
+    }
+};
+
+/**
+ * @brief Набор записей аниме для больших выборок (синхронизация и импорт каталога).
+ *
+ * Вместо вектора Anime с семью строками на запись данные лежат столбцами: числовые поля —
+ * отдельными массивами int32 (их удобно просматривать и фильтровать подряд), строки — string_view
+ * на монотонную арену таблицы. Названия и синонимы интернируются: одинаковая строка хранится один раз.
+ * Строки и таблица интернирования освобождаются разом вместе с таблицей. Сами столбцы растут
+ * удвоением и живут в обычной куче: в монотонной арене каждое удвоение оставляло бы старый буфер.
+ */
+class AnimeTable {
+public:
+    using value_type = Anime;
+
+    // Порядок столбцов совпадает с catalogNumbers и catalogTexts
+    enum Number { Id, ShikimoriId, MyAnimeListId, Episodes, EpisodesAired, Duration, NumberCount };
+    enum Text { Name, Russian, English, Description, TextCount };
+
+    explicit AnimeTable(size_t initialBytes = 64 * 1024)
+        : arena(initialBytes), numbers(NumberCount), texts(TextCount), synonymStarts(1, 0), interned(&arena) {
+    }
+
+    AnimeTable(const AnimeTable&) = delete;
+    AnimeTable& operator=(const AnimeTable&) = delete;
+
+    size_t size() const {
+        return synonymStarts.size() - 1;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    void reserve(size_t count) {
+        for (auto& column : numbers) {
+            column.reserve(count);
+        }
+        for (auto& column : texts) {
+            column.reserve(count);
+        }
+        synonymStarts.reserve(count + 1);
+    }
+
+    /**
+     * @brief Копирует запись в таблицу.
+     */
+    void push_back(const Anime& anime) {
+        for (int column = 0; column < NumberCount; column++) {
+            numbers[column].push_back(anime.*catalogNumbers[column]);
+        }
+        for (int column = 0; column < TextCount; column++) {
+            const string& text = anime.*catalogTexts[column];
+            // Описания почти всегда уникальны, хешировать их незачем
+            texts[column].push_back(column == Description ? store(text) : intern(text));
+        }
+        for (const auto& synonym : anime.synonyms) {
+            synonyms.push_back(intern(synonym));
+        }
+        synonymStarts.push_back((uint32_t)synonyms.size());
+        newest.advance(anime);
+    }
+
+    /**
+     * @brief Отметка самой поздней по updatedAt записи таблицы (с нее начнется --sync-delta).
+     */
+    const SyncMark& newest_mark() const {
+        return newest;
+    }
+
+    int32_t number(Number column, size_t row) const {
+        return numbers[column][row];
+    }
+
+    /**
+     * @brief Числовой столбец целиком (для просмотра подряд и записи в файл каталога).
+     */
+    const vector<int32_t>& column(Number column) const {
+        return numbers[column];
+    }
+
+    string_view text(Text column, size_t row) const {
+        return texts[column][row];
+    }
+
+    size_t synonym_count(size_t row) const {
+        return synonymStarts[row + 1] - synonymStarts[row];
+    }
+
+    string_view synonym(size_t row, size_t index) const {
+        return synonyms[synonymStarts[row] + index];
+    }
+
+    /**
+     * @brief Собирает запись обратно в Anime (например, для вывода на экран).
+     */
+    Anime record(size_t row) const {
+        Anime anime;
+        for (int column = 0; column < NumberCount; column++) {
+            anime.*catalogNumbers[column] = numbers[column][row];
+        }
+        for (int column = 0; column < TextCount; column++) {
+            anime.*catalogTexts[column] = string(texts[column][row]);
+        }
+        for (size_t i = 0; i < synonym_count(row); i++) {
+            anime.synonyms.emplace_back(synonym(row, i));
+        }
+        return anime;
+    }
+
+    /**
+     * @brief Номера записей, у которых значение столбца удовлетворяет predicate.
+     */
+    template <class Predicate>
+    vector<uint32_t> filter(Number column, Predicate predicate) const {
+        const vector<int32_t>& values = numbers[column];
+        vector<uint32_t> rows;
+        for (size_t row = 0; row < values.size(); row++) {
+            if (predicate(values[row])) {
+                rows.push_back((uint32_t)row);
+            }
+        }
+        return rows;
+    }
+
+    /**
+     * @brief Номера записей, упорядоченные по столбцу (при равенстве — в исходном порядке).
+     */
+    vector<uint32_t> order_by(Number column, bool descending = false) const {
+        const vector<int32_t>& values = numbers[column];
+        vector<uint32_t> rows(values.size());
+        for (size_t row = 0; row < rows.size(); row++) {
+            rows[row] = (uint32_t)row;
+        }
+        stable_sort(rows.begin(), rows.end(), [&values, descending](uint32_t left, uint32_t right) {
+            return descending ? values[left] > values[right] : values[left] < values[right];
+        });
+        return rows;
+    }
+
+    /**
+     * @brief Сколько разных строк хранится в таблице интернирования.
+     */
+    size_t interned_count() const {
+        return interned.size();
+    }
+
+private:
+    pmr::monotonic_buffer_resource arena;
+    vector<vector<int32_t>> numbers;
+    vector<vector<string_view>> texts;
+    // Синонимы записи row — synonyms[synonymStarts[row] .. synonymStarts[row + 1])
+    vector<uint32_t> synonymStarts;
+    vector<string_view> synonyms;
+    pmr::unordered_set<string_view> interned;
+    SyncMark newest;
+
+    string_view store(const string& text) {
+        if (text.empty()) {
+            return string_view();
+        }
+        char* memory = static_cast<char*>(arena.allocate(text.size(), 1));
+        memcpy(memory, text.data(), text.size());
+        return string_view(memory, text.size());
+    }
+
+    string_view intern(const string& text) {
+        auto found = interned.find(string_view(text));
+        if (found != interned.end()) {
+            return *found;
+        }
+        string_view stored = store(text);
+        interned.insert(stored);
+        return stored;
+    }
+};
+
+void append_record(AnimeTable& table, Anime& record) {
+    table.push_back(record);
+}
+
+/**
+ * @brief Записывает записи аниме в файл каталога.
+ *
+ * Числовые столбцы таблицы пишутся в файл как есть. Файл сначала пишется во временный и затем
+ * переименовывается, поэтому прерванная запись не портит существующий каталог.
+ *
+ * @return true, если каталог успешно записан.
+ */
+bool write_catalog(const string& path, const AnimeTable& table) {
+    uint32_t count = (uint32_t)table.size();
+
+    // Ключи — string_view на арену таблицы, она живет дольше этой функции
+    string heap;
+    unordered_map<string_view, uint32_t> interned;
+    auto intern = [&](string_view text) {
+        auto it = interned.find(text);
+        if (it != interned.end()) {
+            return CatalogString{ it->second, (uint32_t)text.size() };
+        }
+        uint32_t offset = (uint32_t)heap.size();
+        heap.append(text.data(), text.size());
+        interned.emplace(text, offset);
+        return CatalogString{ offset, (uint32_t)text.size() };
+    };
+
+    vector<CatalogString> texts[4];
+    vector<CatalogString> spans;
+    vector<CatalogString> synonyms;
+    for (auto& column : texts) {
+        column.reserve(count);
+    }
+    spans.reserve(count);
+    for (uint32_t row = 0; row < count; row++) {
+        for (int column = 0; column < 4; column++) {
+            texts[column].push_back(intern(table.text((AnimeTable::Text)column, row)));
+        }
+
+        // Для списка синонимов offset — индекс первого синонима, length — их количество
+        spans.push_back({ (uint32_t)synonyms.size(), (uint32_t)table.synonym_count(row) });
+        for (size_t i = 0; i < table.synonym_count(row); i++) {
+            synonyms.push_back(intern(table.synonym(row, i)));
+        }
+    }
+
+    CatalogHeader header = {};
+    memcpy(header.magic, catalogMagic, sizeof(catalogMagic));
+    header.version = catalogVersion;
+    header.count = count;
+    header.synonymCount = (uint32_t)synonyms.size();
+
+    uint64_t offset = sizeof(CatalogHeader);
+    for (int column = 0; column < 6; column++) {
+        header.numberColumns[column] = offset;
+        offset += count * sizeof(int32_t);
+    }
+    for (int column = 0; column < 4; column++) {
+        header.textColumns[column] = offset;
+        offset += count * sizeof(CatalogString);
+    }
+    header.synonymSpans = offset;
+    offset += count * sizeof(CatalogString);
+    header.synonymRefs = offset;
+    offset += synonyms.size() * sizeof(CatalogString);
+    header.heap = offset;
+    header.heapSize = heap.size();
+
+    string temporary = path + ".tmp";
+    {
+        ofstream file(temporary, ios::binary | ios::trunc);
+        file.write((const char*)&header, sizeof(header));
+        for (int column = 0; column < 6; column++) {
+            file.write((const char*)table.column((AnimeTable::Number)column).data(), count * sizeof(int32_t));
+        }
+        for (const auto& column : texts) {
+            file.write((const char*)column.data(), column.size() * sizeof(CatalogString));
+        }
+        file.write((const char*)spans.data(), spans.size() * sizeof(CatalogString));
+        file.write((const char*)synonyms.data(), synonyms.size() * sizeof(CatalogString));
+        file.write(heap.data(), heap.size());
+        if (!file.good()) {
+            return false;
+        }
+    }
+
+    error_code error;
+    filesystem::rename(temporary, path, error);
+    return !error;
+}
+
+/**
+ * @brief Локальный каталог аниме, отображенный в память.
+ *
+ * Файл открывается через mmap (MapViewOfFile в Windows) без разбора: столбцы читаются
+ * прямо из отображения, а строки отдаются как string_view на кучу файла.
+ * Поверх файла можно наложить записи из журнала синхронизации (overlay): они заменяют
+ * записи с тем же id, а новые записи идут после записей файла.
+ */
+class CatalogView {
+public:
+    ~CatalogView() {
+        close();
+    }
+
+    /**
+     * @brief Открывает и проверяет файл каталога.
+     *
+     * @return true, если каталог успешно открыт.
+     */
+    bool open(const string& path) {
+        close();
+
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(file, &fileSize);
+        length = (size_t)fileSize.QuadPart;
+
+        HANDLE mapping = length ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+        CloseHandle(file);
+        if (!mapping) {
+            return false;
+        }
+
+        data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+#else
+        int file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0) {
+            return false;
+        }
+
+        struct stat info;
+        fstat(file, &info);
+        length = (size_t)info.st_size;
+
+        void* view = length ? mmap(NULL, length, PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+        ::close(file);
+        data = view == MAP_FAILED ? nullptr : (const char*)view;
+#endif
+
+        if (!data || !validate()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (data) {
+#ifdef _WIN32
+            UnmapViewOfFile(data);
+#else
+            munmap((void*)data, length);
+#endif
+        }
+        data = nullptr;
+        length = 0;
+        header = nullptr;
+        patches.clear();
+        replaced.clear();
+        appendedFrom = 0;
+    }
+
+    /**
+     * @brief Накладывает записи на открытый каталог (предыдущие наложенные записи заменяются).
+     */
+    void overlay(const unordered_map<int, Anime>& records) {
+        patches.clear();
+        replaced.clear();
+        if (!header) {
+            return;
+        }
+
+        unordered_set<int> found;
+        for (size_t index = 0; index < header->count; index++) {
+            auto it = records.find(stored_number(index, 0));
+            if (it != records.end() && found.insert(it->first).second) {
+                replaced[index] = (uint32_t)patches.size();
+                patches.push_back(it->second);
+            }
+        }
+
+        // Новые записи — по возрастанию id, чтобы порядок не зависел от хеш-таблицы
+        appendedFrom = patches.size();
+        for (const auto& entry : records) {
+            if (!found.count(entry.first)) {
+                patches.push_back(entry.second);
+            }
+        }
+        sort(patches.begin() + appendedFrom, patches.end(), [](const Anime& left, const Anime& right) {
+            return left.id < right.id;
+        });
+    }
+
+    bool is_open() const {
+        return header != nullptr;
+    }
+
+    size_t size() const {
+        return header ? header->count + (patches.size() - appendedFrom) : 0;
+    }
+
+    int number(size_t index, int column) const {
+        if (const Anime* anime = patch(index)) {
+            return anime->*catalogNumbers[column];
+        }
+        return stored_number(index, column);
+    }
+
+    string_view text(size_t index, int column) const {
+        if (const Anime* anime = patch(index)) {
+            return anime->*catalogTexts[column];
+        }
+        return heap_string(ref(header->textColumns[column], index));
+    }
+
+    size_t synonym_count(size_t index) const {
+        if (const Anime* anime = patch(index)) {
+            return anime->synonyms.size();
+        }
+        return ref(header->synonymSpans, index).length;
+    }
+
+    string_view synonym(size_t index, size_t position) const {
+        if (const Anime* anime = patch(index)) {
+            return anime->synonyms[position];
+        }
+        return heap_string(ref(header->synonymRefs, ref(header->synonymSpans, index).offset + position));
+    }
+
+    /**
+     * @brief Собирает полную структуру Anime для записи с номером index.
+     */
+    Anime record(size_t index) const {
+        if (const Anime* anime = patch(index)) {
+            return *anime;
+        }
+
+        Anime anime;
+        for (int column = 0; column < 6; column++) {
+            anime.*catalogNumbers[column] = number(index, column);
+        }
+        for (int column = 0; column < 4; column++) {
+            anime.*catalogTexts[column] = string(text(index, column));
+        }
+        for (size_t i = 0; i < synonym_count(index); i++) {
+            anime.synonyms.emplace_back(synonym(index, i));
+        }
+        return anime;
+    }
+
+    /**
+     * @brief Возвращает случайную запись каталога.
+     */
+    Anime random() const {
+        static mutex generatorMutex;
+        static mt19937 generator(random_device{}());
+
+        lock_guard<mutex> lock(generatorMutex);
+        uniform_int_distribution<size_t> distribution(0, size() - 1);
+        return record(distribution(generator));
+    }
+
+private:
+    const char* data = nullptr;
+    size_t length = 0;
+    const CatalogHeader* header = nullptr;
+    // Наложенные записи: сначала замены записей файла (replaced: номер записи -> индекс в patches), затем новые
+    vector<Anime> patches;
+    unordered_map<size_t, uint32_t> replaced;
+    size_t appendedFrom = 0;
+
+    const Anime* patch(size_t index) const {
+        if (patches.empty()) {
+            return nullptr;
+        }
+        if (index >= header->count) {
+            return &patches[appendedFrom + index - header->count];
+        }
+        auto it = replaced.find(index);
+        return it != replaced.end() ? &patches[it->second] : nullptr;
+    }
+
+    int stored_number(size_t index, int column) const {
+        int32_t value;
+        memcpy(&value, data + header->numberColumns[column] + index * sizeof(int32_t), sizeof(value));
+        return value;
+    }
+
+    CatalogString ref(uint64_t column, size_t index) const {
+        CatalogString value;
+        memcpy(&value, data + column + index * sizeof(CatalogString), sizeof(value));
+        return value;
+    }
+
+    string_view heap_string(CatalogString value) const {
+        return string_view(data + header->heap + value.offset, value.length);
+    }
+
+    bool validate() {
+        if (length < sizeof(CatalogHeader)) {
+            return false;
+        }
+
+        const CatalogHeader* candidate = (const CatalogHeader*)data;
+        if (memcmp(candidate->magic, catalogMagic, sizeof(catalogMagic)) != 0 || candidate->version != catalogVersion) {
+            return false;
+        }
+
+        uint64_t count = candidate->count;
+        auto fits = [&](uint64_t offset, uint64_t bytes) {
+            return offset <= length && bytes <= length - offset;
+        };
+        for (uint64_t column : candidate->numberColumns) {
+            if (!fits(column, count * sizeof(int32_t))) return false;
+        }
+        for (uint64_t column : candidate->textColumns) {
+            if (!fits(column, count * sizeof(CatalogString))) return false;
+        }
+        if (!fits(candidate->synonymSpans, count * sizeof(CatalogString))
+            || !fits(candidate->synonymRefs, (uint64_t)candidate->synonymCount * sizeof(CatalogString))
+            || !fits(candidate->heap, candidate->heapSize)) {
+            return false;
+        }
+
+        // Ссылки проверяются один раз при открытии, чтобы heap_string и synonym читали без проверок
+        auto inside = [](CatalogString value, uint64_t limit) {
+            return (uint64_t)value.offset + value.length <= limit;
+        };
+        for (uint64_t column : candidate->textColumns) {
+            for (size_t index = 0; index < count; index++) {
+                if (!inside(ref(column, index), candidate->heapSize)) return false;
+            }
+        }
+        for (size_t index = 0; index < count; index++) {
+            if (!inside(ref(candidate->synonymSpans, index), candidate->synonymCount)) return false;
+        }
+        for (size_t index = 0; index < candidate->synonymCount; index++) {
+            if (!inside(ref(candidate->synonymRefs, index), candidate->heapSize)) return false;
+        }
+
+        header = candidate;
+        return true;
+    }
+};
+
+/**
+ * @brief Возвращает общий локальный каталог (открывается в main, если включен режим "offline").
+ */
+CatalogView& local_catalog() {
+    static CatalogView catalog;
+    return catalog;
+}
+
+/**
+ * @brief CRC-32 (IEEE 802.3) для проверки записей журнала синхронизации.
+ */
+uint32_t crc32_hash(const char* data, size_t size) {
+    static const vector<uint32_t> table = []() {
+        vector<uint32_t> values(256);
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; bit++) {
+                value = value & 1 ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+            }
+            values[i] = value;
+        }
+        return values;
+    }();
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ (unsigned char)data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+/**
+ * @brief Путь к журналу синхронизации каталога (лежит рядом с ним).
+ */
+string sync_log_path(const string& catalogPath) {
+    return catalogPath + ".wal";
+}
+
+const char syncLogMagic[4] = { 'A', 'M', 'S', 'L' };
+const uint32_t syncLogVersion = 1;
+
+/**
+ * @brief Журнал предзаписи (WAL) инкрементальной синхронизации каталога.
+ *
+ * Файл начинается с "AMSL" и версии (uint32), дальше идут записи: длина содержимого (uint32),
+ * его CRC-32 (uint32) и само содержимое — тип записи (uint32) и поля. Upsert хранит аниме целиком,
+ * Commit — отметку синхронизации после очередной страницы. При чтении учитываются только записи
+ * до последнего целого Commit: хвост, оборванный прерванной синхронизацией или поврежденный,
+ * отбрасывается и затирается при следующей записи. Числа little-endian, как в журнале трафика.
+ */
+class SyncLog {
+public:
+    explicit SyncLog(const string& path)
+        : path(path) {
+    }
+
+    /**
+     * @brief Читает подтвержденные записи и последнюю отметку.
+     *
+     * @return false, если журнала нет или у него другой формат.
+     */
+    bool load() {
+        committed.clear();
+        lastMark = SyncMark();
+        committedBytes = 0;
+
+        ifstream file(path, ios::binary);
+        string data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        if (data.compare(0, 4, string(syncLogMagic, 4)) != 0) {
+            return false;
+        }
+
+        TrafficReader reader{ data.data(), data.size() };
+        reader.offset = 4;
+        if (reader.u32() != syncLogVersion) {
+            return false;
+        }
+        committedBytes = reader.offset;
+
+        vector<Anime> pending;
+        while (reader.offset < data.size()) {
+            uint32_t length = reader.u32();
+            uint32_t checksum = reader.u32();
+            if (!reader.ok || length > data.size() - reader.offset || crc32_hash(data.data() + reader.offset, length) != checksum) {
+                break;
+            }
+
+            TrafficReader entry{ data.data() + reader.offset, length };
+            reader.offset += length;
+
+            uint32_t type = entry.u32();
+            if (type == Upsert) {
+                Anime anime = read_anime(entry);
+                if (!entry.ok) {
+                    break;
+                }
+                pending.push_back(move(anime));
+            }
+            else if (type == Commit) {
+                SyncMark mark;
+                mark.updatedAt = (int64_t)entry.u64();
+                mark.id = (int)entry.u32();
+                if (!entry.ok) {
+                    break;
+                }
+                for (auto& anime : pending) {
+                    committed[anime.id] = move(anime);
+                }
+                pending.clear();
+                lastMark = mark;
+                committedBytes = reader.offset;
+            }
+            else {
+                break;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Дописывает страницу изменений и подтверждающую ее отметку одним блоком.
+     *
+     * @return true, если запись удалась.
+     */
+    bool append(const vector<Anime>& page, const SyncMark& mark) {
+        string data;
+        if (committedBytes == 0) {
+            data.assign(syncLogMagic, 4);
+            put_u32(data, syncLogVersion);
+        }
+        else {
+            // Отбрасываем неподтвержденный хвост прерванной синхронизации
+            error_code error;
+            if (filesystem::file_size(path, error) != committedBytes) {
+                filesystem::resize_file(path, committedBytes, error);
+            }
+            if (error) {
+                return false;
+            }
+        }
+
+        string payload;
+        for (const auto& anime : page) {
+            payload.clear();
+            put_u32(payload, Upsert);
+            put_anime(payload, anime);
+            put_entry(data, payload);
+        }
+        payload.clear();
+        put_u32(payload, Commit);
+        put_u64(payload, (uint64_t)mark.updatedAt);
+        put_u32(payload, (uint32_t)mark.id);
+        put_entry(data, payload);
+
+        {
+            ofstream file(path, ios::binary | (committedBytes == 0 ? ios::trunc : ios::app));
+            file.write(data.data(), data.size());
+            file.flush();
+            if (!file.good()) {
+                return false;
+            }
+        }
+
+        committedBytes += data.size();
+        for (const auto& anime : page) {
+            committed[anime.id] = anime;
+        }
+        lastMark = mark;
+        return true;
+    }
+
+    /**
+     * @brief Начинает журнал заново с одной отметкой (после полной синхронизации или компакции).
+     *
+     * Новый журнал пишется во временный файл и затем переименовывается.
+     */
+    bool reset(const SyncMark& mark) {
+        string data(syncLogMagic, 4);
+        put_u32(data, syncLogVersion);
+
+        string payload;
+        put_u32(payload, Commit);
+        put_u64(payload, (uint64_t)mark.updatedAt);
+        put_u32(payload, (uint32_t)mark.id);
+        put_entry(data, payload);
+
+        string temporary = path + ".tmp";
+        {
+            ofstream file(temporary, ios::binary | ios::trunc);
+            file.write(data.data(), data.size());
+            if (!file.good()) {
+                return false;
+            }
+        }
+
+        error_code error;
+        filesystem::rename(temporary, path, error);
+        if (error) {
+            return false;
+        }
+
+        committed.clear();
+        lastMark = mark;
+        committedBytes = data.size();
+        return true;
+    }
+
+    const SyncMark& mark() const {
+        return lastMark;
+    }
+
+    /**
+     * @brief Записи, подтвержденные в журнале, по id (последняя версия каждой).
+     */
+    const unordered_map<int, Anime>& records() const {
+        return committed;
+    }
+
+    uint64_t size_bytes() const {
+        return committedBytes;
+    }
+
+private:
+    enum EntryType : uint32_t { Upsert = 1, Commit = 2 };
+
+    string path;
+    SyncMark lastMark;
+    unordered_map<int, Anime> committed;
+    uint64_t committedBytes = 0;
+
+    static void put_entry(string& out, const string& payload) {
+        put_u32(out, (uint32_t)payload.size());
+        put_u32(out, crc32_hash(payload.data(), payload.size()));
+        out += payload;
+    }
+
+    static void put_anime(string& out, const Anime& anime) {
+        for (int column = 0; column < 6; column++) {
+            put_u32(out, (uint32_t)(anime.*catalogNumbers[column]));
+        }
+        for (int column = 0; column < 4; column++) {
+            put_string(out, anime.*catalogTexts[column]);
+        }
+        put_string(out, anime.updatedAt);
+        put_u32(out, (uint32_t)anime.synonyms.size());
+        for (const auto& synonym : anime.synonyms) {
+            put_string(out, synonym);
+        }
+    }
+
+    static Anime read_anime(TrafficReader& reader) {
+        Anime anime;
+        for (int column = 0; column < 6; column++) {
+            anime.*catalogNumbers[column] = (int)reader.u32();
+        }
+        for (int column = 0; column < 4; column++) {
+            anime.*catalogTexts[column] = reader.text();
+        }
+        anime.updatedAt = reader.text();
+        uint32_t count = reader.u32();
+        for (uint32_t i = 0; i < count && reader.ok; i++) {
+            anime.synonyms.push_back(reader.text());
+        }
+        return anime;
+    }
+};
+
+/**
+ * @brief Декодирует UTF-8 строку в кодовые точки (некорректные байты пропускаются).
+ */
+void decode_utf8(string_view text, vector<uint32_t>& codepoints) {
+    for (size_t i = 0; i < text.size();) {
+        unsigned char c = text[i];
+        size_t length = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xE ? 3 : (c >> 3) == 0x1E ? 4 : 0;
+        if (length == 0 || i + length > text.size()) {
+            i++;
+            continue;
+        }
+
+        uint32_t codepoint = length == 1 ? c : c & (0x7F >> length);
+        for (size_t j = 1; j < length; j++) {
+            codepoint = (codepoint << 6) | (text[i + j] & 0x3F);
+        }
+        codepoints.push_back(codepoint);
+        i += length;
+    }
+}
+
+/**
+ * @brief Нормализует кодовую точку для поиска.
+ *
+ * Приводит к нижнему регистру латиницу и кириллицу, заменяет ё на е, а кириллические буквы,
+ * которые выглядят как латинские (а, е, о, р, с, х, ...), — на латинские, чтобы смешанный ввод
+ * находил те же записи. Не буквы и не цифры превращаются в пробел (граница слова).
+ *
+ * @return Нормализованная кодовая точка или ' ' для разделителя.
+ */
+uint32_t normalize_codepoint(uint32_t c) {
+    if (c >= 'A' && c <= 'Z') {
+        return c + 32;
+    }
+    if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) {
+        return c;
+    }
+    if (c < 0x80) {
+        return ' ';
+    }
+
+    if (c >= 0x0410 && c <= 0x042F) {
+        c += 0x20;
+    }
+    if (c == 0x0401 || c == 0x0451) {
+        c = 0x0435;
+    }
+
+    switch (c) {
+    case 0x0430: return 'a';
+    case 0x0432: return 'b';
+    case 0x0435: return 'e';
+    case 0x043A: return 'k';
+    case 0x043C: return 'm';
+    case 0x043D: return 'h';
+    case 0x043E: return 'o';
+    case 0x0440: return 'p';
+    case 0x0441: return 'c';
+    case 0x0442: return 't';
+    case 0x0443: return 'y';
+    case 0x0445: return 'x';
+    }
+
+    // Прочая пунктуация Unicode (кавычки, тире и т. п.) — разделитель
+    if ((c >= 0x2000 && c <= 0x206F) || (c >= 0x3000 && c <= 0x303F) || c == 0x00A0) {
+        return ' ';
+    }
+    return c;
+}
+
+/**
+ * @brief Добавляет в out триграммы нормализованного текста (каждое слово дополняется пробелами: "  слово ").
+ */
+void extract_trigrams(string_view text, vector<uint64_t>& out) {
+    thread_local vector<uint32_t> codepoints;
+    codepoints.clear();
+    decode_utf8(text, codepoints);
+
+    uint32_t window[3] = { ' ', ' ', ' ' };
+    bool inWord = false;
+    auto push = [&](uint32_t c) {
+        window[0] = window[1];
+        window[1] = window[2];
+        window[2] = c;
+        out.push_back(((uint64_t)window[0] << 42) | ((uint64_t)window[1] << 21) | window[2]);
+    };
+
+    for (uint32_t c : codepoints) {
+        c = normalize_codepoint(c);
+        if (c == ' ') {
+            if (inWord) {
+                push(' ');
+                window[0] = window[1] = window[2] = ' ';
+            }
+            inWord = false;
+            continue;
+        }
+        inWord = true;
+        push(c);
+    }
+    if (inWord) {
+        push(' ');
+    }
+}
+
+/**
+ * @brief Пересечение двух отсортированных списков без повторов.
+ *
+ * При наличии SSE2 сравнивает блоки по 4 элемента со всеми сдвигами другого блока за раз,
+ * хвост доходит скалярным слиянием.
+ *
+ * @return Количество элементов, записанных в out.
+ */
+size_t intersect_sorted(const uint32_t* a, size_t countA, const uint32_t* b, size_t countB, uint32_t* out) {
+    size_t i = 0, j = 0, found = 0;
+
+#ifdef ANIMI_SSE2
+    while (i + 4 <= countA && j + 4 <= countB) {
+        __m128i blockA = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i blockB = _mm_loadu_si128((const __m128i*)(b + j));
+
+        __m128i equal = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi32(blockA, blockB),
+                _mm_cmpeq_epi32(blockA, _mm_shuffle_epi32(blockB, _MM_SHUFFLE(0, 3, 2, 1)))),
+            _mm_or_si128(_mm_cmpeq_epi32(blockA, _mm_shuffle_epi32(blockB, _MM_SHUFFLE(1, 0, 3, 2))),
+                _mm_cmpeq_epi32(blockA, _mm_shuffle_epi32(blockB, _MM_SHUFFLE(2, 1, 0, 3)))));
+
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(equal));
+        for (int bit = 0; bit < 4; bit++) {
+            if (mask & (1 << bit)) {
+                out[found++] = a[i + bit];
+            }
+        }
+
+        uint32_t lastA = a[i + 3];
+        uint32_t lastB = b[j + 3];
+        if (lastA <= lastB) {
+            i += 4;
+        }
+        if (lastB <= lastA) {
+            j += 4;
+        }
+    }
+#endif
+
+    while (i < countA && j < countB) {
+        if (a[i] < b[j]) {
+            i++;
+        }
+        else if (b[j] < a[i]) {
+            j++;
+        }
+        else {
+            out[found++] = a[i];
+            i++;
+            j++;
+        }
+    }
+    return found;
+}
+
+/**
+ * @brief Триграммный инвертированный индекс для нечеткого поиска по названиям.
+ *
+ * Для каждой триграммы хранится отсортированный список номеров записей, сжатый как
+ * разности соседних номеров в формате varint. Запрос ранжируется по коэффициенту Дайса
+ * (доля общих триграмм), а записи, содержащие все триграммы запроса (пересечение списков),
+ * поднимаются наверх.
+ */
+class TrigramIndex {
+public:
+    struct Match {
+        uint32_t document;
+        float score;
+    };
+
+    /**
+     * @brief Строит индекс по count записям; source заполняет тексты записи для индексации.
+     */
+    void build(size_t count, const function<void(size_t, vector<string_view>&)>& source) {
+        lookup.clear();
+        documentTrigrams.assign(count, 0);
+
+        vector<vector<uint32_t>> lists;
+        vector<string_view> texts;
+        vector<uint64_t> grams;
+
+        for (size_t document = 0; document < count; document++) {
+            texts.clear();
+            grams.clear();
+            source(document, texts);
+            for (string_view text : texts) {
+                extract_trigrams(text, grams);
+            }
+
+            sort(grams.begin(), grams.end());
+            grams.erase(unique(grams.begin(), grams.end()), grams.end());
+            documentTrigrams[document] = (uint16_t)(grams.size() < 65535 ? grams.size() : 65535);
+
+            for (uint64_t gram : grams) {
+                auto inserted = lookup.emplace(gram, (uint32_t)lists.size());
+                if (inserted.second) {
+                    lists.emplace_back();
+                }
+                lists[inserted.first->second].push_back((uint32_t)document);
+            }
+        }
+
+        // Сжимаем списки: разности соседних номеров в varint
+        postings.clear();
+        listOffsets.assign(lists.size(), 0);
+        listSizes.assign(lists.size(), 0);
+        for (size_t list = 0; list < lists.size(); list++) {
+            listOffsets[list] = postings.size();
+            listSizes[list] = (uint32_t)lists[list].size();
+
+            uint32_t previous = 0;
+            for (uint32_t document : lists[list]) {
+                uint32_t delta = document - previous;
+                previous = document;
+                while (delta >= 0x80) {
+                    postings.push_back((uint8_t)(delta | 0x80));
+                    delta >>= 7;
+                }
+                postings.push_back((uint8_t)delta);
+            }
+        }
+        postings.shrink_to_fit();
+    }
+
+    size_t size() const {
+        return documentTrigrams.size();
+    }
+
+    size_t compressed_bytes() const {
+        return postings.size();
+    }
+
+    /**
+     * @brief Ищет до topK записей, наиболее похожих на запрос.
+     */
+    vector<Match> search(const string& query, size_t topK) const {
+        vector<uint64_t> grams;
+        extract_trigrams(query, grams);
+        sort(grams.begin(), grams.end());
+        grams.erase(unique(grams.begin(), grams.end()), grams.end());
+
+        vector<uint32_t> lists;
+        for (uint64_t gram : grams) {
+            auto it = lookup.find(gram);
+            if (it != lookup.end()) {
+                lists.push_back(it->second);
+            }
+        }
+        if (lists.empty()) {
+            return {};
+        }
+
+        // Сначала короткие списки: пересечение быстрее сходится к пустому
+        sort(lists.begin(), lists.end(), [this](uint32_t a, uint32_t b) { return listSizes[a] < listSizes[b]; });
+
+        thread_local vector<uint16_t> hits;
+        thread_local vector<uint32_t> touched;
+        thread_local vector<uint32_t> decoded;
+        thread_local vector<uint32_t> exact;
+        thread_local vector<uint32_t> scratch;
+        hits.assign(size(), 0);
+        touched.clear();
+
+        for (size_t n = 0; n < lists.size(); n++) {
+            decode(lists[n], decoded);
+            for (uint32_t document : decoded) {
+                if (hits[document]++ == 0) {
+                    touched.push_back(document);
+                }
+            }
+
+            // Пересечение имеет смысл, только если все триграммы запроса есть в индексе
+            if (lists.size() == grams.size()) {
+                if (n == 0) {
+                    exact = decoded;
+                }
+                else if (!exact.empty()) {
+                    scratch.resize(exact.size() < decoded.size() ? exact.size() : decoded.size());
+                    scratch.resize(intersect_sorted(exact.data(), exact.size(), decoded.data(), decoded.size(), scratch.data()));
+                    exact.swap(scratch);
+                }
+            }
+        }
+        if (lists.size() != grams.size()) {
+            exact.clear();
+        }
+
+        vector<Match> matches;
+        matches.reserve(touched.size());
+        float queryTrigrams = (float)grams.size();
+        for (uint32_t document : touched) {
+            float score = 2.0f * hits[document] / (queryTrigrams + documentTrigrams[document]);
+            matches.push_back({ document, score });
+        }
+        for (uint32_t document : exact) {
+            // touched не отсортирован, поэтому бонус ищем через hits: 0 у записи быть не может
+            hits[document] = 0xFFFF;
+        }
+        for (auto& match : matches) {
+            if (hits[match.document] == 0xFFFF) {
+                match.score += 1.0f;
+            }
+        }
+
+        size_t take = topK < matches.size() ? topK : matches.size();
+        partial_sort(matches.begin(), matches.begin() + take, matches.end(), [](const Match& a, const Match& b) {
+            return a.score != b.score ? a.score > b.score : a.document < b.document;
+        });
+        matches.resize(take);
+        return matches;
+    }
+
+private:
+    unordered_map<uint64_t, uint32_t> lookup;
+    vector<uint64_t> listOffsets;
+    vector<uint32_t> listSizes;
+    vector<uint8_t> postings;
+    vector<uint16_t> documentTrigrams;
+
+    void decode(uint32_t list, vector<uint32_t>& out) const {
+        out.resize(listSizes[list]);
+
+        const uint8_t* cursor = postings.data() + listOffsets[list];
+        uint32_t document = 0;
+        for (uint32_t i = 0; i < listSizes[list]; i++) {
+            uint32_t delta = 0;
+            int shift = 0;
+            while (*cursor & 0x80) {
+                delta |= (uint32_t)(*cursor++ & 0x7F) << shift;
+                shift += 7;
+            }
+            delta |= (uint32_t)(*cursor++) << shift;
+            document += delta;
+            out[i] = document;
+        }
+    }
+};
+
+/**
+ * @brief Индекс по локальному каталогу; строится при первом поиске.
+ */
+const TrigramIndex& catalog_index() {
+    static TrigramIndex index;
+    static once_flag built;
+
+    call_once(built, []() {
+        const CatalogView& catalog = local_catalog();
+        auto start = chrono::steady_clock::now();
+
+        index.build(catalog.size(), [&catalog](size_t document, vector<string_view>& texts) {
+            for (int column = 0; column < 3; column++) {
+                texts.push_back(catalog.text(document, column));
+            }
+            for (size_t i = 0; i < catalog.synonym_count(document); i++) {
+                texts.push_back(catalog.synonym(document, i));
+            }
+        });
+
+        if (logger().enabled(LogLevel::Debug)) {
+            double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            LOG_DEBUG("Триграммный индекс построен за " + to_string(milliseconds) + " мс, списки: "
+                + to_string(index.compressed_bytes() / 1024) + " КБ");
+        }
+    });
+    return index;
+}
+
+/**
+ * @brief Нечеткий поиск по локальному каталогу; возвращает до take записей, пропустив первые skip.
+ */
+vector<Anime> search_catalog(const string& query, size_t take, size_t skip = 0) {
+    vector<Anime> results;
+    vector<TrigramIndex::Match> matches = catalog_index().search(query, take + skip);
+    for (size_t i = skip; i < matches.size(); i++) {
+        results.push_back(local_catalog().record(matches[i].document));
+    }
+    return results;
+}
+
+/**
+ * @brief Включен ли автономный режим (поиск и случайное аниме из локального каталога).
+ */
+bool offline_mode() {
+    return config.value("offline", false) && local_catalog().is_open();
+}
+
+/**
+ * @brief Постраничный поиск аниме с окном страниц и предзагрузкой следующей.
+ *
+ * Страницы запрашиваются по смещению (skip/take). В памяти держится не больше window страниц:
+ * при листании вперед вытесняется самая далекая от текущей, а вернувшись к вытесненной, пагинатор
+ * запрашивает ее заново (обычно из дискового кэша). Пока пользователь читает страницу, следующая
+ * загружается в фоновом потоке.
+ *
+ * Размер страницы подстраивается под задержку: ответ быстрее половины "search_page_target_ms"
+ * удваивает размер следующих страниц (до "search_page_max"), ответ медленнее — уменьшает вдвое.
+ */
+class SearchPager {
+public:
+    struct Page {
+        size_t number = 0;
+        size_t offset = 0;
+        vector<Anime> items;
+        bool last = false;
+        string error;
+        double seconds = 0;
+    };
+
+    /**
+     * @brief Загружает take записей начиная с offset. Вызывается и из фонового потока.
+     */
+    using Fetcher = function<Page(size_t offset, size_t take)>;
+
+    SearchPager(Fetcher fetcher, size_t pageSize, size_t maxPageSize, size_t window, double targetSeconds)
+        : fetcher(move(fetcher)), minPageSize(max<size_t>(pageSize, 1)), pageSize(max<size_t>(pageSize, 1)),
+        maxPageSize(max(maxPageSize, pageSize)), window(max<size_t>(window, 2)), targetSeconds(targetSeconds) {
+    }
+
+    ~SearchPager() {
+        if (prefetch.valid()) {
+            prefetch.wait();
+        }
+    }
+
+    SearchPager(const SearchPager&) = delete;
+    SearchPager& operator=(const SearchPager&) = delete;
+
+    /**
+     * @brief Возвращает страницу с номером number (с нуля), дожидаясь ее загрузки, и запускает
+     * предзагрузку следующей.
+     *
+     * @return nullptr, если страница лежит за концом результатов. Страница с ошибкой не
+     * сохраняется и действительна только до следующего вызова.
+     */
+    const Page* page(size_t number) {
+        if (endPage && number >= *endPage) {
+            return nullptr;
+        }
+
+        auto cached = pages.find(number);
+        if (cached == pages.end()) {
+            Page loaded;
+            if (prefetch.valid() && prefetchNumber == number) {
+                loaded = prefetch.get();
+            }
+            else if (number < layout.size()) {
+                loaded = load(number, layout[number].first, layout[number].second);
+            }
+            else if (number == layout.size()) {
+                loaded = load(number, next_offset(), pageSize);
+            }
+            else {
+                return nullptr;
+            }
+            adapt(loaded);
+
+            // Пустая страница без ошибки означает, что результаты кончились на предыдущей
+            if (loaded.items.empty() && loaded.error.empty() && number > 0) {
+                endPage = number;
+                return nullptr;
+            }
+            // Ошибку не кэшируем: следующий запрос той же страницы загрузит ее заново
+            if (!loaded.error.empty()) {
+                failed = move(loaded);
+                return &failed;
+            }
+            cached = store(move(loaded));
+        }
+
+        current = number;
+        start_prefetch(number + 1);
+        return &cached->second;
+    }
+
+    size_t page_size() const {
+        return pageSize;
+    }
+
+    size_t resident_pages() const {
+        return pages.size();
+    }
+
+private:
+    Fetcher fetcher;
+    size_t minPageSize;
+    size_t pageSize;
+    size_t maxPageSize;
+    size_t window;
+    double targetSeconds;
+
+    map<size_t, Page> pages;
+    Page failed;
+    vector<pair<size_t, size_t>> layout;
+    optional<size_t> endPage;
+    size_t current = 0;
+
+    future<Page> prefetch;
+    size_t prefetchNumber = 0;
+
+    Page load(size_t number, size_t offset, size_t take) {
+        auto started = chrono::steady_clock::now();
+        Page page = fetcher(offset, take);
+        page.number = number;
+        page.offset = offset;
+        page.last = page.error.empty() && page.items.size() < take;
+        page.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        return page;
+    }
+
+    size_t next_offset() const {
+        return layout.empty() ? 0 : layout.back().first + layout.back().second;
+    }
+
+    void adapt(const Page& page) {
+        if (!page.error.empty()) {
+            return;
+        }
+        if (page.number == layout.size()) {
+            layout.emplace_back(page.offset, max<size_t>(page.items.size(), pageSize));
+            if (page.last) {
+                endPage = page.number + 1;
+            }
+        }
+
+        if (page.seconds < targetSeconds / 2) {
+            pageSize = min(pageSize * 2, maxPageSize);
+        }
+        else if (page.seconds > targetSeconds) {
+            pageSize = max(pageSize / 2, minPageSize);
+        }
+    }
+
+    map<size_t, Page>::iterator store(Page page) {
+        size_t number = page.number;
+        while (pages.size() >= window) {
+            // Вытесняем страницу, дальше всех отстоящую от запрошенной
+            auto farthest = pages.begin();
+            if (number - min(number, pages.begin()->first) < prev(pages.end())->first - min(number, prev(pages.end())->first)) {
+                farthest = prev(pages.end());
+            }
+            pages.erase(farthest);
+        }
+        return pages.emplace(number, move(page)).first;
+    }
+
+    void start_prefetch(size_t number) {
+        if (pages.count(number) || (endPage && number >= *endPage) || number > layout.size()) {
+            return;
+        }
+        if (prefetch.valid()) {
+            if (prefetchNumber == number) {
+                return;
+            }
+            prefetch.wait();
+        }
+
+        // Границы вытесненной страницы уже известны, новая начинается сразу за последней
+        size_t offset = number < layout.size() ? layout[number].first : next_offset();
+        size_t take = number < layout.size() ? layout[number].second : pageSize;
+        prefetchNumber = number;
+        prefetch = async(launch::async, [this, number, offset, take]() {
+            return load(number, offset, take);
+        });
+    }
+};
+
+/**
+ * @brief Загрузчик страниц поиска: локальный каталог в автономном режиме, иначе API.
+ */
+SearchPager::Fetcher search_page_fetcher(const string& query) {
+    if (offline_mode()) {
+        return [query](size_t offset, size_t take) {
+            SearchPager::Page page;
+            page.items = search_catalog(query, take, offset);
+            return page;
+        };
+    }
+
+    return [query](size_t offset, size_t take) {
+        SearchPager::Page page;
+        string url = api_url("/anime/search");
+        string response = http_post_request(url, query, (int)take, (int)offset);
+
+        ParseTimer timer(endpoint_of(url));
+        string type = decode_records(response, page.items, page.error);
+        if (page.error.empty() && type != "array" && type != "object" && type != "null") {
+            page.error = "Ожидался массив или объект данных аниме, получен: " + type;
+        }
+        return page;
+    };
+}
+
+/**
+ * @brief Выводит краткую карточку аниме из результатов поиска.
+ */
+void print_search_result(const Anime& anime) {
+    cout << "ID: " << anime.id << endl;
+    cout << "Shikimori ID: " << anime.shikimoriId << endl;
+    cout << "MyAnimeList ID: " << anime.myAnimeListId << endl;
+    cout << "Название: " << anime.name << endl;
+    cout << "Название на русском: " << anime.russian << endl;
+    cout << "Название на английском: " << anime.english << endl;
+    cout << "Кол-во эпизодов: " << anime.episodes << " / " << anime.episodesAired << endl;
+    cout << "Длительность: " << anime.duration << " м." << endl;
+    cout << "Смотреть: " << "https://animi.club/anime/" << anime.id << "\n" << endl;
+}
+
+/**
+ * @brief Открывает локальный каталог при старте, накладывает на него журнал синхронизации
+ * и выводит время открытия и RSS в режиме отладки.
+ */
+void open_catalog() {
+    string path = config.value("catalog_file", string("catalog.bin"));
+
+    auto start = chrono::steady_clock::now();
+    bool opened = local_catalog().open(path);
+    if (opened) {
+        SyncLog log(sync_log_path(path));
+        if (log.load() && !log.records().empty()) {
+            local_catalog().overlay(log.records());
+            LOG_INFO("Из журнала синхронизации наложено записей: " + to_string(log.records().size()));
+        }
+    }
+    double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    if (opened) {
+        LOG_INFO("Каталог '" + path + "' открыт: " + to_string(local_catalog().size()) + " записей за "
+            + to_string(milliseconds) + " мс, RSS " + to_string(current_rss_bytes() / 1024) + " КБ");
+    }
+    else {
+        LOG_ERROR("Не удалось открыть каталог '" + path + "', используется API");
+    }
+}
+
+/**
+ * @brief --sync [файл]: постранично выгружает каталог из API и записывает его в файл каталога.
+ */
+int sync_catalog(const vector<string>& args) {
+    string path = args.empty() ? config.value("catalog_file", string("catalog.bin")) : args[0];
+    int pageSize = config.value("sync_page_size", 100);
+
+    AnimeTable records;
+    for (int skip = 0;; skip += pageSize) {
+        HttpRequest request = search_anime_request("");
+        request.body = search_request_body("", pageSize, skip);
+
+        HttpResponse response = transport().perform(request);
+        if (response.code != CURLE_OK || response.status != 200) {
+            cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] "
+                << "Ошибка при загрузке страницы (skip " << skip << "): HTTP " << response.status << endl;
+            return 1;
+        }
+
+        size_t before = records.size();
+        string errorMessage;
+        decode_records(response.body, records, errorMessage);
+
+        cout << "\rЗагружено записей: " << records.size() << flush;
+        if (!errorMessage.empty() || records.size() - before < (size_t)pageSize) {
+            break;
+        }
+    }
+    cout << endl;
+
+    // Журнал удаляется до замены каталога: если запись прервется, следующая --sync-delta
+    // просто начнет с нуля, а не наложит старые изменения на новый каталог
+    error_code error;
+    filesystem::remove(sync_log_path(path), error);
+    local_catalog().close();
+    if (!write_catalog(path, records)) {
+        cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] " << "Не удалось записать каталог " << path << endl;
+        return 1;
+    }
+    SyncLog(sync_log_path(path)).reset(records.newest_mark());
+    cout << "[" << COLOR_MAGENTA << "+" << COLOR_RESET << "] " << "Каталог записан: " << path << endl;
+    return 0;
+}
+
+/**
+ * @brief Тело запроса изменений: записи после отметки по возрастанию (updatedAt, id).
+ */
+string changes_request_body(const SyncMark& mark, int take) {
+    char since[32];
+    json body;
+    body["query"] = "";
+    body["take"] = take;
+    body["updatedSince"] = format_iso8601(mark.updatedAt, since, sizeof(since)) > 0 ? since : "1970-01-01T00:00:00.000Z";
+    body["afterId"] = mark.id;
+    return body.dump();
+}
+
+/**
+ * @brief Переписывает каталог с записями журнала и начинает журнал заново с его отметки.
+ *
+ * Сначала заменяется каталог, затем журнал. Если процесс прервется между этими шагами,
+ * старый журнал при следующем открытии наложит на новый каталог те же самые записи.
+ *
+ * @return Число записей в новом каталоге или -1 при ошибке.
+ */
+long long compact_catalog(const string& path, SyncLog& log) {
+    const unordered_map<int, Anime>& changes = log.records();
+
+    AnimeTable table;
+    {
+        CatalogView base;
+        unordered_set<int> found;
+        if (base.open(path)) {
+            table.reserve(base.size() + changes.size());
+            for (size_t index = 0; index < base.size(); index++) {
+                auto it = changes.find(base.number(index, AnimeTable::Id));
+                if (it != changes.end()) {
+                    found.insert(it->first);
+                    table.push_back(it->second);
+                }
+                else {
+                    table.push_back(base.record(index));
+                }
+            }
+        }
+
+        vector<int> added;
+        for (const auto& entry : changes) {
+            if (!found.count(entry.first)) {
+                added.push_back(entry.first);
+            }
+        }
+        sort(added.begin(), added.end());
+        for (int id : added) {
+            table.push_back(changes.at(id));
+        }
+    }
+
+    // Отображенный в память каталог нельзя заменить в Windows
+    local_catalog().close();
+    if (!write_catalog(path, table) || !log.reset(log.mark())) {
+        return -1;
+    }
+    return (long long)table.size();
+}
+
+/**
+ * @brief --sync-delta [файл]: загружает только записи, измененные после прошлой синхронизации.
+ *
+ * Страницы запрашиваются начиная строго после отметки из журнала синхронизации, и каждая
+ * дописывается в журнал вместе с новой отметкой, поэтому прерванная синхронизация продолжается
+ * с последней записанной страницы. Когда записей в журнале становится больше "sync_compact_ratio"
+ * от размера каталога, каталог переписывается вместе с ними (компакция).
+ */
+int sync_catalog_delta(const vector<string>& args) {
+    string path = args.empty() ? config.value("catalog_file", string("catalog.bin")) : args[0];
+    int pageSize = config.value("sync_page_size", 100);
+    double compactRatio = config.value("sync_compact_ratio", 0.1);
+
+    auto started = chrono::steady_clock::now();
+    SyncLog log(sync_log_path(path));
+    log.load();
+
+    SyncMark mark = log.mark();
+    size_t changed = 0;
+    string endpoint = endpoint_of(search_anime_request("").url);
+    auto wire_bytes = [&endpoint]() {
+        json metrics = request_metrics().to_json();
+        return metrics.contains(endpoint) ? metrics[endpoint].value("wire_bytes", (uint64_t)0) : 0;
+    };
+    uint64_t wireBefore = wire_bytes();
+    while (true) {
+        HttpRequest request = search_anime_request("");
+        request.body = changes_request_body(mark, pageSize);
+
+        HttpResponse response = transport().perform(request);
+        if (response.code != CURLE_OK || response.status != 200) {
+            cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] "
+                << "Ошибка при загрузке изменений: HTTP " << response.status << endl;
+            return 1;
+        }
+
+        vector<Anime> page;
+        string errorMessage;
+        decode_records(response.body, page, errorMessage);
+        if (!errorMessage.empty()) {
+            cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] " << "Ошибка API: " << errorMessage << endl;
+            return 1;
+        }
+        if (page.empty()) {
+            break;
+        }
+
+        SyncMark next = mark;
+        for (const auto& anime : page) {
+            next.advance(anime);
+        }
+        if (!(mark < next)) {
+            // Иначе API, не понимающий updatedSince, отдавал бы одну и ту же страницу бесконечно
+            cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] "
+                << "API вернул записи не новее отметки: выборка изменений не поддерживается, используйте --sync" << endl;
+            return 1;
+        }
+        if (!log.append(page, next)) {
+            cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] " << "Не удалось записать журнал " << sync_log_path(path) << endl;
+            return 1;
+        }
+        mark = next;
+        changed += page.size();
+
+        cout << "\rИзменено записей: " << changed << flush;
+        if (page.size() < (size_t)pageSize) {
+            break;
+        }
+    }
+    if (changed > 0) {
+        cout << endl;
+    }
+
+    size_t catalogSize = 0;
+    {
+        CatalogView base;
+        if (base.open(path)) {
+            catalogSize = base.size();
+        }
+    }
+
+    long long compacted = 0;
+    if (!log.records().empty() && log.records().size() > catalogSize * compactRatio) {
+        compacted = compact_catalog(path, log);
+        if (compacted < 0) {
+            cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] " << "Не удалось записать каталог " << path << endl;
+            return 1;
+        }
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    cout << "[" << COLOR_MAGENTA << "+" << COLOR_RESET << "] " << "Изменено записей: " << changed
+        << ", получено " << (wire_bytes() - wireBefore) / 1024 << " КБ на проводе за " << fixed << setprecision(2) << seconds << " с" << endl;
+    if (compacted > 0) {
+        cout << "[" << COLOR_MAGENTA << "+" << COLOR_RESET << "] " << "Каталог перезаписан с изменениями: " << path
+            << " (" << compacted << " записей)" << endl;
+    }
+    else if (!log.records().empty()) {
+        cout << "[" << COLOR_MAGENTA << "+" << COLOR_RESET << "] " << "В журнале " << log.records().size()
+            << " измененных записей (" << log.size_bytes() / 1024 << " КБ), каталог будет перезаписан после "
+            << (size_t)(catalogSize * compactRatio) << endl;
+    }
+    return 0;
+}
+
+/**
+ * @brief --import <дамп> [файл]: строит каталог из JSON-массива или NDJSON-файла с записями аниме.
+ */
+int import_catalog(const vector<string>& args) {
+    if (args.empty()) {
+        cout << "Использование: --import <dump.json|dump.ndjson> [catalog.bin]" << endl;
+        return 1;
+    }
+    string path = args.size() > 1 ? args[1] : config.value("catalog_file", string("catalog.bin"));
+
+    ifstream dump(args[0], ios::binary);
+    if (!dump.good()) {
+        cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] " << "Не удалось открыть " << args[0] << endl;
+        return 1;
+    }
+
+    AnimeTable records;
+    try {
+        dump >> ws;
+        string errorMessage;
+        if (dump.peek() == '[') {
+            decode_records(dump, records, errorMessage);
+        }
+        else {
+            string line;
+            while (getline(dump, line)) {
+                if (line.find_first_not_of(" \t\r") != string::npos) {
+                    decode_records(line, records, errorMessage);
+                }
+            }
+        }
+    }
+    catch (const json::exception& e) {
+        cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] " << "Ошибка в дампе: " << e.what() << endl;
+        return 1;
+    }
+
+    if (!write_catalog(path, records)) {
+        cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] " << "Не удалось записать каталог " << path << endl;
+        return 1;
+    }
+    cout << "[" << COLOR_MAGENTA << "+" << COLOR_RESET << "] " << "Каталог записан: " << path
+        << " (" << records.size() << " записей)" << endl;
+    return 0;
+}
+
+/**
+ * @brief Фоновая очередь предварительно загруженных случайных аниме.
+ *
+ * Поток-производитель держит кольцевой буфер уже полученных и разобранных записей Anime
+ * глубиной "prefetch_depth" и дозаполняет его, как только в нем остается
+ * "prefetch_refill" записей или меньше. Счетчики попаданий и промахов помогают подобрать глубину.
+ */
+class RandomAnimePrefetcher {
+public:
+    RandomAnimePrefetcher(size_t depth, size_t refill)
+        : ring(depth > 0 ? depth : 1), refillThreshold(refill < ring.size() ? refill : ring.size() - 1) {
+    }
+
+    ~RandomAnimePrefetcher() {
+        stop();
+    }
+
+    /**
+     * @brief Запускает поток-производитель (повторный вызов ничего не делает).
+     */
+    void start() {
+        lock_guard<mutex> lock(ringMutex);
+        if (worker.joinable() || stopping) {
+            return;
+        }
+        worker = thread(&RandomAnimePrefetcher::run, this);
+    }
+
+    /**
+     * @brief Останавливает поток-производитель и дожидается его завершения.
+     */
+    void stop() {
+        {
+            lock_guard<mutex> lock(ringMutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    /**
+     * @brief Забирает готовое аниме из буфера без ожидания.
+     *
+     * @return true при попадании; false, если буфер пуст и аниме нужно запросить самостоятельно.
+     */
+    bool pop(Anime& anime) {
+        {
+            lock_guard<mutex> lock(ringMutex);
+            if (count == 0) {
+                misses++;
+                return false;
+            }
+
+            anime = move(ring[head]);
+            head = (head + 1) % ring.size();
+            count--;
+            hits++;
+        }
+        wakeup.notify_all();
+        return true;
+    }
+
+    uint64_t hit_count() const {
+        return hits;
+    }
+
+    uint64_t miss_count() const {
+        return misses;
+    }
+
+private:
+    vector<Anime> ring;
+    size_t head = 0;
+    size_t count = 0;
+    size_t refillThreshold;
+
+    mutex ringMutex;
+    condition_variable wakeup;
+    thread worker;
+    bool stopping = false;
+
+    atomic<uint64_t> hits{ 0 };
+    atomic<uint64_t> misses{ 0 };
+
+    void run() {
+        unique_lock<mutex> lock(ringMutex);
+
+        while (!stopping) {
+            // Ждем, пока буфер опустеет до порога дозаполнения
+            wakeup.wait(lock, [this] { return stopping || count <= refillThreshold; });
+
+            while (!stopping && count < ring.size()) {
+                lock.unlock();
+
+                Anime anime;
+                string error;
+                bool fetched = false;
+                try {
+                    // Паузу между повторами прерывает остановка очереди
+                    fetched = fetch_random_anime(anime, error, [this](chrono::milliseconds delay) {
+                        unique_lock<mutex> pauseLock(ringMutex);
+                        return !wakeup.wait_for(pauseLock, delay, [this] { return stopping; });
+                    });
+                }
+                catch (const json::exception&) {
+                }
+
+                lock.lock();
+                if (!fetched) {
+                    // Не даем потоку засыпать API запросами, если оно отвечает ошибками
+                    wakeup.wait_for(lock, chrono::seconds(1), [this] { return stopping; });
+                    continue;
+                }
+
+                ring[(head + count) % ring.size()] = move(anime);
+                count++;
+            }
+        }
+    }
+};
+
+/**
+ * @brief Возвращает общую очередь предзагрузки случайных аниме, настроенную из config.json.
+ */
+RandomAnimePrefetcher& random_prefetcher() {
+    static RandomAnimePrefetcher prefetcher(config.value("prefetch_depth", 4), config.value("prefetch_refill", 2));
+    return prefetcher;
+}
+
+/**
+ * @brief Выполняет запрос на случайное аниме через API и выводит информацию на консоль.
+ *
+ * Аниме берется из фоновой очереди предзагрузки; если очередь пуста, функция сама отправляет
+ * HTTP GET запрос и парсит ответ. Из полученных данных выводятся основные характеристики
+ * аниме, такие как ID, названия на разных языках, количество эпизодов и другие атрибуты.
+ *
+ * Если в полученных данных присутствует ошибка (например, отсутствует запрашиваемое поле), выводится сообщение об ошибке.
+ *
+ * После вывода информации о случайном аниме функция запрашивает пользователя о желании продолжить.
+ * В зависимости от ответа ('y' или 'Y' для продолжения, любой другой ответ для завершения) функция либо
+ * рекурсивно вызывает себя для получения нового случайного аниме, либо завершает выполнение программы.
+ */
+void get_random_anime() {
+    // Очищаем консоль
+    clear_console();
+
+    RandomAnimePrefetcher& prefetcher = random_prefetcher();
+    if (!offline_mode()) {
+        prefetcher.start();
+    }
+
+    try {
+        Anime anime;
+        if (offline_mode() && local_catalog().size() > 0) {
+            anime = local_catalog().random();
+        }
+        else if (!prefetcher.pop(anime)) {
+            string errorMessage;
+            if (!fetch_random_anime(anime, errorMessage)) {
+                cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] "
+                    << "Ошибка при получении информации о пользователе: " << errorMessage << endl;
+                return;
+            }
+        }
+
+        // Выводим информацию о аниме
+        cout << "[" << COLOR_MAGENTA << "+" << COLOR_RESET << "] "
+            << "Информация о аниме" << endl;
+        cout << "ID: " << anime.id << endl;
+        cout << "Shikimori ID: " << anime.shikimoriId << endl;
+        cout << "MyAnimeList ID: " << anime.myAnimeListId << endl;
+        cout << "Название: " << anime.name << endl;
+        cout << "Название на русском: " << anime.russian << endl;
+        cout << "Название на английском: " << anime.english << endl;
+
+        cout << "Альтернативные названия: ";
+        if (anime.synonyms.size() == 0) {
+            cout << "Нет";
+        }
+        else if (anime.synonyms.size() == 1) {
+            cout << anime.synonyms[0];
+        }
+        else {
+            for (size_t i = 0; i < anime.synonyms.size(); i++) {
+                cout << anime.synonyms[i];
+                if (i != anime.synonyms.size() - 1) {
+                    cout << ", ";
+                }
+            }
+        }
+        cout << endl;
+
+        cout << "Кол-во эпизодов: " << anime.episodes << " / " << anime.episodesAired << endl;
+        cout << "Длительность: " << anime.duration << " м." << endl;
+        cout << "Описание: " << anime.description << '\n' << endl;
+
+        cout << "Ссылки: " << endl;
+        cout << "AniMi Club: " << "https://animi.club/anime/" << anime.id << endl;
+        cout << "Shikimori: " << "https://shikimori.one/animes/" << anime.shikimoriId << endl;
+        cout << "MyAnimeList: " << "https://myanimelist.net/anime/" << anime.myAnimeListId << '\n' << endl;
+    }
+    catch (const json::exception& e) {
+        cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] "
+            << "Ошибка при обработке данных аниме: " << e.what() << endl;
+    }
+
+    string answer;
+    cout << "[" << COLOR_MAGENTA << "?" << COLOR_RESET << "] " << "Хотите продолжить? (y/n): ";
+    cin >> answer;
+
+    if (answer == "y" || answer == "Y") {
+        get_random_anime();
+    }
+    else {
+        exit(0);
+    }
+}
+
+void get_anime_by_query() {
+    clear_console();
+
+    string query;
+
+    cout << "[" << COLOR_MAGENTA << "?" << COLOR_RESET << "] " << "Введите название: ";
+    cin >> query;
+
+    string answer;
+    {
+        // Пагинатор живет только внутри блока: фоновая загрузка завершается до выхода или нового поиска
+        SearchPager pager(search_page_fetcher(query), config.value("search_page_size", config.value("search_top_k", 5)),
+            config.value("search_page_max", 40), config.value("search_page_window", 3),
+            config.value("search_page_target_ms", 250) / 1000.0);
+
+        size_t number = 0;
+        while (true) {
+            clear_console();
+
+            const SearchPager::Page* page = nullptr;
+            try {
+                page = pager.page(number);
+            }
+            catch (const json::exception& e) {
+                cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] "
+                    << "Ошибка при обработке данных аниме: " << e.what() << endl;
+            }
+
+            bool hasNext = false;
+            if (page && !page->error.empty()) {
+                cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] "
+                    << "Ошибка при получении данных аниме: " << page->error << endl;
+            }
+            else if (page && !page->items.empty()) {
+                cout << "[" << COLOR_MAGENTA << "#" << COLOR_RESET << "] " << "Страница " << number + 1 << ", результаты "
+                    << page->offset + 1 << "-" << page->offset + page->items.size() << '\n' << endl;
+                for (const auto& anime : page->items) {
+                    print_search_result(anime);
+                }
+                hasNext = !page->last;
+            }
+            else if (number == 0) {
+                cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] " << "Ничего не найдено." << endl;
+            }
+
+            if (page) {
+                LOG_DEBUG("Страница загружена за " + to_string(page->seconds * 1000) + " мс, следующие по "
+                    + to_string(pager.page_size()) + ", страниц в памяти: " + to_string(pager.resident_pages()));
+            }
+
+            cout << "[" << COLOR_MAGENTA << "?" << COLOR_RESET << "] "
+                << (hasNext ? "Следующая страница (n), " : "") << (number > 0 ? "предыдущая (p), " : "")
+                << "новый поиск (y), выход (любая клавиша): ";
+            cin >> answer;
+
+            if (answer == "n" || answer == "p") {
+                if (answer == "n" && hasNext) {
+                    number++;
+                }
+                else if (answer == "p" && number > 0) {
+                    number--;
+                }
+                continue;
+            }
+            break;
+        }
+    }
+
+    if (answer == "y" || answer == "Y") {
+        get_anime_by_query();
+    }
+    else {
+        exit(0);
+    }
+}
+
+/**
+ * @brief Очищает введенное имя пользователя от недопустимых символов.
+ *
+ * Функция принимает строку `username` и удаляет из нее все символы, кроме букв (верхнего и нижнего регистра), цифр, символов '-' и '_'. Очищенная строка возвращается в качестве результата.
+ *
+ * @param username Строка с именем пользователя, которую необходимо очистить.
+ * @return Очищенная строка с именем пользователя.
+ */
+string sanitize_username(string username) {
+    // Регулярное выражение для разрешенных символов: буквы, цифры, '-', '_'
+    regex pattern("[^a-zA-Z0-9-_]");
+
+    // Заменяем недопустимые символы на пустую строку
+    username = regex_replace(username, pattern, "");
+
+    return username;
+}
+
+/**
+ * @brief Разбирает ответ API на запрос пользователя и выводит информацию о нем в консоль.
+ *
+ * @param username Имя пользователя, по которому выполнялся запрос.
+ * @param response Тело ответа API.
+ */
+void show_user_response(const string& username, const string& response) {
+    // Проверяем на пустой ответ или внутреннюю серверную ошибку
+    if (response.empty()) {
+        cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] "
+            << "Пользователь с именем '" << username << "' не найден." << endl;
+        return;
+    }
+
+    // Разбираем JSON ответ
+    try {
+        vector<User> users;
+        string errorMessage;
+        {
+            ParseTimer timer("/users/:name");
+            decode_records(response, users, errorMessage);
+        }
+
+        // Проверяем на наличие ошибок
+        if (!errorMessage.empty() || users.empty()) {
+            cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] "
+                << "Ошибка при получении информации о пользователе: " << errorMessage << endl;
+            return;
+        }
+
+        User& user = users.front();
+        user.username = username;
+
+        // Выводим информацию о пользователе
+        cout << "[" << COLOR_MAGENTA << "+" << COLOR_RESET << "] "
+            << "Информация о пользователе '" << username << "':" << endl;
+        cout << "ID: " << user.id << endl;
+        cout << "Имя пользователя: " << user.username << endl;
+        cout << "Отображаемое имя: " << user.globalName << endl;
+        cout << "Верифицирован: " << (user.verified ? "Да" : "Нет") << endl;
+        cout << "Аватар: " << avatar_url(user.avatar) << endl;
+        cout << "Дата создания: " << user.createdAt << endl;
+        cout << "Дата обновления: " << user.updatedAt << '\n' << endl;
+    }
+    catch (const json::exception& e) {
+        cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] "
+            << "Ошибка при обработке данных пользователя: " << e.what() << endl;
+    }
+}
+
+/**
+ * @brief Запрашивает у пользователя одно или несколько имен пользователей и выводит информацию о них.
+ *
+ * Функция запрашивает у пользователя имена пользователей (через пробел или запятую) с помощью стандартного ввода. Затем производит очистку каждого имени от всех символов, кроме букв (верхнего и нижнего регистра), цифр, символов '-' и '_'.
+ * Одно имя запрашивается обычным GET-запросом, несколько имен — пакетом через BatchClient, одновременно
+ * не более "batch_concurrency" запросов; результаты выводятся по мере получения.
+ */
+void get_user_by_username() {
+    // Очищаем консоль
+    clear_console();
+
+    string line;
+
+    // Спрашиваем имена пользователей
+    cout << "[" << COLOR_MAGENTA << "?" << COLOR_RESET << "] " << "Введите имя пользователя (несколько — через пробел): ";
+    cin >> ws;
+    getline(cin, line);
+
+    replace(line.begin(), line.end(), ',', ' ');
+
+    vector<string> usernames;
+    stringstream names(line);
+    string username;
+    while (names >> username) {
+        // Очищаем имя пользователя от недопустимых символов
+        string sanitized_username = sanitize_username(username);
+
+        // Проверяем, осталось ли что-то от имени пользователя после очистки
+        if (sanitized_username.empty()) {
+            cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] "
+                << "Имя пользователя содержит недопустимые символы. Разрешены только буквы, цифры, '-', '_'" << endl;
+            return;
+        }
+        usernames.push_back(sanitized_username);
+    }
+
+    if (usernames.empty()) {
+        return;
+    }
+
+    clear_console();
+
+    if (usernames.size() == 1) {
+        string response = http_get_request(user_request(usernames[0]).url);
+        show_user_response(usernames[0], response);
+    }
+    else {
+        BatchClient batch(config.value("batch_concurrency", 8));
+        for (const auto& name : usernames) {
+            batch.submit(user_request(name));
+        }
+
+        batch.run([&usernames](BatchResult& result) {
+            show_user_response(usernames[result.index], result.response->body);
+        });
+    }
+
+    string answer;
+    cout << "[" << COLOR_MAGENTA << "?" << COLOR_RESET << "] " << "Хотите продолжить? (y/n): ";
+    cin >> answer;
+
+    if (answer == "y" || answer == "Y") {
+        get_user_by_username();
+    }
+    else {
+        exit(0);
+    }
+}
+
+
+/**
+* @brief Функция для вывода в консоль "Об программе"
+*/
+void about() {
+    clear_console();
+
+    cout << "[" << COLOR_MAGENTA << "?" << COLOR_RESET << "] " << "Что делает программа?" << '\n' << endl;
+    cout << "[" << COLOR_MAGENTA << "#" << COLOR_RESET << "] " << "Да х.. его знает, эта программа была написана ради прикола ну и для финального проекта. Этот софт я старался писать так чтобы Денис не говорил где комментарии и че за говно код, мне даже пришлось учить libcurl для подачи HTTP запросов на мой REST-API сервер сайта. Надеюсь Денис это тебе понравиться." << '\n' << endl;
+
+    cout << "[" << COLOR_MAGENTA << "?" << COLOR_RESET << "] " << "Что использовалось?" << '\n' << endl;
+    cout << "[" << COLOR_MAGENTA << "#" << COLOR_RESET << "] " << "ChatGPT вообще не использовал, в ютубе прилшось смотреть как сделать хорошее меню, попадались именно видео по созданию консольных меню для читов CS:GO))) Денис не осуждай, это все не я я не контрибьютю читы на геншин :D https://korepi.com. А так использовались такие библиотеки как: fstream - работа с файловой системой; clocale - для установи языка (я прочитал что locale это для Си а не для С++); Windows.h - для использования Windows API; nlohman/json - для работы с JSON форматом; curl - для подачи HTTP запросов на REST-API сервер." << '\n' << endl;
+
+    cout << "[" << COLOR_MAGENTA << "?" << COLOR_RESET << "] " << "Где смотреть аниме?" << '\n' << endl;
+    cout << "[" << COLOR_MAGENTA << "#" << COLOR_RESET << "] " << "Вот: https://animi.club (скоро обнова, Миша когда на бек ко мне?)" << '\n' << endl;
+
+    
+    cout << "app_name: " << config["app_name"] << endl;
+    cout << "app_version: " << config["app_version"] << endl;
+    cout << "[" << COLOR_MAGENTA << "#" << COLOR_RESET << "] " << "Отладочная информация" << '\n' << endl;cout << "debug: " << config["debug"] << endl;
+    cout << "developer: " << "https://github.com/" + config["developer"].get<string>() << endl;
+}
+
+void secret() {
+    // Вывод без ввода сам на экран не попадает, поэтому кадр выводится перед каждой паузой
+    cout << "Ну что сказать... я ничего лучше не придумал как рубануть питание монитора :D" << endl;
+    screen_renderer().present();
+    Sleep(3000);
+    cout << "Выключаем через 3.." << endl;
+    screen_renderer().present();
+    Sleep(1000);
+    cout << "Выключаем через 2.." << endl;
+    screen_renderer().present();
+    Sleep(1000);
+    cout << "Выключаем через 1.." << endl;
+    screen_renderer().present();
+    Sleep(1500);
+    SendMessage(HWND_BROADCAST,WM_SYSCOMMAND,SC_MONITORPOWER, (LPARAM)2);
+}
+
+/**
+ * @brief Одна операция пакетного режима (строка входного NDJSON-файла).
+ */
+struct BatchOperation {
+    size_t line = 0;
+    json id;
+    string op;
+    string argument;
+};
+
+/**
+ * @brief Разбирает строку входного файла в операцию.
+ *
+ * Поддерживаются {"op": "random"}, {"op": "search", "query": "..."} и {"op": "user", "username": "..."};
+ * вместо "op" можно указать "type". Необязательное поле "id" возвращается в результате как есть.
+ *
+ * @return true, если операция распознана; иначе error содержит причину.
+ */
+bool parse_operation(const json& input, BatchOperation& operation, string& error) {
+    if (!input.is_object()) {
+        error = "ожидался JSON-объект";
+        return false;
+    }
+
+    operation.id = input.value("id", json());
+    operation.op = input.value("op", input.value("type", string()));
+
+    if (operation.op == "random") {
+        return true;
+    }
+    if (operation.op == "search") {
+        operation.argument = input.value("query", string());
+        return true;
+    }
+    if (operation.op == "user") {
+        operation.argument = sanitize_username(input.value("username", string()));
+        if (operation.argument.empty()) {
+            error = "пустое или недопустимое имя пользователя";
+            return false;
+        }
+        return true;
+    }
+
+    error = "неизвестная операция '" + operation.op + "'";
+    return false;
+}
+
+/**
+ * @brief HTTP-запрос для операции.
+ */
+HttpRequest operation_request(const BatchOperation& operation) {
+    if (operation.op == "search") {
+        return search_anime_request(operation.argument);
+    }
+    if (operation.op == "user") {
+        return user_request(operation.argument);
+    }
+    return random_anime_request();
+}
+
+/**
+ * @brief Можно ли выполнить операцию без сети (автономный режим и локальный каталог).
+ */
+bool operation_is_local(const BatchOperation& operation) {
+    return offline_mode() && (operation.op == "random" || operation.op == "search");
+}
+
+/**
+ * @brief Формирует заготовку результата операции (номер строки, id и тип операции).
+ */
+json operation_header(const BatchOperation& operation) {
+    json result;
+    result["line"] = operation.line;
+    if (!operation.id.is_null()) {
+        result["id"] = operation.id;
+    }
+    result["op"] = operation.op;
+    return result;
+}
+
+/**
+ * @brief Выполняет операцию по локальному каталогу.
+ */
+json local_operation_result(const BatchOperation& operation) {
+    json result = operation_header(operation);
+    if (operation.op == "random") {
+        if (local_catalog().size() > 0) {
+            result["result"] = local_catalog().random();
+        }
+        else {
+            result["error"] = "каталог пуст";
+        }
+    }
+    else {
+        result["result"] = search_catalog(operation.argument, config.value("search_top_k", 5));
+    }
+    return result;
+}
+
+/**
+ * @brief Разбирает ответ API на операцию: статус и "result" или "error", без полей заголовка операции.
+ */
+json operation_payload(const BatchOperation& operation, const HttpResponse& response) {
+    json result = json::object();
+    result["status"] = response.status;
+
+    if (response.code != CURLE_OK) {
+        result["error"] = curl_easy_strerror(response.code);
+        return result;
+    }
+
+    try {
+        ParseTimer timer(endpoint_of(operation_request(operation).url));
+
+        string errorMessage;
+        if (operation.op == "user") {
+            vector<User> users;
+            decode_records(response.body, users, errorMessage);
+            if (errorMessage.empty() && !users.empty()) {
+                users.front().username = operation.argument;
+                result["result"] = users.front();
+            }
+        }
+        else {
+            vector<Anime> records;
+            string type = decode_records(response.body, records, errorMessage);
+            if (errorMessage.empty() && operation.op == "random" && !records.empty()) {
+                result["result"] = records.front();
+            }
+            else if (errorMessage.empty() && operation.op == "search") {
+                result["result"] = records;
+            }
+        }
+
+        if (!errorMessage.empty()) {
+            result["error"] = errorMessage;
+        }
+        else if (!result.contains("result")) {
+            result["error"] = "пустой ответ сервера";
+        }
+    }
+    catch (const json::exception& e) {
+        result["error"] = e.what();
+    }
+    return result;
+}
+
+/**
+ * @brief Разбирает ответ API на операцию в результат для вывода.
+ */
+json operation_result(const BatchOperation& operation, const HttpResponse& response) {
+    json result = operation_header(operation);
+    result.update(operation_payload(operation, response));
+    return result;
+}
+
+/**
+ * @brief Значение перцентиля p (0..1) в отсортированном массиве.
+ */
+double percentile(const vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+/**
+ * @brief Разбирает неотрицательное целое из аргумента командной строки.
+ *
+ * @return false, если строка не является числом целиком или число слишком велико.
+ */
+bool parse_count(const string& text, size_t& value) {
+    const char* end = text.data() + text.size();
+    from_chars_result result = from_chars(text.data(), end, value);
+    return result.ec == errc() && result.ptr == end;
+}
+
+/**
+ * @brief --batch <файл> [--ordered] [--concurrency N]: неинтерактивная обработка NDJSON-файла операций.
+ *
+ * Операции выполняются одновременно через BatchClient (не больше N в работе), результаты
+ * выводятся в stdout по одному JSON-объекту на строку — по мере готовности или, с --ordered,
+ * в порядке входного файла. В конце в stderr выводится пропускная способность и перцентили задержки.
+ */
+int run_batch(const vector<string>& args) {
+    string path;
+    bool ordered = false;
+    size_t concurrency = config.value("batch_concurrency", 8);
+
+    for (size_t i = 0; i < args.size(); i++) {
+        if (args[i] == "--ordered") {
+            ordered = true;
+        }
+        else if (args[i] == "--concurrency" && i + 1 < args.size()) {
+            if (!parse_count(args[++i], concurrency) || concurrency == 0) {
+                path.clear();
+                break;
+            }
+        }
+        else {
+            path = args[i];
+        }
+    }
+
+    ifstream input(path);
+    if (path.empty() || !input.good()) {
+        cerr << "Использование: --batch <requests.jsonl> [--ordered] [--concurrency N]" << endl;
+        return 1;
+    }
+
+    map<size_t, string> waiting;
+    size_t nextLine = 1;
+    size_t total = 0;
+    size_t failed = 0;
+    vector<double> latencies;
+
+    auto emit = [&](size_t line, const json& result) {
+        total++;
+        if (result.contains("error")) {
+            failed++;
+        }
+
+        string text = result.dump(-1, ' ', false, json::error_handler_t::replace);
+        if (!ordered) {
+            cout << text << '\n';
+            return;
+        }
+
+        waiting[line] = move(text);
+        while (!waiting.empty() && waiting.begin()->first == nextLine) {
+            cout << waiting.begin()->second << '\n';
+            waiting.erase(waiting.begin());
+            nextLine++;
+        }
+    };
+
+    auto start = chrono::steady_clock::now();
+
+    BatchClient batch(concurrency);
+    vector<BatchOperation> operations;
+    string text;
+    for (size_t line = 1; getline(input, text); line++) {
+        BatchOperation operation;
+        operation.line = line;
+
+        string error;
+        json parsed = json::parse(text, nullptr, false);
+        if (text.find_first_not_of(" \t\r") == string::npos) {
+            error = "пустая строка";
+        }
+        else if (parsed.is_discarded()) {
+            error = "некорректный JSON";
+        }
+
+        if (!error.empty() || !parse_operation(parsed, operation, error)) {
+            json result = operation_header(operation);
+            result["error"] = error;
+            emit(line, result);
+            continue;
+        }
+
+        if (operation_is_local(operation)) {
+            emit(line, local_operation_result(operation));
+            latencies.push_back(0);
+            continue;
+        }
+
+        batch.submit(operation_request(operation));
+        operations.push_back(move(operation));
+    }
+
+    // Объединенные одинаковые операции получают один ответ: он разбирается один раз на всех
+    map<const HttpResponse*, pair<shared_ptr<const json>, size_t>> sharedPayloads;
+
+    batch.run([&](BatchResult& result) {
+        const BatchOperation& operation = operations[result.index];
+
+        shared_ptr<const json> payload;
+        if (result.shares > 1) {
+            auto& shared = sharedPayloads[result.response.get()];
+            if (!shared.first) {
+                shared = { make_shared<const json>(operation_payload(operation, *result.response)), result.shares };
+            }
+            payload = shared.first;
+            if (--shared.second == 0) {
+                sharedPayloads.erase(result.response.get());
+            }
+        }
+        else {
+            payload = make_shared<const json>(operation_payload(operation, *result.response));
+        }
+
+        json output = operation_header(operation);
+        output.update(*payload);
+        output["latency_ms"] = result.seconds * 1000;
+        latencies.push_back(result.seconds * 1000);
+        emit(operation.line, output);
+    });
+    cout << flush;
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    sort(latencies.begin(), latencies.end());
+
+    cerr << fixed << setprecision(2)
+        << "Операций: " << total << ", ошибок: " << failed << ", время: " << seconds << " с, "
+        << (seconds > 0 ? total / seconds : 0) << " оп/с" << endl
+        << "Задержка, мс: p50 " << percentile(latencies, 0.50) << ", p90 " << percentile(latencies, 0.90)
+        << ", p99 " << percentile(latencies, 0.99) << ", max " << (latencies.empty() ? 0 : latencies.back()) << endl;
+    return failed == 0 ? 0 : 2;
+}
+
+/**
+ * @brief --loadgen [--requests N] [--concurrency N] [--mix random=1,search=1,user=1] [--cache] [--coalesce]:
+ * нагрузочный прогон клиента против API (обычно против AniMi-MockServer).
+ *
+ * Запросы строятся и разбираются теми же функциями, что и в пакетном режиме, и выполняются
+ * через BatchClient. Дисковый кэш и объединение одинаковых запросов по умолчанию отключаются,
+ * чтобы каждый запрос шел в сеть.
+ * Выводит пропускную способность и перцентили p50/p99/p999 полной задержки (передача и разбор).
+ */
+int run_loadgen(const vector<string>& args) {
+    size_t requests = 1000;
+    size_t concurrency = config.value("batch_concurrency", 8);
+    bool useCache = false;
+    bool coalesce = false;
+    vector<pair<string, int>> mix = { { "random", 1 }, { "search", 1 }, { "user", 1 } };
+
+    for (size_t i = 0; i < args.size(); i++) {
+        bool valid = true;
+        if (args[i] == "--requests" && i + 1 < args.size()) {
+            valid = parse_count(args[++i], requests);
+        }
+        else if (args[i] == "--concurrency" && i + 1 < args.size()) {
+            valid = parse_count(args[++i], concurrency) && concurrency > 0;
+        }
+        else if (args[i] == "--mix" && i + 1 < args.size()) {
+            mix.clear();
+            stringstream list(args[++i]);
+            string item;
+            while (valid && getline(list, item, ',')) {
+                size_t equals = item.find('=');
+                size_t weight = 1;
+                valid = equals == string::npos || (parse_count(item.substr(equals + 1), weight) && weight <= 1000000);
+                mix.emplace_back(item.substr(0, equals), (int)weight);
+            }
+        }
+        else if (args[i] == "--cache") {
+            useCache = true;
+        }
+        else if (args[i] == "--coalesce") {
+            coalesce = true;
+        }
+        else {
+            valid = false;
+        }
+
+        if (!valid) {
+            cerr << "Использование: --loadgen [--requests N] [--concurrency N] [--mix random=1,search=1,user=1] [--cache] [--coalesce]" << endl;
+            return 1;
+        }
+    }
+
+    logger().set_level(LogLevel::Warning);
+    response_cache().set_enabled(useCache);
+
+    const char* queries[] = { "naruto", "bleach", "one piece", "frieren", "monster", "haikyuu" };
+    const char* usernames[] = { "riktikdev", "alice", "bob", "carol", "dave" };
+
+    int totalWeight = 0;
+    for (const auto& item : mix) {
+        totalWeight += item.second;
+    }
+    if (totalWeight <= 0) {
+        cerr << "Пустая смесь операций" << endl;
+        return 1;
+    }
+
+    // Фиксированное зерно, чтобы прогоны были воспроизводимыми
+    mt19937 random(42);
+    vector<BatchOperation> operations;
+    BatchClient batch(concurrency);
+    batch.set_coalescing(coalesce);
+    for (size_t i = 0; i < requests; i++) {
+        int pick = uniform_int_distribution<int>(0, totalWeight - 1)(random);
+        BatchOperation operation;
+        operation.line = i + 1;
+        for (const auto& item : mix) {
+            if (pick < item.second) {
+                operation.op = item.first;
+                break;
+            }
+            pick -= item.second;
+        }
+
+        if (operation.op == "search") {
+            operation.argument = queries[random() % size(queries)];
+        }
+        else if (operation.op == "user") {
+            operation.argument = usernames[random() % size(usernames)];
+        }
+        else if (operation.op != "random") {
+            cerr << "Неизвестная операция '" << operation.op << "'" << endl;
+            return 1;
+        }
+
+        batch.submit(operation_request(operation));
+        operations.push_back(move(operation));
+    }
+
+    LatencyHistogram latency;
+    size_t failed = 0;
+    uint64_t bytes = 0;
+    auto start = chrono::steady_clock::now();
+
+    batch.run([&](BatchResult& result) {
+        auto parseStarted = chrono::steady_clock::now();
+        json output = operation_result(operations[result.index], *result.response);
+        double parseSeconds = chrono::duration<double>(chrono::steady_clock::now() - parseStarted).count();
+
+        latency.record((uint64_t)((result.seconds + parseSeconds) * 1e6));
+        bytes += result.response->body.size();
+        if (output.contains("error")) {
+            failed++;
+        }
+    });
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << fixed << setprecision(2)
+        << "Запросов: " << requests << ", ошибок: " << failed << ", одновременно: " << concurrency
+        << ", получено " << bytes << " Б" << endl
+        << "Время: " << seconds << " с, " << (seconds > 0 ? requests / seconds : 0) << " запр/с" << endl
+        << "Задержка, мс: p50 " << latency.percentile(0.50) / 1000.0 << ", p99 " << latency.percentile(0.99) / 1000.0
+        << ", p999 " << latency.percentile(0.999) / 1000.0 << ", max " << latency.max_value() / 1000.0 << endl
+        << "Соединений открыто: " << http_client().connections_opened()
+        << ", переиспользовано: " << http_client().connections_reused()
+        << ", объединено запросов: " << batch.collapsed_count() << endl;
+    return failed == 0 ? 0 : 2;
+}
+
+/**
+ * @brief Адреса аватаров пользователей: профили запрашиваются пакетом через BatchClient.
+ *
+ * @param errors Для каждого имени — причина, по которой адреса нет (пусто, если адрес найден).
+ * @return Адреса в порядке имен; для пользователя без аватара или с ошибкой строка пуста.
+ */
+vector<string> avatar_urls(const vector<string>& usernames, vector<string>& errors) {
+    vector<string> urls(usernames.size());
+    errors.assign(usernames.size(), string());
+
+    BatchClient batch(config.value("batch_concurrency", 8));
+    for (const auto& name : usernames) {
+        batch.submit(user_request(name));
+    }
+    batch.run([&](BatchResult& result) {
+        const HttpResponse& response = *result.response;
+        string& error = errors[result.index];
+        if (response.code != CURLE_OK || response.status != 200) {
+            error = response.code != CURLE_OK ? curl_easy_strerror(response.code) : "HTTP " + to_string(response.status);
+            return;
+        }
+
+        vector<User> users;
+        try {
+            decode_records(response.body, users, error);
+        }
+        catch (const json::exception& e) {
+            error = e.what();
+        }
+        if (error.empty() && users.empty()) {
+            error = "пользователь не найден";
+        }
+        else if (error.empty() && users.front().avatar.empty()) {
+            error = "у пользователя нет аватара";
+        }
+        else if (error.empty()) {
+            urls[result.index] = avatar_url(users.front().avatar);
+        }
+    });
+    return urls;
+}
+
+/**
+ * @brief Описание аватара из хранилища для вывода в JSON.
+ */
+json avatar_json(const AvatarStore::Result& avatar) {
+    json result = json::object();
+    result["avatar"] = avatar.url;
+    if (!avatar.error.empty()) {
+        result["error"] = avatar.error;
+        return result;
+    }
+    result["status"] = avatar.status;
+    result["sha256"] = avatar.hash;
+    result["size"] = avatar.size;
+    result["path"] = avatar_store().blob_path(avatar.hash);
+    return result;
+}
+
+/**
+ * @brief Загружает аватары пользователей в хранилище и возвращает их описания в порядке имен.
+ */
+vector<json> fetch_avatars(const vector<string>& usernames) {
+    vector<string> errors;
+    vector<string> urls = avatar_urls(usernames, errors);
+
+    // Несколько пользователей с одним адресом аватара загружаются одним запросом
+    vector<string> unique;
+    map<string, size_t> positions;
+    for (const auto& url : urls) {
+        if (!url.empty() && positions.emplace(url, unique.size()).second) {
+            unique.push_back(url);
+        }
+    }
+    vector<AvatarStore::Result> avatars = avatar_store().fetch(unique, config.value("batch_concurrency", 8));
+
+    vector<json> results;
+    for (size_t i = 0; i < usernames.size(); i++) {
+        json result = urls[i].empty() ? json{ { "error", errors[i] } } : avatar_json(avatars[positions[urls[i]]]);
+        result["username"] = usernames[i];
+        results.push_back(move(result));
+    }
+    return results;
+}
+
+/**
+ * @brief --avatars [имя ...]: загружает аватары пользователей в локальное хранилище.
+ *
+ * Имена берутся из аргументов, а без них — из stdin (через пробелы или по строкам). Для каждого
+ * пользователя в stdout выводится JSON-объект с хэшем и путем к файлу, итог — в stderr.
+ *
+ * @return 0, если все аватары получены, 2 — если были ошибки.
+ */
+int run_avatars(const vector<string>& args) {
+    vector<string> usernames;
+    vector<string> words = args;
+    if (words.empty()) {
+        string word;
+        while (cin >> word) {
+            words.push_back(word);
+        }
+    }
+    for (const auto& word : words) {
+        string username = sanitize_username(word);
+        if (!username.empty()) {
+            usernames.push_back(username);
+        }
+    }
+
+    auto start = chrono::steady_clock::now();
+    vector<json> results = fetch_avatars(usernames);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    bool failed = false;
+    for (const auto& result : results) {
+        cout << result.dump(-1, ' ', false, json::error_handler_t::replace) << '\n';
+        failed = failed || result.contains("error");
+    }
+    cout << flush;
+
+    cerr << "Пользователей: " << usernames.size() << ", время: " << seconds << " с" << endl
+        << "Аватары: " << avatar_store().stats() << endl;
+    return failed ? 2 : 0;
+}
+
+#ifdef _WIN32
+typedef SOCKET socket_t;
+#else
+typedef int socket_t;
+const socket_t INVALID_SOCKET = -1;
+#endif
+
+void close_socket(socket_t socket) {
+#ifdef _WIN32
+    closesocket(socket);
+#else
+    ::close(socket);
+#endif
+}
+
+/**
+ * @brief Инициализирует сокеты (WSAStartup в Windows; тонкий клиент запускается до curl_global_init).
+ */
+bool socket_startup() {
+#ifdef _WIN32
+    WSADATA wsa;
+    return WSAStartup(MAKEWORD(2, 2), &wsa) == 0;
+#else
+    return true;
+#endif
+}
+
+/**
+ * @brief Ждет данных на сокете не дольше timeoutMs.
+ *
+ * @return Больше нуля — есть данные или соединение закрыто, 0 — таймаут, меньше нуля — ошибка.
+ */
+int wait_readable(socket_t socket, int timeoutMs) {
+    pollfd descriptor = {};
+    descriptor.fd = socket;
+    descriptor.events = POLLIN;
+#ifdef _WIN32
+    return WSAPoll(&descriptor, 1, timeoutMs);
+#else
+    return ::poll(&descriptor, 1, timeoutMs);
+#endif
+}
+
+/**
+ * @brief Адрес Unix-сокета демона.
+ *
+ * @return false, если путь не помещается в sockaddr_un.
+ */
+bool daemon_address(const string& path, sockaddr_un& address) {
+    address = {};
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+bool send_all(socket_t socket, const char* data, size_t size) {
+    // Клиент, закрывший соединение раньше ответа, не должен завершать сервер сигналом SIGPIPE
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+    while (size > 0) {
+        int sent = (int)send(socket, data, (int)min(size, (size_t)1 << 30), flags);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+/**
+ * @brief Принимает ровно size байт.
+ *
+ * @param deadline Если задан, ожидание данных после него прекращается и возвращается false.
+ */
+bool receive_all(socket_t socket, char* data, size_t size, optional<chrono::steady_clock::time_point> deadline = nullopt) {
+    while (size > 0) {
+        if (deadline) {
+            auto left = chrono::duration_cast<chrono::milliseconds>(*deadline - chrono::steady_clock::now()).count();
+            if (left <= 0 || wait_readable(socket, (int)left) <= 0) {
+                return false;
+            }
+        }
+        int received = (int)recv(socket, data, (int)min(size, (size_t)1 << 30), 0);
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        size -= received;
+    }
+    return true;
+}
+
+// Наибольший размер кадра протокола демона: длиннее запросы не бывают, а ответы поиска укладываются с запасом
+const uint32_t daemonMaxFrame = 16 * 1024 * 1024;
+
+/**
+ * @brief Отправляет кадр протокола демона: длина (uint32, little-endian) и JSON.
+ */
+bool write_frame(socket_t socket, const string& payload) {
+    string frame;
+    frame.reserve(4 + payload.size());
+    put_u32(frame, (uint32_t)payload.size());
+    frame += payload;
+    return send_all(socket, frame.data(), frame.size());
+}
+
+/**
+ * @brief Читает кадр протокола демона.
+ *
+ * @param timeoutMs Сколько ждать кадр целиком; меньше нуля — без ограничения.
+ * @return false, если соединение закрыто, кадр больше daemonMaxFrame или не пришел за timeoutMs.
+ */
+bool read_frame(socket_t socket, string& payload, int timeoutMs = -1) {
+    optional<chrono::steady_clock::time_point> deadline;
+    if (timeoutMs >= 0) {
+        deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+    }
+
+    char header[4];
+    if (!receive_all(socket, header, sizeof(header), deadline)) {
+        return false;
+    }
+    TrafficReader reader{ header, sizeof(header) };
+    uint32_t length = reader.u32();
+    if (length > daemonMaxFrame) {
+        return false;
+    }
+    payload.resize(length);
+    return length == 0 || receive_all(socket, &payload[0], length, deadline);
+}
+
+/**
+ * @brief Ограничивает время одного вызова send на сокете: клиент, который не читает ответ,
+ * не держит отправляющий поток дольше timeoutMs.
+ */
+void set_send_timeout(socket_t socket, int timeoutMs) {
+#ifdef _WIN32
+    DWORD timeout = (DWORD)timeoutMs;
+#else
+    timeval timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000 };
+#endif
+    setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
+}
+
+/**
+ * @brief Отправляет файл кадром протокола демона, не копируя его в память процесса.
+ *
+ * В Linux данные идут из кэша страниц прямо в сокет через sendfile, в остальных системах —
+ * send из отображения файла в память (MapViewOfFile в Windows).
+ */
+bool send_file(socket_t socket, const string& path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    size_t length = (size_t)fileSize.QuadPart;
+
+    HANDLE mapping = length ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    CloseHandle(file);
+    const char* data = mapping ? (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    if (length && !data) {
+        return false;
+    }
+#else
+    int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        return false;
+    }
+
+    struct stat info;
+    fstat(file, &info);
+    size_t length = (size_t)info.st_size;
+#endif
+
+    string header;
+    put_u32(header, (uint32_t)length);
+    bool sent = length <= daemonMaxFrame && send_all(socket, header.data(), header.size());
+
+#if defined(_WIN32)
+    sent = sent && send_all(socket, data, length);
+    if (data) {
+        UnmapViewOfFile(data);
+    }
+#elif defined(__linux__)
+    off_t offset = 0;
+    while (sent && (size_t)offset < length) {
+        sent = sendfile(socket, file, &offset, length - (size_t)offset) > 0;
+    }
+    ::close(file);
+#else
+    void* view = length ? mmap(NULL, length, PROT_READ, MAP_PRIVATE, file, 0) : nullptr;
+    ::close(file);
+    sent = sent && view != MAP_FAILED && send_all(socket, (const char*)view, length);
+    if (view && view != MAP_FAILED) {
+        munmap(view, length);
+    }
+#endif
+    return sent;
+}
+
+/**
+ * @brief Резидентный сервер: выполняет операции пакетного режима для клиентов Unix-сокета.
+ *
+ * Живет столько же, сколько процесс, поэтому конфигурация, HTTP-клиент с прогретыми соединениями,
+ * кэш ответов, очередь случайных аниме и локальный каталог создаются один раз на все запросы.
+ * Соединения ждут запросов в одном цикле poll; соединение с пришедшим запросом ставится в очередь
+ * пулу из "daemon_workers" потоков, а после ответа возвращается в цикл, так что молчащие клиенты
+ * не занимают потоки. Кадр должен прийти целиком за timeoutMs ("daemon_io_timeout_ms"), а каждый
+ * send — завершиться за то же время, иначе соединение закрывается: клиент, оборвавший кадр
+ * на середине или переставший читать ответы, занимает поток не дольше этого времени.
+ * Операция {"op": "shutdown"} останавливает сервер.
+ */
+class DaemonServer {
+public:
+    DaemonServer(const string& path, size_t workers, int timeoutMs)
+        : path(path), workerCount(workers > 0 ? workers : 1), timeoutMs(max(timeoutMs, 1)) {
+    }
+
+    /**
+     * @brief Принимает соединения до операции shutdown.
+     *
+     * @return Код завершения программы.
+     */
+    int run() {
+        sockaddr_un address;
+        if (!daemon_address(path, address)) {
+            cerr << "Недопустимый путь сокета: " << path << endl;
+            return 1;
+        }
+        if (!release_stale_socket(address)) {
+            return 1;
+        }
+
+#ifndef _WIN32
+        // sendfile не принимает MSG_NOSIGNAL: закрытый клиентом сокет не должен завершать сервер
+        signal(SIGPIPE, SIG_IGN);
+#endif
+
+        listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener == INVALID_SOCKET) {
+            cerr << "Не удалось создать сокет" << endl;
+            return 1;
+        }
+        if (::bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 64) != 0) {
+            cerr << "Не удалось занять сокет " << path << endl;
+            close_socket(listener);
+            return 1;
+        }
+
+        // Пара соединенных сокетов, через которую обработчики будят цикл ожидания, когда
+        // возвращают соединение (pipe не подходит: WSAPoll в Windows ждет только сокеты)
+        wakeWriter = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (wakeWriter == INVALID_SOCKET || ::connect(wakeWriter, (sockaddr*)&address, sizeof(address)) != 0
+            || (wakeReader = accept(listener, nullptr, nullptr)) == INVALID_SOCKET) {
+            cerr << "Не удалось создать сокет пробуждения" << endl;
+            close_socket(listener);
+            return 1;
+        }
+
+        for (size_t i = 0; i < workerCount; i++) {
+            workers.emplace_back(&DaemonServer::work, this);
+        }
+        LOG_INFO("Сервер слушает " + path + ", обработчиков: " + to_string(workerCount));
+
+        // Простаивающие соединения ждут здесь, а не в обработчиках: поток занимается соединением,
+        // только когда по нему пришли данные, и держит его не дольше timeoutMs на кадр
+        vector<Connection> idle;
+        vector<pollfd> descriptors;
+        while (!stopping) {
+            descriptors.assign(2 + idle.size(), pollfd{});
+            descriptors[0].fd = listener;
+            descriptors[1].fd = wakeReader;
+            for (size_t i = 0; i < idle.size(); i++) {
+                descriptors[2 + i].fd = idle[i].socket;
+            }
+            for (auto& descriptor : descriptors) {
+                descriptor.events = POLLIN;
+            }
+
+            // Таймаут страхует на случай, если пробуждение потерялось
+#ifdef _WIN32
+            int ready = WSAPoll(descriptors.data(), (ULONG)descriptors.size(), 200);
+#else
+            int ready = ::poll(descriptors.data(), descriptors.size(), 200);
+#endif
+            if (ready < 0 || stopping) {
+                continue;
+            }
+
+            // Соединения, прочитанные до конца, попадают в очередь на обработку
+            vector<Connection> waiting;
+            {
+                lock_guard<mutex> lock(queueMutex);
+                for (size_t i = 0; i < idle.size(); i++) {
+                    if (descriptors[2 + i].revents != 0) {
+                        pending.push_back(idle[i]);
+                        queueReady.notify_one();
+                    }
+                    else {
+                        waiting.push_back(idle[i]);
+                    }
+                }
+            }
+            idle.swap(waiting);
+
+            if (descriptors[1].revents != 0) {
+                char buffer[64];
+                recv(wakeReader, buffer, sizeof(buffer), 0);
+            }
+            {
+                lock_guard<mutex> lock(queueMutex);
+                idle.insert(idle.end(), returned.begin(), returned.end());
+                returned.clear();
+            }
+
+            if (descriptors[0].revents != 0) {
+                socket_t client = accept(listener, nullptr, nullptr);
+                if (client != INVALID_SOCKET) {
+                    connections++;
+                    set_send_timeout(client, timeoutMs);
+                    idle.push_back({ client, 0 });
+                }
+            }
+        }
+
+        {
+            lock_guard<mutex> lock(queueMutex);
+            queueReady.notify_all();
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        idle.insert(idle.end(), pending.begin(), pending.end());
+        idle.insert(idle.end(), returned.begin(), returned.end());
+        for (const Connection& connection : idle) {
+            close_socket(connection.socket);
+        }
+        close_socket(wakeWriter);
+        close_socket(wakeReader);
+        close_socket(listener);
+        error_code error;
+        filesystem::remove(path, error);
+
+        LOG_INFO("Сервер остановлен: соединений " + to_string(connections.load()) + ", запросов " + to_string(requests.load()));
+        return 0;
+    }
+
+private:
+    string path;
+    size_t workerCount;
+    int timeoutMs;
+    socket_t listener = INVALID_SOCKET;
+    socket_t wakeReader = INVALID_SOCKET;
+    socket_t wakeWriter = INVALID_SOCKET;
+    atomic<bool> stopping{ false };
+    atomic<size_t> connections{ 0 };
+    atomic<size_t> requests{ 0 };
+
+    vector<thread> workers;
+    mutex queueMutex;
+    condition_variable queueReady;
+    /**
+     * @brief Соединение клиента и число выполненных по нему запросов (номер "line" в ответах).
+     */
+    struct Connection {
+        socket_t socket;
+        size_t served;
+    };
+
+    // Соединения с пришедшим запросом и соединения, которые обработчики вернули циклу ожидания
+    deque<Connection> pending;
+    vector<Connection> returned;
+
+    /**
+     * @brief Освобождает путь сокета, оставшийся от аварийно завершенного сервера.
+     *
+     * Удаляется только сокет, к которому не удается подключиться. Работающий сервер
+     * и файл другого типа (например, указанный по ошибке config.json) не трогаются.
+     *
+     * @return false, если путь занят.
+     */
+    bool release_stale_socket(const sockaddr_un& address) {
+        error_code error;
+        filesystem::file_status status = filesystem::symlink_status(path, error);
+        if (!filesystem::exists(status)) {
+            return true;
+        }
+
+#ifdef _WIN32
+        // Сокет AF_UNIX в Windows — точка повторной обработки, filesystem не опознает его как сокет
+        bool socketFile = !filesystem::is_regular_file(status) && !filesystem::is_directory(status) && !filesystem::is_symlink(status);
+#else
+        bool socketFile = filesystem::is_socket(status);
+#endif
+        if (!socketFile) {
+            cerr << "Путь " << path << " занят файлом, который не является сокетом" << endl;
+            return false;
+        }
+
+        socket_t probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        bool alive = probe != INVALID_SOCKET && ::connect(probe, (const sockaddr*)&address, sizeof(address)) == 0;
+        if (probe != INVALID_SOCKET) {
+            close_socket(probe);
+        }
+        if (alive) {
+            cerr << "На сокете " << path << " уже работает сервер" << endl;
+            return false;
+        }
+
+        filesystem::remove(path, error);
+        return true;
+    }
+
+    void work() {
+        while (true) {
+            Connection client;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                queueReady.wait(lock, [this]() { return stopping || !pending.empty(); });
+                if (stopping) {
+                    return;
+                }
+                client = pending.front();
+                pending.pop_front();
+            }
+
+            if (!serve(client)) {
+                close_socket(client.socket);
+                continue;
+            }
+
+            lock_guard<mutex> lock(queueMutex);
+            returned.push_back(client);
+            send_all(wakeWriter, "w", 1);
+        }
+    }
+
+    /**
+     * @brief Выполняет запросы, уже пришедшие по соединению, и возвращает его циклу ожидания.
+     *
+     * @return false, если соединение закрыто или оборвалось.
+     */
+    bool serve(Connection& connection) {
+        socket_t client = connection.socket;
+        string frame;
+        do {
+            if (!read_frame(client, frame, timeoutMs)) {
+                return false;
+            }
+            requests++;
+            size_t sequence = ++connection.served;
+
+            json input = json::parse(frame, nullptr, false);
+            if (input.is_object() && input.value("op", string()) == "shutdown") {
+                write_frame(client, json{ { "op", "shutdown" } }.dump());
+                stopping = true;
+                send_all(wakeWriter, "w", 1);
+                return false;
+            }
+            if (input.is_object() && input.value("op", string()) == "avatar") {
+                if (!serve_avatar(client, input, sequence)) {
+                    return false;
+                }
+                continue;
+            }
+            if (!write_frame(client, execute(input, sequence).dump(-1, ' ', false, json::error_handler_t::replace))) {
+                return false;
+            }
+            // Следующий запрос, отправленный клиентом без паузы, выполняется тем же потоком
+        } while (!stopping && wait_readable(client, 0) > 0);
+        return !stopping;
+    }
+
+    /**
+     * @brief Операция {"op": "avatar", "username": "...", "data": true}: загружает аватар в хранилище
+     * и отвечает хэшем и путем к файлу. С "data" следом за ответом идет кадр с содержимым файла;
+     * если файл вытеснен раньше, чем его удалось закрепить, ответ содержит "error" и "data": false.
+     *
+     * @return false, если соединение оборвалось.
+     */
+    static bool serve_avatar(socket_t client, const json& input, size_t sequence) {
+        LogRequestScope scope;
+
+        string username = sanitize_username(input.value("username", string()));
+        json result = username.empty() ? json{ { "error", "недопустимое имя пользователя" } } : fetch_avatars({ username }).front();
+        result["line"] = sequence;
+        result["op"] = "avatar";
+        result["username"] = username;
+
+        bool data = input.value("data", false) && !result.contains("error");
+        string hash = data ? result["sha256"].get<string>() : string();
+        // Файл закрепляется до ответа: иначе параллельная загрузка могла бы вытеснить его
+        // между ответом с "data": true и отправкой кадра с содержимым
+        if (data && !avatar_store().pin(hash)) {
+            result["error"] = "файл вытеснен из хранилища";
+            data = false;
+        }
+        result["data"] = data;
+
+        bool sent = write_frame(client, result.dump(-1, ' ', false, json::error_handler_t::replace))
+            && (!data || send_file(client, result["path"].get<string>()));
+        if (data) {
+            avatar_store().unpin(hash);
+        }
+        return sent;
+    }
+
+    /**
+     * @brief Выполняет одну операцию так же, как пакетный режим, но по одной и с общими кэшами.
+     */
+    static json execute(const json& input, size_t sequence) {
+        LogRequestScope scope;
+
+        BatchOperation operation;
+        operation.line = sequence;
+
+        string error;
+        if (input.is_discarded()) {
+            error = "некорректный JSON";
+        }
+        if (!error.empty() || !parse_operation(input, operation, error)) {
+            json result = operation_header(operation);
+            result["error"] = error;
+            return result;
+        }
+
+        if (operation_is_local(operation)) {
+            return local_operation_result(operation);
+        }
+
+        // Случайное аниме отдается из очереди предзагрузки, которая дозаполняется в фоне
+        Anime anime;
+        if (operation.op == "random" && random_prefetcher().pop(anime)) {
+            json result = operation_header(operation);
+            result["status"] = 200;
+            result["result"] = anime;
+            return result;
+        }
+
+        shared_ptr<const HttpResponse> response = coalesced_perform(operation_request(operation));
+        return operation_result(operation, *response);
+    }
+};
+
+/**
+ * @brief --serve [сокет]: запускает резидентный сервер на Unix-сокете ("daemon_socket").
+ */
+int run_serve(const vector<string>& args) {
+    string path = args.empty() ? config.value("daemon_socket", string("animi.sock")) : args[0];
+
+    // Соединения к API прогреваются сразу, а не при первом запросе клиента
+    if (transport().live() && !offline_mode()) {
+        http_client().start_warmup(api_url(""), avatar_url(""));
+        random_prefetcher().start();
+    }
+
+    cout << "[" << COLOR_MAGENTA << "+" << COLOR_RESET << "] " << "Сервер запущен: " << path << endl;
+    return DaemonServer(path, config.value("daemon_workers", 4), config.value("daemon_io_timeout_ms", 2000)).run();
+}
+
+/**
+ * @brief Соединение клиента с резидентным сервером.
+ */
+class DaemonClient {
+public:
+    DaemonClient() = default;
+    DaemonClient(const DaemonClient&) = delete;
+    DaemonClient& operator=(const DaemonClient&) = delete;
+
+    ~DaemonClient() {
+        disconnect();
+    }
+
+    bool connect(const string& path) {
+        disconnect();
+        sockaddr_un address;
+        if (!daemon_address(path, address)) {
+            return false;
+        }
+        connection = socket(AF_UNIX, SOCK_STREAM, 0);
+        return connection != INVALID_SOCKET && ::connect(connection, (sockaddr*)&address, sizeof(address)) == 0;
+    }
+
+    /**
+     * @brief Отправляет запрос и ждет ответ (не дольше timeoutMs, если он не меньше нуля).
+     *
+     * @return false, если соединение оборвалось или ответ не пришел вовремя.
+     */
+    bool call(const string& request, string& response, int timeoutMs = -1) {
+        return write_frame(connection, request) && read_frame(connection, response, timeoutMs);
+    }
+
+    /**
+     * @brief Отправляет байты как есть, без разбиения на кадры.
+     */
+    bool send_raw(const string& data) {
+        return send_all(connection, data.data(), data.size());
+    }
+
+    /**
+     * @brief Читает следующий кадр без запроса (файл, переданный следом за ответом).
+     */
+    bool receive(string& frame) {
+        return read_frame(connection, frame);
+    }
+
+    void disconnect() {
+        if (connection != INVALID_SOCKET) {
+            close_socket(connection);
+            connection = INVALID_SOCKET;
+        }
+    }
+
+private:
+    socket_t connection = INVALID_SOCKET;
+};
+
+/**
+ * @brief Собирает операцию из аргументов тонкого клиента: random, search <запрос>, user <имя>,
+ * avatar <имя>, shutdown.
+ */
+json client_operation(const vector<string>& words) {
+    json operation;
+    operation["op"] = words[0];
+    if (words[0] == "search" || words[0] == "user" || words[0] == "avatar") {
+        string argument;
+        for (size_t i = 1; i < words.size(); i++) {
+            argument += (i > 1 ? " " : "") + words[i];
+        }
+        operation[words[0] == "search" ? "query" : "username"] = argument;
+    }
+    return operation;
+}
+
+/**
+ * @brief --client [--socket путь] [--out файл] [операция [аргумент]]: тонкий клиент резидентного сервера.
  *
- * Функция отправляет HTTP GET запрос на указанный URL для получения данных случайного аниме.
- * Полученные данные парсятся в формате JSON, а затем извлекаются и выводятся основные характеристики
- * аниме, такие как ID, названия на разных языках, количество эпизодов и другие атрибуты.
+ * Запускается до инициализации журнала, HTTP-клиента и кэшей: вся работа выполняется сервером.
+ * Операция берется из аргументов (random, search <запрос>, user <имя>, avatar <имя>, shutdown),
+ * а без них — из stdin в формате --batch, по одной на строку, через одно соединение. Ответы выводятся
+ * в stdout по одному JSON-объекту на строку. С --out сервер передает сам файл аватара, и он
+ * сохраняется в указанный файл.
  *
- * Если запрос не вернул данных (пустой ответ), функция рекурсивно вызывает сама себя.
- * Если в полученных данных присутствует ошибка (например, отсутствует запрашиваемое поле), выводится сообщение об ошибке.
+ * @return 0, если все операции успешны, 2 — если были ошибки, 1 — если сервер недоступен.
+ */
+int run_client(const vector<string>& args) {
+    string path = config.value("daemon_socket", string("animi.sock"));
+    string output;
+    vector<string> words;
+    for (size_t i = 0; i < args.size(); i++) {
+        if (args[i] == "--socket" && i + 1 < args.size()) {
+            path = args[++i];
+        }
+        else if (args[i] == "--out" && i + 1 < args.size()) {
+            output = args[++i];
+        }
+        else {
+            words.push_back(args[i]);
+        }
+    }
+
+    DaemonClient client;
+    if (!socket_startup() || !client.connect(path)) {
+        cerr << "Сервер не отвечает на " << path << " (запустите --serve)" << endl;
+        return 1;
+    }
+
+    bool failed = false;
+    auto call = [&](const string& request) {
+        string response;
+        if (!client.call(request, response)) {
+            cerr << "Соединение с сервером прервано" << endl;
+            return false;
+        }
+        cout << response << '\n';
+        json parsed = json::parse(response, nullptr, false);
+        failed = failed || !parsed.is_object() || parsed.contains("error");
+
+        // Содержимое аватара приходит отдельным кадром сразу за ответом
+        if (parsed.is_object() && parsed.value("data", false)) {
+            string data;
+            if (!client.receive(data)) {
+                cerr << "Соединение с сервером прервано" << endl;
+                return false;
+            }
+            ofstream file(output, ios::binary | ios::trunc);
+            file.write(data.data(), data.size());
+            failed = failed || !file.good();
+        }
+        return true;
+    };
+
+    if (!words.empty()) {
+        json operation = client_operation(words);
+        if (operation["op"] == "avatar" && !output.empty()) {
+            operation["data"] = true;
+        }
+        if (!call(operation.dump())) {
+            return 1;
+        }
+    }
+    else {
+        string line;
+        while (getline(cin, line)) {
+            if (line.find_first_not_of(" \t\r") != string::npos && !call(line)) {
+                return 1;
+            }
+        }
+    }
+    cout << flush;
+    return failed ? 2 : 0;
+}
+
+/**
+ * @brief Освобождает ресурсы при завершении программы и выводит статистику (в режиме отладки).
  *
- * После вывода информации о случайном аниме функция запрашивает пользователя о желании продолжить.
- * В зависимости от ответа ('y' или 'Y' для продолжения, любой другой ответ для завершения) функция либо
- * рекурсивно вызывает себя для получения нового случайного аниме, либо завершает выполнение программы.
+ * Регистрируется через atexit, поэтому вызывается и при выходе через exit(0) из меню.
  */
-void get_random_anime() {
-    // Очищаем консоль
+void shutdown_app() {
+    // Останавливаем фоновую предзагрузку, перепроверку кэша и прогрев до освобождения HTTP-клиента
+    random_prefetcher().stop();
+    wait_revalidations();
+    http_client().join_warmup();
+
+    if (logger().enabled(LogLevel::Debug)) {
+        LOG_DEBUG("Предзагрузка случайных аниме: попаданий " + to_string(random_prefetcher().hit_count())
+            + ", промахов " + to_string(random_prefetcher().miss_count()));
+        LOG_DEBUG("Кэш ответов: " + response_cache().stats());
+        LOG_DEBUG("HTTP соединений открыто: " + to_string(http_client().connections_opened())
+            + ", переиспользовано: " + to_string(http_client().connections_reused()));
+        if (request_flights().leader_count() > 0) {
+            LOG_DEBUG("Одинаковые одновременные запросы: выполнено " + to_string(request_flights().leader_count())
+                + ", присоединилось к уже идущим " + to_string(request_flights().collapsed_count()));
+        }
+        if (!http_client().warmup_status().empty()) {
+            LOG_DEBUG("Прогрев: " + http_client().warmup_status());
+        }
+        if (!request_metrics().empty()) {
+            LOG_DEBUG("Метрики запросов, мс:\n" + request_metrics().table());
+        }
+    }
+
+    // Пустой "metrics_file" отключает сохранение метрик
+    string metricsFile = config.value("metrics_file", string("metrics"));
+    if (!metricsFile.empty() && !request_metrics().empty()) {
+        request_metrics().write(metricsFile);
+    }
+}
+
+/**
+ * @brief Показывает таблицу метрик запросов и сохраняет их в файлы (пункт меню в режиме отладки).
+ */
+void show_metrics() {
+    clear_console();
+
+    if (request_metrics().empty()) {
+        cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] " << "Запросов к API еще не было" << endl;
+    }
+    else {
+        cout << request_metrics().table() << endl;
+
+        string metricsFile = config.value("metrics_file", string("metrics"));
+        if (!metricsFile.empty() && request_metrics().write(metricsFile)) {
+            cout << "[" << COLOR_MAGENTA << "+" << COLOR_RESET << "] " << "Метрики сохранены в "
+                << metricsFile << ".json и " << metricsFile << ".prom" << endl;
+        }
+    }
+}
+
+void show_menu() {
     clear_console();
 
-    string url = "https://api.animi.club/anime/random";
-    string response = http_get_request(url);
+    cout << "[" << COLOR_MAGENTA << "#" << COLOR_RESET << "] " << "Выберите один из пунктов меню" << '\n' << endl;
+
+    cout << "[" << COLOR_MAGENTA << "1" << COLOR_RESET << "] " << "Случайное аниме" << endl;
+    cout << "[" << COLOR_MAGENTA << "2" << COLOR_RESET << "] " << "Поиск аниме по названию" << endl;
+    cout << "[" << COLOR_MAGENTA << "3" << COLOR_RESET << "] " << "Поиск пользователя по названию" << endl;
+    cout << "[" << COLOR_MAGENTA << "4" << COLOR_RESET << "] " << "Об программе" << endl;
+    if (config["debug"] == true) {
+        cout << "[" << COLOR_MAGENTA << "5" << COLOR_RESET << "] " << "Метрики запросов" << endl;
+    }
+    cout << "[" << COLOR_MAGENTA << "0" << COLOR_RESET << "] " << "Выход" << '\n' << endl;
+
+    while (true) {
+        string input;
+        cout << "[" << COLOR_MAGENTA << "?" << COLOR_RESET << "] " << "> ";
+        cin >> input;
+
+        bool isNumber = true;
+        for (char c : input) {
+            if (!isdigit(c)) {
+                isNumber = false;
+                break;
+            }
+        }
+
+        if (isNumber) {
+            // Преобразуем введенную строку в число
+            int choice = stoi(input);
+
+            switch (choice) {
+            case 1: {
+                get_random_anime();
+                break;
+            }
+            case 2:
+                get_anime_by_query();
+                break;
+            case 3:
+                get_user_by_username();
+                break;
+            case 4:
+                about();
+                break;
+            case 5:
+                if (config["debug"] == true) {
+                    show_metrics();
+                    break;
+                }
+                cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "]" << " "
+                    << "Данного пункта меню не существует" << endl;
+                break;
+            case 0:
+                exit(0);
+            default:
+                cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "]" << " "
+                    << "Данного пункта меню не существует" << endl;
+                break;
+            }
+        }
+        else {
+            string lower = input;
+
+            // Преобразуем строку в нижний регистр
+            for (char& c : lower) {
+                c = tolower(c);
+            }
+
+            if (lower == "secret") {
+                secret();
+            }
+            else {
+                clear_console();
+                show_menu();
+                cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "]" << " "
+                    << "Только цифры разрешены" << endl;
+            }
+        }
+    }  
+}
+
+#ifdef ANIMI_BENCH
+// Бенчмарки собираются только с определенным ANIMI_BENCH и запускаются из командной строки
+
+atomic<uint64_t> benchAllocations{ 0 };
+atomic<uint64_t> benchAllocatedBytes{ 0 };
+
+// Заменяем все формы new/delete, включая массивы и выровненные, чтобы каждое выделение
+// считалось и освобождалось парной функцией.
+//
+// GCC после встраивания operator delete видит free() на указателе из operator new и выдает
+// -Wmismatched-new-delete, хотя оба заменены и парны (malloc/free). Предупреждение ложное
+// и отключается только для этих определений.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size) {
+    benchAllocations++;
+    benchAllocatedBytes += size;
+    if (void* memory = malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+    free(memory);
+}
+
+void* operator new(size_t size, align_val_t alignment) {
+    benchAllocations++;
+    benchAllocatedBytes += size;
+    size_t align = (size_t)alignment;
+#ifdef _WIN32
+    void* memory = _aligned_malloc(size ? size : 1, align);
+#else
+    // aligned_alloc требует размер, кратный выравниванию
+    void* memory = aligned_alloc(align, ((size ? size : 1) + align - 1) / align * align);
+#endif
+    if (memory) {
+        return memory;
+    }
+    throw bad_alloc();
+}
+
+void* operator new[](size_t size, align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void operator delete(void* memory, align_val_t) noexcept {
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    free(memory);
+#endif
+}
+
+void operator delete(void* memory, size_t, align_val_t alignment) noexcept {
+    operator delete(memory, alignment);
+}
+
+void operator delete[](void* memory, align_val_t alignment) noexcept {
+    operator delete(memory, alignment);
+}
+
+void operator delete[](void* memory, size_t, align_val_t alignment) noexcept {
+    operator delete(memory, alignment);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+/**
+ * @brief Числовой аргумент бенчмарка с номером position; если аргумента нет, берется fallback.
+ *
+ * @return false, если аргумент не число (строка usage уже выведена).
+ */
+bool bench_count(const vector<string>& args, size_t position, size_t fallback, size_t& value, const char* usage) {
+    value = fallback;
+    if (args.size() <= position || parse_count(args[position], value)) {
+        return true;
+    }
+    cerr << "Использование: " << usage << endl;
+    return false;
+}
+
+/**
+ * @brief Прежний способ разбора: заполняет Anime из DOM поле за полем (база для сравнения).
+ *
+ * @param data JSON-объект аниме.
+ * @return Заполненная структура Anime.
+ */
+Anime parse_anime_dom(json& data) {
+    // Создаем объект аниме и заполяем его данными
+    Anime anime;
+    anime.id = data["id"];
+    anime.shikimoriId = data["shikimoriId"];
+    anime.myAnimeListId = data["myAnimeListId"];
+
+    // Проверяем и заполняем поля, если они присутствуют в JSON и не являются null
+    if (!data["name"].is_null() && data["name"].is_string()) {
+        anime.name = data["name"];
+    }
+    else {
+        LOG_DEBUG("Значение 'name' пусто или не является строкой");
+        anime.name = "Нет";
+    }
+    if (!data["russian"].is_null() && data["russian"].is_string()) {
+        anime.russian = data["russian"];
+    }
+    else {
+        LOG_DEBUG("Значение 'russian' пусто или не является строкой");
+        anime.russian = "Нет";
+    }
+    if (!data["english"].is_null() && data["english"].is_string()) {
+        anime.english = data["english"];
+    }
+    else {
+        LOG_DEBUG("Значение 'english' пусто или не является строкой");
+        anime.english = "Нет";
+    }
+    if (!data["synonyms"].empty() && data["synonyms"].is_array()) {
+        anime.synonyms = data["synonyms"].get<vector<string>>();
+    }
+    else {
+        LOG_DEBUG("Значение 'synonyms' пусто или не массивом");
+        anime.synonyms = { "Нет" };
+    }
+    if (data["episodes"].is_number()) {
+        anime.episodes = data["episodes"];
+    }
+    else {
+        LOG_DEBUG("Значение 'episodes' не является числом");
+        anime.episodes = 0;
+    }
+    if (data["episodesAired"].is_number()) {
+        anime.episodesAired = data["episodesAired"];
+    }
+    else {
+        LOG_DEBUG("Значение 'episodesAired' не является числом");
+        anime.episodesAired = 0;
+    }
+    if (data["duration"].is_number()) {
+        anime.duration = data["duration"];
+    }
+    else {
+        LOG_DEBUG("Значение 'duration' не является числом");
+        anime.duration = 0;
+    }
+    if (!data["description"].is_null() && data["description"].is_string()) {
+        anime.description = data["description"];
+    }
+    else {
+        LOG_DEBUG("Значение 'description' пусто или не является строкой");
+        anime.description = "Нет";
+    }
+
+    return anime;
+}
+
+/**
+ * @brief Формирует синтетический ответ поиска из count записей аниме.
+ */
+string make_anime_page(size_t count) {
+    json page = json::array();
+    for (size_t i = 0; i < count; i++) {
+        page.push_back({
+            {"id", i}, {"shikimoriId", i + 1}, {"myAnimeListId", i + 2},
+            {"name", "Anime title " + to_string(i)}, {"russian", "Аниме " + to_string(i)},
+            {"english", i % 3 ? json("English title " + to_string(i)) : json(nullptr)},
+            {"episodes", 12}, {"episodesAired", 12}, {"duration", 24},
+            {"description", string(400, 'x')}, {"synonyms", {"Synonym " + to_string(i), "Alt " + to_string(i)}},
+            {"genres", {{{"id", 1}, {"name", "Action"}}}}
+        });
+    }
+    return page.dump();
+}
+
+/**
+ * @brief Замеряет время и количество выделений памяти для функции, выполненной runs раз.
+ */
+void bench_run(const string& name, size_t runs, const function<size_t()>& body) {
+    uint64_t allocations = benchAllocations;
+    uint64_t bytes = benchAllocatedBytes;
+    size_t records = 0;
 
-    if (response.empty()) {
-        get_random_anime();
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < runs; i++) {
+        records += body();
     }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
 
-    try {
-        json data = json::parse(response);
+    cout << "  " << left << setw(14) << name << right
+        << setw(12) << fixed << setprecision(3) << seconds * 1000 / runs << " мс"
+        << setw(12) << (benchAllocations - allocations) / runs << " выделений"
+        << setw(14) << (benchAllocatedBytes - bytes) / runs << " Б"
+        << setw(10) << records / runs << " записей" << endl;
+}
 
-        // Проверяем на наличие ошибок
-        if (data.find("error") != data.end()) {
-            string errorMessage = data["error"];
-            cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] "
-                << "Ошибка при получении информации о пользователе: " << errorMessage << endl;
-            return;
+/**
+ * @brief --bench-decode [файл...]: сравнивает разбор через DOM и SAX-декодер.
+ *
+ * Без аргументов используются синтетические ответы на 5, 500 и 50000 записей,
+ * иначе — записанные ответы из указанных файлов.
+ */
+int bench_decode(const vector<string>& files) {
+    // Отладочные записи о пропущенных полях исказили бы замер
+    logger().set_level(LogLevel::Warning);
+
+    vector<pair<string, string>> inputs;
+    if (files.empty()) {
+        for (size_t count : { 5, 500, 50000 }) {
+            inputs.emplace_back(to_string(count) + " записей", make_anime_page(count));
         }
+    }
+    for (const auto& path : files) {
+        ifstream file(path, ios::binary);
+        inputs.emplace_back(path, string(istreambuf_iterator<char>(file), istreambuf_iterator<char>()));
+    }
 
-        // Создаем объект аниме и заполяем его данными
-        Anime anime;
-        anime.id = data["id"];
-        anime.shikimoriId = data["shikimoriId"];
-        anime.myAnimeListId = data["myAnimeListId"];
+    for (const auto& input : inputs) {
+        size_t runs = input.second.size() < 100000 ? 200 : 5;
+        cout << input.first << " (" << input.second.size() << " Б):" << endl;
 
-        // Проверяем и заполняем поля, если они присутствуют в JSON и не являются null
-        if (!data["name"].is_null() && data["name"].is_string()) {
-            anime.name = data["name"];
-        }
-        else {
-            if (config["debug"] == true) {
-                log_info("Значение 'name' пусто или не является строкой");
-            }
-            anime.name = "Нет";
-        }
-        if (!data["russian"].is_null() && data["russian"].is_string()) {
-            anime.russian = data["russian"];
-        }
-        else {
-            if (config["debug"] == true) {
-                log_info("Значение 'russian' пусто или не является строкой");
-            }
-            anime.russian = "Нет";
-        }
-        if (!data["english"].is_null() && data["english"].is_string()) {
-            anime.english = data["english"];
-        }
-        else {
-            if (config["debug"] == true) {
-                log_info("Значение 'english' пусто или не является строкой");
-            }
-            anime.english = "Нет";
-        }
-        if (!data["synonyms"].empty() && data["synonyms"].is_array()) {
-            anime.synonyms = data["synonyms"].get<vector<string>>();
-        }
-        else {
-            if (config["debug"] == true) {
-                log_info("Значение 'synonyms' пусто или не массивом");
+        bench_run("DOM", runs, [&]() {
+            json data = json::parse(input.second);
+            vector<Anime> results;
+            if (data.is_array()) {
+                for (auto& item : data) {
+                    results.push_back(parse_anime_dom(item));
+                }
             }
-            anime.synonyms = { "Нет" };
-        }
-        if (data["episodes"].is_number()) {
-            anime.episodes = data["episodes"];
-        }
-        else {
-            if (config["debug"] == true) {
-                log_info("Значение 'episodes' не является числом");
+            else {
+                results.push_back(parse_anime_dom(data));
             }
-            anime.episodes = 0;
+            return results.size();
+        });
+
+        bench_run("SAX", runs, [&]() {
+            vector<Anime> results;
+            string error;
+            decode_records(input.second, results, error);
+            return results.size();
+        });
+    }
+    return 0;
+}
+
+/**
+ * @brief --bench-fields [кол-во]: сравнивает разбор одной записи из готового DOM.
+ *
+ * Прежняя цепочка проверок по каждому полю против одного прохода по ключам с таблицей Schema.
+ */
+int bench_fields(const vector<string>& args) {
+    logger().set_level(LogLevel::Warning);
+
+    size_t count;
+    if (!bench_count(args, 0, 10000, count, "--bench-fields [кол-во]")) {
+        return 1;
+    }
+    json page = json::parse(make_anime_page(count));
+    cout << count << " записей из DOM:" << endl;
+
+    bench_run("ladder", 20, [&]() {
+        size_t decoded = 0;
+        for (auto& item : page) {
+            Anime anime = parse_anime_dom(item);
+            decoded += !anime.description.empty() && !anime.name.empty();
         }
-        if (data["episodesAired"].is_number()) {
-            anime.episodesAired = data["episodesAired"];
+        return decoded;
+    });
+
+    bench_run("schema", 20, [&]() {
+        size_t decoded = 0;
+        for (const auto& item : page) {
+            Anime anime = decode_object<Anime>(item);
+            decoded += !anime.description.empty() && !anime.name.empty();
         }
-        else {
-            if (config["debug"] == true) {
-                log_info("Значение 'episodesAired' не является числом");
+        return decoded;
+    });
+    return 0;
+}
+
+/**
+ * @brief --bench-search: задержка нечеткого поиска в зависимости от размера корпуса и длины запроса.
+ *
+ * Корпус — синтетические названия из случайных слов, запросы — фрагменты названий с одной опечаткой.
+ */
+int bench_search(const vector<string>&) {
+    const vector<string> words = {
+        "naruto", "bleach", "one", "piece", "attack", "titan", "death", "note", "sword", "art", "online",
+        "steins", "gate", "fullmetal", "alchemist", "cowboy", "bebop", "evangelion", "spirited", "away",
+        "наруто", "атака", "титанов", "тетрадь", "смерти", "мастера", "меча", "врата", "штейна", "алхимик"
+    };
+    mt19937 generator(42);
+
+    for (size_t corpus : { 1000, 10000, 50000 }) {
+        vector<string> names(corpus);
+        for (auto& name : names) {
+            size_t count = 2 + generator() % 3;
+            for (size_t i = 0; i < count; i++) {
+                name += (i ? " " : "") + words[generator() % words.size()];
             }
-            anime.episodesAired = 0;
-        }
-        if (data["duration"].is_number()) {
-            anime.duration = data["duration"];
         }
-        else {
-            if (config["debug"] == true) {
-                log_info("Значение 'duration' не является числом");
+
+        TrigramIndex index;
+        auto start = chrono::steady_clock::now();
+        index.build(corpus, [&names](size_t document, vector<string_view>& texts) {
+            texts.push_back(names[document]);
+        });
+        double buildMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << corpus << " записей: построение " << fixed << setprecision(1) << buildMs << " мс, списки "
+            << index.compressed_bytes() / 1024 << " КБ" << endl;
+
+        for (size_t length : { 4, 8, 16, 32 }) {
+            vector<string> queries;
+            while (queries.size() < 200) {
+                const string& name = names[generator() % corpus];
+                if (name.size() < length) {
+                    continue;
+                }
+                string query = name.substr(0, length);
+                query[generator() % length] = 'q';
+                queries.push_back(query);
             }
-            anime.duration = 0;
-        }
-        if (!data["description"].is_null() && data["description"].is_string()) {
-            anime.description = data["description"];
-        }
-        else {
-            if (config["debug"] == true) {
-                log_info("Значение 'description' пусто или не является строкой");
+
+            size_t found = 0;
+            start = chrono::steady_clock::now();
+            for (const auto& query : queries) {
+                found += index.search(query, 10).size();
             }
-            anime.description = "Нет";
+            double microseconds = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / queries.size();
+            cout << "  запрос " << setw(2) << length << " Б: " << setw(8) << setprecision(1) << microseconds
+                << " мкс, найдено в среднем " << (double)found / queries.size() << endl;
         }
+    }
+    return 0;
+}
 
-        // Выводим информацию о аниме
-        cout << "[" << COLOR_MAGENTA << "+" << COLOR_RESET << "] "
-            << "Информация о аниме" << endl;
-        cout << "ID: " << anime.id << endl;
-        cout << "Shikimori ID: " << anime.shikimoriId << endl;
-        cout << "MyAnimeList ID: " << anime.myAnimeListId << endl;
-        cout << "Название: " << anime.name << endl;
-        cout << "Название на русском: " << anime.russian << endl;
-        cout << "Название на английском: " << anime.english << endl;
+/**
+ * @brief --bench-pager [страниц]: ожидание страницы поиска с предзагрузкой и без нее на
+ * искусственном источнике с задержкой 20 мс, плюс проверка, что ошибка загрузки не кэшируется.
+ */
+int bench_pager(const vector<string>& args) {
+    size_t count;
+    if (!bench_count(args, 0, 50, count, "--bench-pager [страниц]")) {
+        return 1;
+    }
 
-        cout << "Альтернативные названия: ";
-        if (anime.synonyms.size() == 0) {
-            cout << "Нет";
+    const size_t total = 100000;
+    auto source = [total](size_t offset, size_t take) {
+        this_thread::sleep_for(chrono::milliseconds(20));
+        SearchPager::Page page;
+        for (size_t i = offset; i < min(offset + take, total); i++) {
+            Anime anime;
+            anime.id = (int)i;
+            page.items.push_back(move(anime));
         }
-        else if (anime.synonyms.size() == 1) {
-            cout << anime.synonyms[0];
-        }
-        else {
-            for (size_t i = 0; i < anime.synonyms.size(); i++) {
-                cout << anime.synonyms[i];
-                if (i != anime.synonyms.size() - 1) {
-                    cout << ", ";
-                }
+        return page;
+    };
+
+    for (bool reading : { false, true }) {
+        SearchPager pager(source, 5, 40, 3, 0.25);
+        double waited = 0;
+        for (size_t number = 0; number < count; number++) {
+            auto started = chrono::steady_clock::now();
+            if (!pager.page(number)) {
+                break;
+            }
+            waited += chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+            if (reading) {
+                // Пока пользователь читает страницу, следующая успевает загрузиться
+                this_thread::sleep_for(chrono::milliseconds(30));
             }
         }
-        cout << endl;
+        cout << (reading ? "С паузой на чтение: " : "Подряд:             ") << fixed << setprecision(2)
+            << waited / count << " мс ожидания на страницу" << endl;
+    }
 
-        cout << "Кол-во эпизодов: " << anime.episodes << " / " << anime.episodesAired << endl;
-        cout << "Длительность: " << anime.duration << " м." << endl;
-        cout << "Описание: " << anime.description << '\n' << endl;
+    // Первая загрузка падает, повторный запрос той же страницы должен сходить в источник заново
+    size_t calls = 0;
+    SearchPager pager([&calls, &source](size_t offset, size_t take) {
+        if (calls++ == 0) {
+            SearchPager::Page page;
+            page.error = "HTTP 503";
+            return page;
+        }
+        return source(offset, take);
+    }, 5, 40, 3, 0.25);
 
-        cout << "Ссылки: " << endl;
-        cout << "AniMi Club: " << "https://animi.club/anime/" << anime.id << endl;
-        cout << "Shikimori: " << "https://shikimori.one/animes/" << anime.shikimoriId << endl;
-        cout << "MyAnimeList: " << "https://myanimelist.net/anime/" << anime.myAnimeListId << '\n' << endl;
-    }
-    catch (const json::exception& e) {
-        cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] "
-            << "Ошибка при обработке данных аниме: " << e.what() << endl;
+    const SearchPager::Page* first = pager.page(0);
+    const SearchPager::Page* second = pager.page(0);
+    if (!first || first->error.empty() || !second || !second->error.empty() || second->items.empty()) {
+        cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] " << "Страница с ошибкой осталась в кэше" << endl;
+        return 1;
     }
+    cout << "[" << COLOR_MAGENTA << "+" << COLOR_RESET << "] " << "Страница после ошибки загружена заново ("
+        << second->items.size() << " записей)" << endl;
+    return 0;
+}
 
-    string answer;
-    cout << "[" << COLOR_MAGENTA << "?" << COLOR_RESET << "] " << "Хотите продолжить? (y/n): ";
-    cin >> answer;
+/**
+ * @brief Выводит экран с результатами поиска в том же виде, что и get_anime_by_query.
+ */
+void bench_print_screen(ostream& out, const vector<Anime>& records) {
+    for (const auto& anime : records) {
+        out << "ID: " << anime.id << endl;
+        out << "Shikimori ID: " << anime.shikimoriId << endl;
+        out << "MyAnimeList ID: " << anime.myAnimeListId << endl;
+        out << "Название: " << anime.name << endl;
+        out << "Название на русском: " << anime.russian << endl;
+        out << "Кол-во эпизодов: " << anime.episodes << " / " << anime.episodesAired << endl;
+        out << "Длительность: " << anime.duration << " м." << '\n' << endl;
+    }
+    out << "[" << COLOR_MAGENTA << "?" << COLOR_RESET << "] " << "Хотите продолжить? (y/n): ";
+}
 
-    if (answer == "y" || answer == "Y") {
-        get_random_anime();
+/**
+ * @brief --bench-render [кадров]: время вывода экрана через system("cls"/"clear") и через ScreenRenderer.
+ *
+ * Чередуются два экрана результатов поиска, отличающиеся частью строк. Кадры пишутся в stdout
+ * (его стоит направить в терминал или в NUL//dev/null), итоги выводятся в stderr.
+ */
+int bench_render(const vector<string>& args) {
+    size_t frames;
+    if (!bench_count(args, 0, 200, frames, "--bench-render [кадров]")) {
+        return 1;
     }
-    else {
-        exit(0);
+
+    vector<Anime> screens[2];
+    string error;
+    decode_records(make_anime_page(4), screens[0], error);
+    screens[1] = screens[0];
+    for (size_t i = 0; i < screens[1].size(); i += 2) {
+        screens[1][i].episodesAired--;
     }
-}
 
-void get_anime_by_query() {
-    clear_console();
+    auto measure = [frames](const function<void(size_t)>& frame) {
+        vector<double> times;
+        for (size_t i = 0; i < frames; i++) {
+            auto start = chrono::steady_clock::now();
+            frame(i);
+            times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+        }
+        sort(times.begin(), times.end());
+        return times;
+    };
 
-    string query;
+    vector<double> legacy = measure([&](size_t i) {
+#ifdef _WIN32
+        int result = system("cls");
+#else
+        int result = system("clear");
+#endif
+        (void)result;
+        bench_print_screen(cout, screens[i % 2]);
+        cout << flush;
+    });
 
-    cout << "[" << COLOR_MAGENTA << "?" << COLOR_RESET << "] " << "Введите название: ";
-    cin >> query;
+    ScreenRenderer renderer;
+    ostream screen(&renderer);
+    vector<double> rendered = measure([&](size_t i) {
+        renderer.clear();
+        bench_print_screen(screen, screens[i % 2]);
+        renderer.present();
+    });
 
-    clear_console();
+    cerr << fixed << setprecision(3) << '\n' << "Кадров: " << frames << ", время до экрана, мс:" << endl;
+    cerr << "  system(\"clear\") + endl: p50 " << percentile(legacy, 0.5) << ", p99 " << percentile(legacy, 0.99) << endl;
+    cerr << "  ScreenRenderer:          p50 " << percentile(rendered, 0.5) << ", p99 " << percentile(rendered, 0.99) << endl;
+    return 0;
+}
 
-    string url = "https://api.animi.club/anime/search";
-    string response = http_post_request(url, query);
+/**
+ * @brief --bench-compression [запросов]: сжатие ответов против его отсутствия на тестовом сервере.
+ *
+ * Для одиночного ответа (/anime/random) и страниц поиска на 5 и 100 записей последовательно
+ * выполняются запросы с Accept-Encoding и без него. Выводятся байты на проводе и после распаковки
+ * на запрос и задержка p50/p99 вместе с разбором. Ожидается, что api_url указывает на AniMi-MockServer.
+ */
+int bench_compression(const vector<string>& args) {
+    size_t requests;
+    if (!bench_count(args, 0, 200, requests, "--bench-compression [запросов]")) {
+        return 1;
+    }
+    response_cache().set_enabled(false);
 
-    try {
-        json data = json::parse(response);
+    struct Scenario {
+        string name;
+        HttpRequest request;
+    };
 
-        if (data.is_array()) {
-            vector<Anime> anime_results;
+    vector<Scenario> scenarios = { { "random", random_anime_request() } };
+    for (int take : { 5, 100 }) {
+        HttpRequest request = search_anime_request("");
+        request.body = search_request_body("", take);
+        scenarios.push_back({ "search x" + to_string(take), request });
+    }
 
-            for (const auto& anime : data) {
-                Anime anime_info;
+    cout << "Сервер: " << api_url("") << ", запросов на сценарий: " << requests << endl;
+    for (const auto& scenario : scenarios) {
+        string endpoint = endpoint_of(scenario.request.url);
 
-                anime_info.id = anime["id"];
-                anime_info.shikimoriId = anime["shikimoriId"];
-                anime_info.myAnimeListId = anime["myAnimeListId"];
-                if (!anime["name"].is_null() && anime["name"].is_string()) {
-                    anime_info.name = anime["name"];
-                }
-                else {
-                    if (config["debug"] == true) {
-                        log_info("Значение 'name' пусто или не является строкой");
-                    }
-                    anime_info.name = "Нет";
-                }
-                if (!anime["russian"].is_null() && anime["russian"].is_string()) {
-                    anime_info.russian = anime["russian"];
-                }
-                else {
-                    if (config["debug"] == true) {
-                        log_info("Значение 'russian' пусто или не является строкой");
-                    }
-                    anime_info.russian = "Нет";
-                }
-                if (!anime["english"].is_null() && anime["english"].is_string()) {
-                    anime_info.english = anime["english"];
-                }
-                else {
-                    if (config["debug"] == true) {
-                        log_info("Значение 'english' пусто или не является строкой");
-                    }
-                    anime_info.english = "Нет";
-                }
-                if (anime["episodes"].is_number()) {
-                    anime_info.episodes = anime["episodes"];
-                }
-                else {
-                    if (config["debug"] == true) {
-                        log_info("Значение 'episodes' не является числом");
-                    }
-                    anime_info.episodes = 0;
-                }
-                if (anime["episodesAired"].is_number()) {
-                    anime_info.episodesAired = anime["episodesAired"];
-                }
-                else {
-                    if (config["debug"] == true) {
-                        log_info("Значение 'episodesAired' не является числом");
-                    }
-                    anime_info.episodesAired = 0;
-                }
-                if (anime["duration"].is_number()) {
-                    anime_info.duration = anime["duration"];
-                }
-                else {
-                    if (config["debug"] == true) {
-                        log_info("Значение 'duration' не является числом");
-                    }
-                    anime_info.duration = 0;
-                }
+        for (bool compression : { false, true }) {
+            config["compression"] = compression;
 
-                anime_results.push_back(anime_info);
-            }
+            auto counter = [&endpoint](const char* key) {
+                json metrics = request_metrics().to_json();
+                return metrics.contains(endpoint) ? metrics[endpoint].value(key, (uint64_t)0) : 0;
+            };
+            uint64_t wireBefore = counter("wire_bytes");
+            uint64_t decodedBefore = counter("decoded_bytes");
 
-            for (const auto& anime : anime_results) {
-                cout << "ID: " << anime.id << endl;
-                cout << "Shikimori ID: " << anime.shikimoriId << endl;
-                cout << "MyAnimeList ID: " << anime.myAnimeListId << endl;
-                cout << "Название: " << anime.name << endl;
-                cout << "Название на русском: " << anime.russian << endl;
-                cout << "Название на английском: " << anime.english << endl;
-                cout << "Кол-во эпизодов: " << anime.episodes << " / " << anime.episodesAired << endl;
-                cout << "Длительность: " << anime.duration << " м." << endl;
-                cout << "Смотреть: " << "https://animi.club/anime/" << anime.id << "\n" << endl;
-            }
-        }
-        else if (data.is_object()) {
-            Anime anime_info;
+            vector<double> latencies;
+            size_t records = 0;
+            for (size_t i = 0; i < requests; i++) {
+                auto start = chrono::steady_clock::now();
+                HttpResponse response = http_client().perform(scenario.request);
 
-            anime_info.id = data["id"];
-            anime_info.shikimoriId = data["shikimoriId"];
-            anime_info.myAnimeListId = data["myAnimeListId"];
-            if (!data["name"].is_null() && data["name"].is_string()) {
-                anime_info.name = data["name"];
-            }
-            else {
-                if (config["debug"] == true) {
-                    log_info("Значение 'name' пусто или не является строкой");
-                }
-                anime_info.name = "Нет";
-            }
-            if (!data["russian"].is_null() && data["russian"].is_string()) {
-                anime_info.russian = data["russian"];
-            }
-            else {
-                if (config["debug"] == true) {
-                    log_info("Значение 'russian' пусто или не является строкой");
-                }
-                anime_info.russian = "Нет";
-            }
-            if (!data["english"].is_null() && data["english"].is_string()) {
-                anime_info.english = data["english"];
-            }
-            else {
-                if (config["debug"] == true) {
-                    log_info("Значение 'english' пусто или не является строкой");
-                }
-                anime_info.english = "Нет";
-            }
-            if (data["episodes"].is_number()) {
-                anime_info.episodes = data["episodes"];
-            }
-            else {
-                if (config["debug"] == true) {
-                    log_info("Значение 'episodes' не является числом");
-                }
-                anime_info.episodes = 0;
-            }
-            if (data["episodesAired"].is_number()) {
-                anime_info.episodesAired = data["episodesAired"];
-            }
-            else {
-                if (config["debug"] == true) {
-                    log_info("Значение 'episodesAired' не является числом");
-                }
-                anime_info.episodesAired = 0;
-            }
-            if (data["duration"].is_number()) {
-                anime_info.duration = data["duration"];
-            }
-            else {
-                if (config["debug"] == true) {
-                    log_info("Значение 'duration' не является числом");
+                vector<Anime> decoded;
+                string error;
+                if (response.code == CURLE_OK && !response.body.empty()) {
+                    decode_records(response.body, decoded, error);
                 }
-                anime_info.duration = 0;
+                records += decoded.size();
+                latencies.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
             }
+            sort(latencies.begin(), latencies.end());
 
-            cout << "ID: " << anime_info.id << endl;
-            cout << "Shikimori ID: " << anime_info.shikimoriId << endl;
-            cout << "MyAnimeList ID: " << anime_info.myAnimeListId << endl;
-            cout << "Название: " << anime_info.name << endl;
-            cout << "Название на русском: " << anime_info.russian << endl;
-            cout << "Название на английском: " << anime_info.english << endl;
-            cout << "Кол-во эпизодов: " << anime_info.episodes << " / " << anime_info.episodesAired << endl;
-            cout << "Длительность: " << anime_info.duration << " м." << endl;
-            cout << "Смотреть: " << "https://animi.club/anime/" << anime_info.id << "\n" << endl;
-        }
-        else {
-            cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] "
-                << "Ошибка: Ожидался массив или объект данных аниме, получен: " << data.type_name() << endl;
+            // Подписи кириллицей выровнены вручную: setw считает байты
+            cout << "  " << left << setw(12) << scenario.name << (compression ? "сжатие" : "без   ") << right
+                << fixed << setprecision(0)
+                << setw(9) << (double)(counter("wire_bytes") - wireBefore) / requests << " Б на проводе"
+                << setw(9) << (double)(counter("decoded_bytes") - decodedBefore) / requests << " Б данных"
+                << setprecision(3) << "   p50 " << percentile(latencies, 0.5) << " мс, p99 " << percentile(latencies, 0.99)
+                << " мс, записей " << records / requests << endl;
         }
     }
-    catch (const json::exception& e) {
-        cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] "
-            << "Ошибка при обработке данных аниме: " << e.what() << endl;
+    return 0;
+}
+/**
+ * @brief --bench-http2 [запросов] [одновременно]: пакет поисковых запросов по HTTP/1.1 с keep-alive
+ * против HTTP/2 с мультиплексированием на тестовом сервере (h2c, поэтому версия "2-prior-knowledge").
+ */
+int bench_http2(const vector<string>& args) {
+    size_t requests;
+    size_t concurrency;
+    if (!bench_count(args, 0, 500, requests, "--bench-http2 [запросов] [одновременно]")
+        || !bench_count(args, 1, 32, concurrency, "--bench-http2 [запросов] [одновременно]")) {
+        return 1;
     }
+    response_cache().set_enabled(false);
 
-    string answer;
-    cout << "[" << COLOR_MAGENTA << "?" << COLOR_RESET << "] " << "Хотите продолжить? (y/n): ";
-    cin >> answer;
+    cout << "Сервер: " << api_url("") << ", запросов: " << requests << ", одновременно: " << concurrency << endl;
+    // Сначала HTTP/1.1: пик потоков на соединение накапливается, и у HTTP/1.1 он всегда 1
+    for (const char* version : { "1.1", "2-prior-knowledge" }) {
+        config["http_version"] = version;
+        http_client().reload_http_version();
 
-    if (answer == "y" || answer == "Y") {
-        get_anime_by_query();
-    }
-    else {
-        exit(0);
+        RequestMetrics::ConnectionSummary before = request_metrics().connection_summary();
+
+        // Сравниваются передачи, поэтому одинаковые запросы не объединяются
+        BatchClient batch(concurrency);
+        batch.set_coalescing(false);
+        for (size_t i = 0; i < requests; i++) {
+            HttpRequest request = search_anime_request("");
+            request.body = search_request_body(to_string(i % 50), 5);
+            batch.submit(move(request));
+        }
+
+        vector<double> latencies;
+        size_t failures = 0;
+        auto start = chrono::steady_clock::now();
+        batch.run([&](BatchResult& result) {
+            if (result.response->code != CURLE_OK || result.response->status != 200) {
+                failures++;
+            }
+            latencies.push_back(result.seconds * 1000);
+        });
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        sort(latencies.begin(), latencies.end());
+
+        RequestMetrics::ConnectionSummary after = request_metrics().connection_summary();
+        uint64_t opened = after.total - before.total;
+        uint64_t served = after.requests - before.requests;
+
+        cout << "  HTTP/" << left << setw(18) << version << right << fixed << setprecision(3)
+            << elapsed << " с, " << setprecision(0) << requests / elapsed << " запр/с, "
+            << setprecision(3) << "p50 " << percentile(latencies, 0.5) << " мс, p99 " << percentile(latencies, 0.99)
+            << " мс, соединений " << opened << ", запросов на соединение " << setprecision(1)
+            << (opened > 0 ? (double)served / opened : 0) << ", потоков до " << after.peakStreams
+            << ", ошибок " << failures << endl;
     }
+    return 0;
 }
 
 /**
- * @brief Очищает введенное имя пользователя от недопустимых символов.
- *
- * Функция принимает строку `username` и удаляет из нее все символы, кроме букв (верхнего и нижнего регистра), цифр, символов '-' и '_'. Очищенная строка возвращается в качестве результата.
- *
- * @param username Строка с именем пользователя, которую необходимо очистить.
- * @return Очищенная строка с именем пользователя.
+ * @brief --bench-hedge [запросов]: последовательные запросы профиля без дублей и с дублями после p95.
+ * Хвост задержек задается тестовому серверу ключами --slow-rate и --slow-ms.
  */
-string sanitize_username(string username) {
-    // Регулярное выражение для разрешенных символов: буквы, цифры, '-', '_'
-    regex pattern("[^a-zA-Z0-9-_]");
+int bench_hedge(const vector<string>& args) {
+    size_t requests;
+    if (!bench_count(args, 0, 500, requests, "--bench-hedge [запросов]")) {
+        return 1;
+    }
+    response_cache().set_enabled(false);
 
-    // Заменяем недопустимые символы на пустую строку
-    username = regex_replace(username, pattern, "");
+    HttpRequest request = user_request("riktikdev");
+    cout << "Сервер: " << api_url("") << ", запросов: " << requests << endl;
+    // Первый проход заодно набирает замеры, по которым второй выбирает задержку дубля
+    for (bool hedge : { false, true }) {
+        config["hedge_requests"] = hedge;
 
-    return username;
+        vector<double> latencies;
+        size_t failures = 0;
+        for (size_t i = 0; i < requests; i++) {
+            auto start = chrono::steady_clock::now();
+            HttpResponse response = http_client().perform(request);
+            latencies.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+            if (response.code != CURLE_OK || response.status != 200) {
+                failures++;
+            }
+        }
+        sort(latencies.begin(), latencies.end());
+
+        cout << (hedge ? "  с дублями:  " : "  без дублей: ") << fixed << setprecision(3)
+            << "p50 " << percentile(latencies, 0.5) << " мс, p95 " << percentile(latencies, 0.95)
+            << " мс, p99 " << percentile(latencies, 0.99) << " мс, max " << latencies.back() << " мс, ошибок " << failures;
+        if (hedge) {
+            json endpoint = request_metrics().to_json()["/users/:name"];
+            cout << ", дублей " << endpoint.value("hedged", 0) << " (выиграли " << endpoint.value("hedge_wins", 0)
+                << "), задержка дубля " << hedge_delay_ms(request.url) << " мс";
+        }
+        cout << endl;
+    }
+    return 0;
 }
 
 /**
- * @brief Запрашивает у пользователя имя пользователя и очищает его от недопустимых символов.
- *
- * Функция запрашивает у пользователя имя пользователя с помощью стандартного ввода. Затем производит очистку введенного имени от всех символов, кроме букв (верхнего и нижнего регистра), цифр, символов '-' и '_'. Если очищенное имя пользователя не содержит недопустимых символов, оно выводится в консоль для демонстрации.
+ * @brief --bench-log [вызовов]: цена выключенного LOG_DEBUG против прежней проверки config["debug"],
+ * включенного вызова (постановка в очередь из одного и из четырех потоков) и синхронной записи с endl.
  */
-void get_user_by_username() {
-    // Очищаем консоль
-    clear_console();
+int bench_log(const vector<string>& args) {
+    size_t calls;
+    if (!bench_count(args, 0, 10000000, calls, "--bench-log [вызовов]")) {
+        return 1;
+    }
+    size_t writes = min<size_t>(calls, 200000);
+    string path = "bench-log.log";
+
+    LogOptions options;
+    options.level = LogLevel::Warning;
+    options.path = path;
+    options.maxBytes = 64 * 1024 * 1024;
+    options.files = 0;
+    Logger bench;
+    bench.start(options);
+
+    auto report = [](const char* name, chrono::steady_clock::time_point start, size_t count) {
+        double nanoseconds = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / count;
+        cout << "  " << name << fixed << setprecision(2) << nanoseconds << " нс/вызов" << endl;
+    };
+
+    volatile size_t sink = 0;
+    json debug = config["debug"];
+    config["debug"] = false;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < calls; i++) {
+        if (config["debug"] == true) {
+            sink = sink + 1;
+        }
+    }
+    report("проверка config[\"debug\"]:       ", start, calls);
+    config["debug"] = debug;
 
-    string username;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < calls; i++) {
+        LOG_TO(bench, LogLevel::Debug, "Запрос " + to_string(i) + " выполнен");
+    }
+    report("выключенный LOG_DEBUG:          ", start, calls);
 
-    // Спрашиваем имя пользователя
-    cout << "[" << COLOR_MAGENTA << "?" << COLOR_RESET << "] " << "Введите имя пользователя: ";
-    cin >> username;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < writes; i++) {
+        LOG_TO(bench, LogLevel::Warning, "Запрос " + to_string(i) + " выполнен");
+    }
+    report("включенный, один поток:         ", start, writes);
 
-    // Очищаем имя пользователя от недопустимых символов
-    string sanitized_username = sanitize_username(username);
+    vector<thread> producers;
+    start = chrono::steady_clock::now();
+    for (int t = 0; t < 4; t++) {
+        producers.emplace_back([&bench, writes] {
+            LogRequestScope scope;
+            for (size_t i = 0; i < writes / 4; i++) {
+                LOG_TO(bench, LogLevel::Warning, "Запрос " + to_string(i) + " выполнен");
+            }
+        });
+    }
+    for (thread& producer : producers) {
+        producer.join();
+    }
+    report("включенный, четыре потока:      ", start, writes / 4 * 4);
+    bench.stop();
 
-    // Проверяем, осталось ли что-то от имени пользователя после очистки
-    if (sanitized_username.empty()) {
-        cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] "
-            << "Имя пользователя содержит недопустимые символы. Разрешены только буквы, цифры, '-', '_'" << endl;
-        return;
+    ofstream sync(path + ".sync");
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < writes; i++) {
+        sync << "[DEBUG] " << "Запрос " + to_string(i) + " выполнен" << endl;
     }
+    report("синхронная запись с endl:       ", start, writes);
+    sync.close();
 
-    clear_console();
+    cout << "Отброшено при переполнении буфера: " << bench.dropped_count() << endl;
+    error_code error;
+    filesystem::remove(path, error);
+    filesystem::remove(path + ".sync", error);
+    return 0;
+}
 
-    string url = "https://api.animi.club/users/" + sanitized_username;
-    string response = http_get_request(url);
+/**
+ * @brief Прежнее форматирование даты через stringstream, get_time и put_time (база для сравнения).
+ */
+string format_iso_date_stream(const string& isoDate) {
+    tm time = {};
+    stringstream ss(isoDate);
+    ss >> get_time(&time, "%Y-%m-%dT%H:%M:%S");
 
-    // Проверяем на пустой ответ или внутреннюю серверную ошибку
-    if (response.empty()) {
-        cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] "
-            << "Пользователь с именем '" << sanitized_username << "' не найден." << endl;
-        return;
+    if (ss.fail()) {
+        return "Недопустимая дата";
     }
 
-    // Пытаемся распарсить JSON ответ
-    try {
-        json data = json::parse(response);
-
-        // Проверяем на наличие ошибок
-        if (data.find("error") != data.end()) {
-            string errorMessage = data["error"];
-            cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] "
-                << "Ошибка при получении информации о пользователе: " << errorMessage << endl;
-            return;
-        }
+    stringstream formattedDate;
+    formattedDate << put_time(&time, "%d %b. %Y");
+    return formattedDate.str();
+}
 
-        // Создаем объект пользователя и заполняем его данными
-        User user;
-        user.id = data["id"];
-        user.username = sanitized_username;
+/**
+ * @brief --bench-dates [меток]: разбор и форматирование меток времени ISO 8601.
+ *
+ * Сравнивает прежний format_iso_date на потоках с новым, отдельно замеряет разбор по одной метке,
+ * пакетный разбор столбца и форматирование в готовый буфер. Перед замером проверяется, что пакетный
+ * разбор совпадает с поштучным, а format_iso8601 и parse_iso8601 взаимно обратны.
+ */
+int bench_dates(const vector<string>& args) {
+    size_t count;
+    if (!bench_count(args, 0, 100000, count, "--bench-dates [меток]")) {
+        return 1;
+    }
 
-        // Проверяем и заполняем поля, если они присутствуют в JSON и не являются null
-        if (!data["globalName"].is_null()) {
-            user.globalName = data["globalName"];
-        }
-        else {
-            user.globalName = "Нет";
-        }
-        if (!data["avatar"].is_null()) {
-            user.avatar = data["avatar"];
+    mt19937 generator(11);
+    vector<string> stamps(count);
+    for (size_t i = 0; i < count; i++) {
+        int64_t epochMs = 946684800000LL + (int64_t)(generator() % 900000000) * 1000 + generator() % 1000;
+        char buffer[40];
+        size_t length = format_iso8601(epochMs, buffer, sizeof(buffer));
+        stamps[i].assign(buffer, length);
+        // Часть меток — с зоной или без долей секунды, как бывает в ответах API
+        if (i % 4 == 1) {
+            stamps[i].replace(stamps[i].size() - 1, 1, "+03:00");
         }
-        else {
-            user.avatar = "Нет";
-        }
-        if (!data["verified"].is_null()) {
-            user.verified = data["verified"];
+        else if (i % 4 == 2) {
+            stamps[i].erase(19, 4);
         }
-        else {
-            user.verified = false;
+    }
+    vector<string_view> views(stamps.begin(), stamps.end());
+    vector<int64_t> single(count), batch(count);
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!parse_iso8601(views[i], single[i])) {
+            single[i] = invalidTimestamp;
         }
-        if (!data["createdAt"].is_null()) {
-            user.createdAt = format_iso_date(data["createdAt"]);
+    }
+    parse_iso8601_batch(views.data(), count, batch.data());
+    for (size_t i = 0; i < count; i++) {
+        char buffer[40];
+        int64_t back = invalidTimestamp;
+        size_t length = format_iso8601(single[i], buffer, sizeof(buffer));
+        parse_iso8601(string_view(buffer, length), back);
+        mismatches += single[i] == invalidTimestamp || batch[i] != single[i] || back != single[i];
+    }
+    cout << count << " меток, расхождений при проверке: " << mismatches << endl;
+
+    bench_run("stream", 5, [&]() {
+        size_t length = 0;
+        for (const auto& stamp : stamps) {
+            length += format_iso_date_stream(stamp).size();
         }
-        else {
-            user.createdAt = "Нет данных";
+        return length > 0 ? count : 0;
+    });
+    bench_run("wrapper", 5, [&]() {
+        size_t length = 0;
+        for (const auto& stamp : stamps) {
+            length += format_iso_date(stamp).size();
         }
-        if (!data["updatedAt"].is_null()) {
-            user.updatedAt = format_iso_date(data["updatedAt"]);
+        return length > 0 ? count : 0;
+    });
+    bench_run("parse", 5, [&]() {
+        size_t parsed = 0;
+        for (size_t i = 0; i < count; i++) {
+            parsed += parse_iso8601(views[i], single[i]);
         }
-        else {
-            user.updatedAt = "Нет данных";
+        return parsed;
+    });
+    bench_run("parse batch", 5, [&]() {
+        return parse_iso8601_batch(views.data(), count, batch.data());
+    });
+    bench_run("format_date", 5, [&]() {
+        char buffer[48];
+        size_t formatted = 0;
+        for (size_t i = 0; i < count; i++) {
+            formatted += format_date(batch[i], buffer, sizeof(buffer), DateLocale::Russian) > 0;
         }
+        return formatted;
+    });
+    return 0;
+}
 
-        // Выводим информацию о пользователе
-        cout << "[" << COLOR_MAGENTA << "+" << COLOR_RESET << "] "
-            << "Информация о пользователе '" << sanitized_username << "':" << endl;
-        cout << "ID: " << user.id << endl;
-        cout << "Имя пользователя: " << user.username << endl;
-        cout << "Отображаемое имя: " << user.globalName << endl;
-        cout << "Верифицирован: " << (user.verified ? "Да" : "Нет") << endl;
-        cout << "Аватар: " << "https://animi-s3.s3.aeza.cloud/" + user.avatar << endl;
-        cout << "Дата создания: " << user.createdAt << endl;
-        cout << "Дата обновления: " << user.updatedAt << '\n' << endl;
+/**
+ * @brief Наибольший объем физической памяти процесса за время работы, в байтах.
+ */
+uint64_t peak_rss_bytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = {};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize;
     }
-    catch (const json::exception& e) {
-        cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] "
-            << "Ошибка при обработке данных пользователя: " << e.what() << endl;
+    return 0;
+#else
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return stoull(line.substr(6)) * 1024;
+        }
     }
+    return 0;
+#endif
+}
 
-    string answer;
-    cout << "[" << COLOR_MAGENTA << "?" << COLOR_RESET << "] " << "Хотите продолжить? (y/n): ";
-    cin >> answer;
-
-    if (answer == "y" || answer == "Y") {
-        get_user_by_username();
-    }
-    else {
-        exit(0);
+/**
+ * @brief Синтетический дамп каталога: у сезонов одного тайтла общие названия, синонимы
+ * берутся из небольшого набора, описания у всех разные.
+ */
+string make_catalog_dump(size_t count) {
+    // Строка собирается без DOM, иначе его пиковая память заслонила бы сравниваемые контейнеры
+    mt19937 generator(7);
+    string dump = "[";
+    dump.reserve(count * 448);
+    for (size_t i = 0; i < count; i++) {
+        size_t title = i / 4;
+        json english = title % 3 ? json("English title " + to_string(title)) : json(nullptr);
+        dump += (i ? "," : "") + json{
+            {"id", i}, {"shikimoriId", i + 1}, {"myAnimeListId", i + 2},
+            {"name", "Anime title " + to_string(title)}, {"russian", "Аниме " + to_string(title)},
+            {"english", english},
+            {"episodes", 1 + generator() % 26}, {"episodesAired", 1 + generator() % 26}, {"duration", 5 + generator() % 20},
+            {"description", "Описание записи " + to_string(i) + string(160, '.')},
+            {"synonyms", {"Synonym " + to_string(generator() % 200), "Alt " + to_string(generator() % 50)}}
+        }.dump();
     }
+    dump += ']';
+    return dump;
 }
 
-
 /**
-* @brief Функция для вывода в консоль "Об программе"
-*/
-void about() {
-    clear_console();
+ * @brief --bench-table [записей] [vector|table]: разбор большой выборки в vector<Anime> и в AnimeTable.
+ *
+ * Для каждого варианта выводятся время разбора, число выделений памяти, прирост RSS и скорость
+ * фильтрации и сортировки по числу эпизодов. С вариантом в аргументах выполняется только он
+ * и выводится пиковый RSS процесса (для чистого сравнения — отдельными запусками).
+ */
+int bench_table(const vector<string>& args) {
+    logger().set_level(LogLevel::Warning);
+    size_t count;
+    if (!bench_count(args, 0, 200000, count, "--bench-table [записей] [vector|table]")) {
+        return 1;
+    }
+    string only = args.size() > 1 ? args[1] : string();
 
-    cout << "[" << COLOR_MAGENTA << "?" << COLOR_RESET << "] " << "Что делает программа?" << '\n' << endl;
-    cout << "[" << COLOR_MAGENTA << "#" << COLOR_RESET << "] " << "Да х.. его знает, эта программа была написана ради прикола ну и для финального проекта. Этот софт я старался писать так чтобы Денис не говорил где комментарии и че за говно код, мне даже пришлось учить libcurl для подачи HTTP запросов на мой REST-API сервер сайта. Надеюсь Денис это тебе понравиться." << '\n' << endl;
+    string dump = make_catalog_dump(count);
+    cout << count << " записей, дамп " << dump.size() / 1024 << " КБ" << endl;
 
-    cout << "[" << COLOR_MAGENTA << "?" << COLOR_RESET << "] " << "Что использовалось?" << '\n' << endl;
-    cout << "[" << COLOR_MAGENTA << "#" << COLOR_RESET << "] " << "ChatGPT вообще не использовал, в ютубе прилшось смотреть как сделать хорошее меню, попадались именно видео по созданию консольных меню для читов CS:GO))) Денис не осуждай, это все не я я не контрибьютю читы на геншин :D https://korepi.com. А так использовались такие библиотеки как: fstream - работа с файловой системой; clocale - для установи языка (я прочитал что locale это для Си а не для С++); Windows.h - для использования Windows API; nlohman/json - для работы с JSON форматом; curl - для подачи HTTP запросов на REST-API сервер." << '\n' << endl;
+    auto measure = [&](const char* name, auto& records, auto filter, auto sort) {
+        uint64_t allocations = benchAllocations;
+        uint64_t bytes = benchAllocatedBytes;
+        uint64_t rss = current_rss_bytes();
 
-    cout << "[" << COLOR_MAGENTA << "?" << COLOR_RESET << "] " << "Где смотреть аниме?" << '\n' << endl;
-    cout << "[" << COLOR_MAGENTA << "#" << COLOR_RESET << "] " << "Вот: https://animi.club (скоро обнова, Миша когда на бек ко мне?)" << '\n' << endl;
+        auto start = chrono::steady_clock::now();
+        string error;
+        decode_records(dump, records, error);
+        double decodeMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        uint64_t grown = current_rss_bytes() - min(rss, current_rss_bytes());
+        uint64_t decodeAllocations = benchAllocations - allocations;
+        uint64_t decodeBytes = benchAllocatedBytes - bytes;
 
-    
-    cout << "app_name: " << config["app_name"] << endl;
-    cout << "app_version: " << config["app_version"] << endl;
-    cout << "[" << COLOR_MAGENTA << "#" << COLOR_RESET << "] " << "Отладочная информация" << '\n' << endl;cout << "debug: " << config["debug"] << endl;
-    cout << "developer: " << "https://github.com/" + config["developer"].get<string>() << endl;
+        const int runs = 10;
+        size_t matched = 0;
+        start = chrono::steady_clock::now();
+        for (int run = 0; run < runs; run++) {
+            matched += filter();
+        }
+        double filterSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        start = chrono::steady_clock::now();
+        for (int run = 0; run < runs; run++) {
+            sort(run % 2 == 1);
+        }
+        double sortSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        cout << "  " << name << fixed << setprecision(1) << "разбор " << decodeMs << " мс, выделений "
+            << decodeAllocations << " (" << decodeBytes / 1024 << " КБ), RSS +" << grown / 1024 << " КБ" << '\n'
+            << "      фильтр " << count * runs / filterSeconds / 1e6 << " млн записей/с (совпало " << matched / runs
+            << "), сортировка " << count * runs / sortSeconds / 1e6 << " млн записей/с" << endl;
+    };
+
+    if (only.empty() || only == "table") {
+        AnimeTable table;
+        measure("AnimeTable:   ", table, [&table]() {
+            return table.filter(AnimeTable::Episodes, [](int32_t episodes) { return episodes >= 12; }).size();
+        }, [&table](bool descending) {
+            return table.order_by(AnimeTable::Episodes, descending).size();
+        });
+        cout << "      строк в таблице интернирования: " << table.interned_count() << endl;
+    }
+    if (only.empty() || only == "vector") {
+        vector<Anime> records;
+        measure("vector<Anime>:", records, [&records]() {
+            vector<uint32_t> rows;
+            for (size_t row = 0; row < records.size(); row++) {
+                if (records[row].episodes >= 12) {
+                    rows.push_back((uint32_t)row);
+                }
+            }
+            return rows.size();
+        }, [&records](bool descending) {
+            stable_sort(records.begin(), records.end(), [descending](const Anime& left, const Anime& right) {
+                return descending ? left.episodes > right.episodes : left.episodes < right.episodes;
+            });
+            return records.size();
+        });
+    }
+    if (!only.empty()) {
+        cout << "Пиковый RSS процесса: " << peak_rss_bytes() / 1024 << " КБ" << endl;
+    }
+    return 0;
 }
 
-void secret() {
-    cout << "Ну что сказать... я ничего лучше не придумал как рубануть питание монитора :D" << endl;
-    Sleep(3000);
-    cout << "Выключаем через 3.." << endl;
-    Sleep(1000);
-    cout << "Выключаем через 2.." << endl;
-    Sleep(1000);
-    cout << "Выключаем через 1.." << endl;
-    Sleep(1500);
-    SendMessage(HWND_BROADCAST,WM_SYSCOMMAND,SC_MONITORPOWER, (LPARAM)2);
+/**
+ * @brief Полный путь к исполняемому файлу программы.
+ */
+string executable_path() {
+#ifdef _WIN32
+    char path[MAX_PATH];
+    DWORD length = GetModuleFileNameA(NULL, path, MAX_PATH);
+    return string(path, length);
+#else
+    error_code error;
+    return filesystem::read_symlink("/proc/self/exe", error).string();
+#endif
 }
 
-void show_menu() {
-    clear_console();
+/**
+ * @brief Запускает копию программы с аргументами через командную оболочку, вывод отбрасывается.
+ */
+int run_self(const string& arguments) {
+#ifdef _WIN32
+    // cmd /c снимает внешние кавычки, поэтому вся команда берется в еще одни
+    string command = "\"\"" + executable_path() + "\" " + arguments + " > NUL 2>&1\"";
+#else
+    string command = "\"" + executable_path() + "\" " + arguments + " > /dev/null 2>&1";
+#endif
+    return system(command.c_str());
+}
 
-    cout << "[" << COLOR_MAGENTA << "#" << COLOR_RESET << "] " << "Выберите один из пунктов меню" << '\n' << endl;
+/**
+ * @brief --bench-daemon [вызовов]: задержка одного запроса профиля при запуске программы на каждый вызов
+ * (--batch), при запуске тонкого клиента (--client) и через уже открытое соединение с сервером.
+ *
+ * Сервер поднимается в этом же процессе на отдельном сокете; запросы идут к "api_url"
+ * (обычно к AniMi-MockServer).
+ */
+int bench_daemon(const vector<string>& args) {
+    size_t calls;
+    if (!bench_count(args, 0, 100, calls, "--bench-daemon [вызовов]")) {
+        return 1;
+    }
+    string path = "animi-bench.sock";
+    logger().set_level(LogLevel::Warning);
 
-    cout << "[" << COLOR_MAGENTA << "1" << COLOR_RESET << "] " << "Случайное аниме" << endl;
-    cout << "[" << COLOR_MAGENTA << "2" << COLOR_RESET << "] " << "Поиск аниме по названию" << endl;
-    cout << "[" << COLOR_MAGENTA << "3" << COLOR_RESET << "] " << "Поиск пользователя по названию" << endl;
-    cout << "[" << COLOR_MAGENTA << "4" << COLOR_RESET << "] " << "Об программе" << endl;
-    cout << "[" << COLOR_MAGENTA << "0" << COLOR_RESET << "] " << "Выход" << '\n' << endl;
+    ofstream("bench-daemon.jsonl") << "{\"op\": \"user\", \"username\": \"riktikdev\"}" << endl;
 
-    while (true) {
-        string input;
-        cout << "[" << COLOR_MAGENTA << "?" << COLOR_RESET << "] " << "> ";
-        cin >> input;
+    size_t workers = config.value("daemon_workers", 4);
+    int timeoutMs = config.value("daemon_io_timeout_ms", 2000);
+    DaemonServer server(path, workers, timeoutMs);
+    thread serving([&server]() {
+        server.run();
+    });
 
-        bool isNumber = true;
-        for (char c : input) {
-            if (!isdigit(c)) {
-                isNumber = false;
-                break;
+    DaemonClient client;
+    for (int attempt = 0; attempt < 100 && !client.connect(path); attempt++) {
+        this_thread::sleep_for(chrono::milliseconds(20));
+    }
+
+    cout << "Сервер: " << api_url("") << ", вызовов: " << calls << endl;
+    auto measure = [calls](const char* name, const function<bool()>& call) {
+        vector<double> latencies;
+        size_t failures = 0;
+        for (size_t i = 0; i < calls; i++) {
+            auto start = chrono::steady_clock::now();
+            if (!call()) {
+                failures++;
             }
+            latencies.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
         }
+        sort(latencies.begin(), latencies.end());
+        cout << "  " << name << fixed << setprecision(3) << "p50 " << percentile(latencies, 0.5) << " мс, p99 "
+            << percentile(latencies, 0.99) << " мс, max " << latencies.back() << " мс, ошибок " << failures << endl;
+    };
 
-        if (isNumber) {
-            // Преобразуем введенную строку в число
-            int choice = stoi(input);
+    string request = json{ { "op", "user" }, { "username", "riktikdev" } }.dump();
+    measure("запуск --batch:  ", []() {
+        return run_self("--batch bench-daemon.jsonl") == 0;
+    });
+    measure("запуск --client: ", [&path]() {
+        return run_self("--client --socket " + path + " user riktikdev") == 0;
+    });
+    measure("соединение:      ", [&client, &request]() {
+        string response;
+        return client.call(request, response) && !json::parse(response, nullptr, false).contains("error");
+    });
 
-            switch (choice) {
-            case 1: {
-                get_random_anime();
-                break;
-            }
-            case 2:
-                get_anime_by_query();
-                break;
-            case 3:
-                get_user_by_username();
-                break;
-            case 4:
-                about();
-                break;
-            case 0:
-                exit(0);
-            default:
-                cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "]" << " "
-                    << "Данного пункта меню не существует" << endl;
-                break;
-            }
+    // Клиенты, оборвавшие кадр на середине, занимают все обработчики; запрос другого клиента
+    // должен выполниться, как только их соединения закроются по таймауту кадра
+    string truncated;
+    put_u32(truncated, (uint32_t)request.size());
+    truncated += request.substr(0, request.size() / 2);
+    vector<unique_ptr<DaemonClient>> stalled;
+    for (size_t i = 0; i < workers; i++) {
+        stalled.push_back(make_unique<DaemonClient>());
+        if (stalled.back()->connect(path)) {
+            stalled.back()->send_raw(truncated);
         }
-        else {
-            string lower = input;
+    }
+    this_thread::sleep_for(chrono::milliseconds(50));
 
-            // Преобразуем строку в нижний регистр
-            for (char& c : lower) {
-                c = tolower(c);
-            }
+    string response;
+    auto start = chrono::steady_clock::now();
+    bool served = client.call(request, response, timeoutMs * 3) && !json::parse(response, nullptr, false).contains("error");
+    double waited = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    stalled.clear();
+    if (served) {
+        cout << "  оборванные кадры: " << workers << " клиентов, запрос выполнен за " << fixed << setprecision(1)
+            << waited << " мс (таймаут кадра " << timeoutMs << " мс)" << endl;
+    }
+    else {
+        cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "] " << "Запрос не выполнен, пока обработчики заняты оборванными кадрами" << endl;
+    }
 
-            if (lower == "secret") {
-                secret();
-            }
-            else {
-                clear_console();
-                show_menu();
-                cout << "[" << COLOR_MAGENTA << "!" << COLOR_RESET << "]" << " "
-                    << "Только цифры разрешены" << endl;
+    client.call(json{ { "op", "shutdown" } }.dump(), response);
+    serving.join();
+
+    error_code error;
+    filesystem::remove("bench-daemon.jsonl", error);
+    return served ? 0 : 1;
+}
+
+/**
+ * @brief --bench-avatars [пользователей]: загрузка аватаров по одному в отдельные файлы против
+ * одновременной загрузки в хранилище с адресацией по содержимому, холодной и повторной (ответы 304).
+ *
+ * Пользователи user1..userN и их аватары отдает AniMi-MockServer --users N; "avatar_url" должен
+ * указывать на его /avatars/.
+ */
+int bench_avatars(const vector<string>& args) {
+    size_t count;
+    if (!bench_count(args, 0, 200, count, "--bench-avatars [пользователей]")) {
+        return 1;
+    }
+    size_t concurrency = config.value("batch_concurrency", 8);
+    logger().set_level(LogLevel::Warning);
+
+    vector<string> usernames;
+    for (size_t i = 1; i <= count; i++) {
+        usernames.push_back("user" + to_string(i));
+    }
+    vector<string> errors;
+    vector<string> urls = avatar_urls(usernames, errors);
+    urls.erase(remove(urls.begin(), urls.end(), string()), urls.end());
+    if (urls.empty()) {
+        cout << "Нет аватаров: запустите AniMi-MockServer --users " << count << " и укажите его /avatars/ в \"avatar_url\"" << endl;
+        return 1;
+    }
+    cout << "Аватары: " << avatar_url("") << ", пользователей: " << urls.size() << ", одновременно: " << concurrency << endl;
+
+    error_code error;
+    string plainDirectory = "bench-avatars-plain";
+    string storeDirectory = "bench-avatars";
+    filesystem::remove_all(plainDirectory, error);
+    filesystem::remove_all(storeDirectory, error);
+    filesystem::create_directories(plainDirectory, error);
+
+    auto disk_usage = [](const string& directory) {
+        error_code error;
+        uint64_t bytes = 0;
+        for (const auto& entry : filesystem::directory_iterator(directory, error)) {
+            if (entry.is_regular_file() && entry.path().filename() != "index.json") {
+                bytes += entry.file_size(error);
             }
         }
-    }  
+        return bytes;
+    };
+    auto report = [](const char* name, double seconds, uint64_t downloaded, uint64_t stored) {
+        cout << "  " << name << fixed << setprecision(3) << seconds * 1000 << " мс, загружено "
+            << downloaded / 1024 << " КБ, на диске " << stored / 1024 << " КБ" << endl;
+    };
+
+    auto start = chrono::steady_clock::now();
+    uint64_t downloaded = 0;
+    for (size_t i = 0; i < urls.size(); i++) {
+        HttpRequest request;
+        request.url = urls[i];
+        HttpResponse response = http_client().perform(request);
+        downloaded += response.body.size();
+        ofstream(plainDirectory + "/" + to_string(i) + ".png", ios::binary) << response.body;
+    }
+    report("по одному:         ", chrono::duration<double>(chrono::steady_clock::now() - start).count(), downloaded, disk_usage(plainDirectory));
+
+    AvatarStore store(storeDirectory, (numeric_limits<uint64_t>::max)());
+    start = chrono::steady_clock::now();
+    store.fetch(urls, concurrency);
+    report("хранилище:         ", chrono::duration<double>(chrono::steady_clock::now() - start).count(), store.bytes_downloaded(), store.total_bytes());
+
+    uint64_t before = store.bytes_downloaded();
+    start = chrono::steady_clock::now();
+    store.fetch(urls, concurrency);
+    report("хранилище, повтор: ", chrono::duration<double>(chrono::steady_clock::now() - start).count(), store.bytes_downloaded() - before, store.total_bytes());
+    cout << "  " << store.stats() << endl;
+
+    filesystem::remove_all(plainDirectory, error);
+    filesystem::remove_all(storeDirectory, error);
+    return 0;
+}
+#endif
+
+/**
+ * @brief Обрабатывает аргументы командной строки (неинтерактивные режимы).
+ *
+ * @return Код завершения программы.
+ */
+int run_command_line(int argc, char* argv[]) {
+    string command = argv[1];
+    vector<string> args(argv + 2, argv + argc);
+
+    if (command == "--sync") {
+        return sync_catalog(args);
+    }
+    if (command == "--sync-delta") {
+        return sync_catalog_delta(args);
+    }
+    if (command == "--import") {
+        return import_catalog(args);
+    }
+    if (command == "--batch") {
+        return run_batch(args);
+    }
+    if (command == "--loadgen") {
+        return run_loadgen(args);
+    }
+    if (command == "--serve") {
+        return run_serve(args);
+    }
+    if (command == "--avatars") {
+        return run_avatars(args);
+    }
+
+#ifdef ANIMI_BENCH
+    if (command == "--bench-decode") {
+        return bench_decode(args);
+    }
+    if (command == "--bench-fields") {
+        return bench_fields(args);
+    }
+    if (command == "--bench-search") {
+        return bench_search(args);
+    }
+    if (command == "--bench-pager") {
+        return bench_pager(args);
+    }
+    if (command == "--bench-render") {
+        return bench_render(args);
+    }
+    if (command == "--bench-compression") {
+        return bench_compression(args);
+    }
+    if (command == "--bench-http2") {
+        return bench_http2(args);
+    }
+    if (command == "--bench-hedge") {
+        return bench_hedge(args);
+    }
+    if (command == "--bench-log") {
+        return bench_log(args);
+    }
+    if (command == "--bench-table") {
+        return bench_table(args);
+    }
+    if (command == "--bench-dates") {
+        return bench_dates(args);
+    }
+    if (command == "--bench-daemon") {
+        return bench_daemon(args);
+    }
+    if (command == "--bench-avatars") {
+        return bench_avatars(args);
+    }
+#endif
+
+    cout << "Неизвестный аргумент: " << command << endl;
+    return 1;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    // Отсчет времени до первого ответа API
+    process_started();
     // Устанавливаем русский язык
     setlocale(LC_ALL, "rus");
     // Проверяем тип системы (программа запускается только на Windows)
@@ -961,8 +9830,41 @@ int main() {
     set_encoding();
     // Загружаем или создаем конфигурацию
     load_config();
+    // Тонкому клиенту не нужны журнал, HTTP-клиент и кэши: запрос выполняет сервер (--serve)
+    if (argc > 1 && string(argv[1]) == "--client") {
+        return run_client(vector<string>(argv + 2, argv + argc));
+    }
+    // Запускаем журнал до всего, что в него пишет
+    logger().start(log_options());
     // Инициализациянастроек
     load_settings();
+    // Инициализируем общие объекты до регистрации shutdown_app, чтобы они были освобождены после нее
+    http_client();
+    random_prefetcher();
+    response_cache();
+    request_metrics();
+    transport();
+    atexit(shutdown_app);
+
+    // Открываем локальный каталог (mmap, без разбора) для автономного режима. Команды, которые
+    // переписывают каталог, его не открывают: в Windows отображенный в память файл нельзя заменить
+    string command = argc > 1 ? argv[1] : "";
+    bool rewritesCatalog = command == "--sync" || command == "--sync-delta" || command == "--import";
+    if (config.value("offline", false) && !rewritesCatalog) {
+        open_catalog();
+    }
+
+    if (argc > 1) {
+        return run_command_line(argc, argv);
+    }
+
+    // Пока рисуется меню и пользователь выбирает пункт, в фоне прогреваются DNS и соединения
+    if (config.value("warmup", false) && transport().live() && !offline_mode()) {
+        http_client().start_warmup(api_url(""), avatar_url(""));
+    }
+
+    // Экраны меню выводятся через рендерер, а не через system("cls")
+    screen_renderer().install();
 
     // Инициализация меню
     show_menu();
@@ -0,0 +1,977 @@
+﻿#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <chrono>
+#include <ctime>
+#include <random>
+#include <algorithm>
+#include <cstring>
+#include <charconv>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <BaseTsd.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef SOCKET socket_t;
+typedef SSIZE_T ssize_t;
+#define close_socket closesocket
+#define poll WSAPoll
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+typedef int socket_t;
+#define INVALID_SOCKET (-1)
+#define close_socket close
+#endif
+
+#include <nlohmann/json.hpp>
+#include <zlib.h>
+#include <nghttp2/nghttp2.h>
+
+using json = nlohmann::json;
+using namespace std;
+
+/**
+ * @brief Локальная замена API api.animi.club для бенчмарков и отладки без сети.
+ *
+ * Отдает /anime/random, /anime/search и /users/<name> из набора тестовых данных (встроенного
+ * или загруженного из файла) с настраиваемой задержкой, разбросом, долей ошибок и размером ответов.
+ * POST /debug/touch {"count": N} меняет N случайных аниме и их updatedAt (для проверки --sync-delta).
+ * GET /avatars/<файл> заменяет хранилище аватаров S3: картинки размером avatar-bytes, из которых
+ * различаются только avatar-variants, поэтому у многих пользователей аватары совпадают (для проверки --avatars).
+ * --users N добавляет пользователей user1..userN с аватарами user<i>.png.
+ * Запуск: AniMi-MockServer.exe [--port 18080] [--latency-ms 0] [--jitter-ms 0] [--error-rate 0] [--slow-rate 0] [--slow-ms 1000]
+ *         [--pad-bytes 0] [--gzip-min-bytes 256] [--no-gzip] [--max-streams 100] [--fixtures fixtures.json] [--anime 200] [--seed 1]
+ *         [--users 0] [--avatar-bytes 16384] [--avatar-variants 8]
+ * Ответы от gzip-min-bytes и больше сжимаются gzip, если клиент прислал Accept-Encoding с gzip.
+ * Кроме HTTP/1.1 принимается HTTP/2 без TLS (h2c с prior knowledge) с не более чем max-streams потоками.
+ */
+
+/**
+ * @brief Параметры сервера из командной строки.
+ */
+struct Options {
+    int port = 18080;
+    double latencyMs = 0;
+    double jitterMs = 0;
+    double errorRate = 0;
+    double slowRate = 0;
+    double slowMs = 1000;
+    size_t padBytes = 0;
+    bool gzip = true;
+    size_t gzipMinBytes = 256;
+    uint32_t maxStreams = 100;
+    string fixtures;
+    size_t animeCount = 200;
+    size_t userCount = 0;
+    size_t avatarBytes = 16384;
+    size_t avatarVariants = 8;
+    unsigned seed = 1;
+    bool verbose = false;
+};
+
+/**
+ * @brief Разобранный HTTP-запрос.
+ */
+struct Request {
+    string method;
+    string path;
+    map<string, string> headers;
+    string body;
+    string error;  ///< Почему запрос некорректен; такой запрос получает 400 и соединение закрывается
+};
+
+Options options;
+json animeFixtures = json::array();
+json userFixtures = json::object();
+// Данные читаются всеми соединениями, а меняются только через /debug/touch
+shared_mutex fixturesMutex;
+vector<string> avatarFixtures;
+
+/**
+ * @brief Строит встроенный набор данных: count аниме и несколько пользователей.
+ */
+void generate_fixtures(size_t count) {
+    const char* titles[] = { "Naruto", "Bleach", "One Piece", "Fullmetal Alchemist", "Steins;Gate",
+        "Cowboy Bebop", "Monster", "Mushishi", "Haikyuu", "Frieren" };
+    const char* russian[] = { "Наруто", "Блич", "Ван-Пис", "Стальной алхимик", "Врата Штейна",
+        "Ковбой Бибоп", "Монстр", "Мастер Муси", "Волейбол", "Провожающая в последний путь Фрирен" };
+
+    for (size_t i = 0; i < count; i++) {
+        size_t title = i % 10;
+        string suffix = i < 10 ? "" : " " + to_string(i / 10 + 1);
+
+        json anime;
+        anime["id"] = i + 1;
+        anime["shikimoriId"] = 1000 + i;
+        anime["myAnimeListId"] = 2000 + i;
+        anime["name"] = titles[title] + suffix;
+        anime["russian"] = russian[title] + suffix;
+        anime["english"] = i % 3 == 0 ? json() : json(titles[title] + suffix);
+        anime["episodes"] = 12 + (int)(i % 4) * 12;
+        anime["episodesAired"] = 12 + (int)(i % 4) * 12;
+        anime["duration"] = 24;
+        anime["description"] = string("Описание аниме ") + russian[title] + suffix + ".";
+        anime["synonyms"] = { string(titles[title]) + " TV" + suffix };
+        anime["updatedAt"] = "2024-05-31T23:10:39.588Z";
+        animeFixtures.push_back(anime);
+    }
+
+    const char* users[] = { "riktikdev", "alice", "bob", "carol", "dave" };
+    for (size_t i = 0; i < 5; i++) {
+        json user;
+        user["id"] = i + 1;
+        user["globalName"] = users[i];
+        user["avatar"] = string(users[i]) + ".png";
+        user["verified"] = i % 2 == 0;
+        user["createdAt"] = "2024-05-31T23:10:39.588Z";
+        user["updatedAt"] = "2024-06-01T01:00:00+03:00";
+        userFixtures[users[i]] = user;
+    }
+}
+
+/**
+ * @brief Добавляет пользователей user1..userN и строит avatar-variants различных картинок.
+ */
+void generate_avatars(size_t users) {
+    for (size_t i = 1; i <= users; i++) {
+        string name = "user" + to_string(i);
+        json user;
+        user["id"] = 100 + i;
+        user["globalName"] = name;
+        user["avatar"] = name + ".png";
+        user["verified"] = false;
+        user["createdAt"] = "2024-05-31T23:10:39.588Z";
+        user["updatedAt"] = "2024-06-01T01:00:00+03:00";
+        userFixtures[name] = user;
+    }
+
+    // Заголовок PNG и случайные (плохо сжимаемые, как у настоящих картинок) байты
+    for (size_t variant = 0; variant < max(options.avatarVariants, (size_t)1); variant++) {
+        mt19937 random((unsigned)variant + 1);
+        string image = "\x89PNG\r\n\x1a\n";
+        while (image.size() < options.avatarBytes) {
+            image += (char)(random() & 0xFF);
+        }
+        avatarFixtures.push_back(image);
+    }
+}
+
+/**
+ * @brief Загружает данные из файла {"anime": [...], "users": {"name": {...}}}.
+ *
+ * @return true, если файл прочитан.
+ */
+bool load_fixtures(const string& path) {
+    ifstream file(path);
+    if (!file.good()) {
+        return false;
+    }
+
+    try {
+        json data = json::parse(file);
+        animeFixtures = data.value("anime", json::array());
+        userFixtures = data.value("users", json::object());
+    }
+    catch (const json::exception& e) {
+        cerr << "Не удалось разобрать " << path << ": " << e.what() << endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Дополняет описание аниме до заданного размера, чтобы управлять объемом ответов.
+ */
+json padded(json anime) {
+    if (options.padBytes > 0 && anime.is_object()) {
+        string description = anime.value("description", string());
+        if (description.size() < options.padBytes) {
+            description.append(options.padBytes - description.size(), '.');
+        }
+        anime["description"] = description;
+    }
+    return anime;
+}
+
+/**
+ * @brief Поиск без учета регистра (для ASCII) по name, russian, english и synonyms.
+ */
+bool matches(const json& anime, const string& query) {
+    auto lower = [](string text) {
+        transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return (char)tolower(c); });
+        return text;
+    };
+
+    string needle = lower(query);
+    for (const char* key : { "name", "russian", "english" }) {
+        if (anime.contains(key) && anime[key].is_string() && lower(anime[key].get<string>()).find(needle) != string::npos) {
+            return true;
+        }
+    }
+    if (anime.contains("synonyms") && anime["synonyms"].is_array()) {
+        for (const auto& synonym : anime["synonyms"]) {
+            if (synonym.is_string() && lower(synonym.get<string>()).find(needle) != string::npos) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief ETag тела ответа (FNV-1a).
+ */
+string etag_of(const string& body) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (unsigned char c : body) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+
+    ostringstream out;
+    out << '"' << hex << hash << '"';
+    return out.str();
+}
+
+/**
+ * @brief Сжимает тело в формат gzip.
+ */
+string gzip_compress(const string& data) {
+    z_stream stream{};
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return string();
+    }
+
+    string out(deflateBound(&stream, (uLong)data.size()), '\0');
+    stream.next_in = (Bytef*)data.data();
+    stream.avail_in = (uInt)data.size();
+    stream.next_out = (Bytef*)&out[0];
+    stream.avail_out = (uInt)out.size();
+
+    int result = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result == Z_STREAM_END ? out : string();
+}
+
+/**
+ * @brief Тело ответа с ошибкой в формате API ({"error": "..."}).
+ */
+string error_body(const string& message) {
+    json body;
+    body["error"] = message;
+    return body.dump();
+}
+
+/**
+ * @brief Текущее время UTC в формате "YYYY-MM-DDTHH:MM:SS.mmmZ".
+ */
+string iso_now() {
+    auto now = chrono::system_clock::now();
+    time_t seconds = chrono::system_clock::to_time_t(now);
+    int milliseconds = (int)(chrono::duration_cast<chrono::milliseconds>(now.time_since_epoch()).count() % 1000);
+
+    tm utc{};
+#ifdef _WIN32
+    gmtime_s(&utc, &seconds);
+#else
+    gmtime_r(&seconds, &utc);
+#endif
+    char buffer[32];
+    size_t length = strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &utc);
+    snprintf(buffer + length, sizeof(buffer) - length, ".%03dZ", milliseconds);
+    return buffer;
+}
+
+/**
+ * @brief Выборка изменений для поиска с "updatedSince": записи строго после пары (updatedSince, afterId)
+ * по возрастанию этой пары. Метки сравниваются как строки, поэтому должны быть в одном формате (как у iso_now).
+ */
+json changed_since(const json& query, const string& text, size_t take) {
+    string since = query.value("updatedSince", string());
+    int afterId = query.value("afterId", 0);
+
+    auto key = [](const json* anime) {
+        return make_pair(anime->value("updatedAt", string()), anime->value("id", 0));
+    };
+
+    vector<const json*> changed;
+    for (const auto& anime : animeFixtures) {
+        if ((text.empty() || matches(anime, text)) && key(&anime) > make_pair(since, afterId)) {
+            changed.push_back(&anime);
+        }
+    }
+
+    size_t count = min(take, changed.size());
+    partial_sort(changed.begin(), changed.begin() + count, changed.end(), [&key](const json* left, const json* right) {
+        return key(left) < key(right);
+    });
+
+    json results = json::array();
+    for (size_t i = 0; i < count; i++) {
+        results.push_back(padded(*changed[i]));
+    }
+    return results;
+}
+
+/**
+ * @brief Формирует ответ на запрос: статус и тело.
+ */
+int route(const Request& request, string& body, mt19937& random) {
+    if (!request.error.empty()) {
+        body = error_body(request.error);
+        return 400;
+    }
+
+    // HEAD обрабатывается как GET, тело отбрасывается при отправке
+    string method = request.method == "HEAD" ? "GET" : request.method;
+
+    if (options.errorRate > 0 && uniform_real_distribution<double>(0, 1)(random) < options.errorRate) {
+        body = error_body("Внутренняя ошибка сервера (сымитирована)");
+        return 500;
+    }
+
+    if (method == "POST" && request.path == "/debug/touch") {
+        json query = json::parse(request.body, nullptr, false);
+        size_t count = query.is_object() ? query.value("count", (size_t)1) : 1;
+
+        unique_lock<shared_mutex> lock(fixturesMutex);
+        for (size_t i = 0; i < count && !animeFixtures.empty(); i++) {
+            json& anime = animeFixtures[uniform_int_distribution<size_t>(0, animeFixtures.size() - 1)(random)];
+            anime["episodesAired"] = anime.value("episodesAired", 0) + 1;
+            anime["updatedAt"] = iso_now();
+        }
+        body = json{ { "touched", count } }.dump();
+        return 200;
+    }
+
+    shared_lock<shared_mutex> lock(fixturesMutex);
+
+    if (method == "GET" && request.path == "/anime/random") {
+        if (animeFixtures.empty()) {
+            body = error_body("Нет данных");
+            return 404;
+        }
+        size_t index = uniform_int_distribution<size_t>(0, animeFixtures.size() - 1)(random);
+        body = padded(animeFixtures[index]).dump();
+        return 200;
+    }
+
+    if (method == "POST" && request.path == "/anime/search") {
+        json query = json::parse(request.body, nullptr, false);
+        if (query.is_discarded() || !query.is_object()) {
+            body = error_body("Некорректное тело запроса");
+            return 400;
+        }
+
+        for (const char* field : { "take", "skip" }) {
+            if (query.contains(field) && !query[field].is_number_unsigned()) {
+                body = error_body(string("Поле ") + field + " должно быть неотрицательным целым числом");
+                return 400;
+            }
+        }
+
+        string text = query.value("query", string());
+        size_t take = query.value("take", 5);
+        size_t skip = query.value("skip", 0);
+        if (query.contains("updatedSince")) {
+            body = changed_since(query, text, take).dump();
+            return 200;
+        }
+
+        json results = json::array();
+        size_t matched = 0;
+        for (const auto& anime : animeFixtures) {
+            if (!text.empty() && !matches(anime, text)) {
+                continue;
+            }
+            if (matched++ < skip) {
+                continue;
+            }
+            if (results.size() >= take) {
+                break;
+            }
+            results.push_back(padded(anime));
+        }
+        body = results.dump();
+        return 200;
+    }
+
+    if (method == "GET" && request.path.compare(0, 9, "/avatars/") == 0) {
+        // Картинка выбирается по имени файла, так что у одного пользователя она не меняется между запросами
+        string file = request.path.substr(9);
+        uint64_t hash = 1469598103934665603ULL;
+        for (unsigned char c : file) {
+            hash ^= c;
+            hash *= 1099511628211ULL;
+        }
+        body = avatarFixtures[hash % avatarFixtures.size()];
+        return 200;
+    }
+
+    if (method == "GET" && request.path.compare(0, 7, "/users/") == 0) {
+        string name = request.path.substr(7);
+        if (!userFixtures.contains(name)) {
+            // Как и настоящий API, для неизвестного пользователя отдаем пустое тело
+            body.clear();
+            return 404;
+        }
+        body = userFixtures[name].dump();
+        return 200;
+    }
+
+    body = error_body("Не найдено");
+    return 404;
+}
+
+/**
+ * @brief Читает из сокета один HTTP-запрос. Лишние байты (следующий запрос) остаются в buffer.
+ *
+ * Если заголовки прочитаны, но Content-Length некорректен, возвращает true и заполняет request.error:
+ * границу следующего запроса уже не найти, поэтому после ответа 400 соединение закрывается.
+ *
+ * @return false, если соединение закрыто или запрос некорректен.
+ */
+bool read_request(socket_t client, string& buffer, Request& request) {
+    char chunk[16384];
+
+    size_t headerEnd;
+    while ((headerEnd = buffer.find("\r\n\r\n")) == string::npos) {
+        int received = recv(client, chunk, sizeof(chunk), 0);
+        if (received <= 0) {
+            return false;
+        }
+        buffer.append(chunk, received);
+    }
+
+    istringstream head(buffer.substr(0, headerEnd));
+    string line;
+    getline(head, line);
+    istringstream requestLine(line);
+    requestLine >> request.method >> request.path;
+    request.path = request.path.substr(0, request.path.find('?'));
+
+    request.headers.clear();
+    request.body.clear();
+    request.error.clear();
+    while (getline(head, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        size_t colon = line.find(':');
+        if (colon == string::npos) {
+            continue;
+        }
+
+        string name = line.substr(0, colon);
+        transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return (char)tolower(c); });
+        size_t valueStart = line.find_first_not_of(' ', colon + 1);
+        request.headers[name] = valueStart == string::npos ? "" : line.substr(valueStart);
+    }
+
+    size_t length = 0;
+    auto contentLength = request.headers.find("content-length");
+    if (contentLength != request.headers.end()) {
+        const string& value = contentLength->second;
+        auto parsed = from_chars(value.data(), value.data() + value.size(), length);
+        if (parsed.ec != errc() || parsed.ptr != value.data() + value.size()) {
+            request.error = "Некорректный Content-Length: " + value;
+            buffer.clear();
+            return !request.method.empty();
+        }
+    }
+
+    size_t bodyStart = headerEnd + 4;
+    while (buffer.size() < bodyStart + length) {
+        int received = recv(client, chunk, sizeof(chunk), 0);
+        if (received <= 0) {
+            return false;
+        }
+        buffer.append(chunk, received);
+    }
+
+    request.body = buffer.substr(bodyStart, length);
+    buffer.erase(0, bodyStart + length);
+    return !request.method.empty();
+}
+
+bool send_all(socket_t client, const string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        int result = send(client, data.data() + sent, (int)(data.size() - sent), 0);
+        if (result <= 0) {
+            return false;
+        }
+        sent += result;
+    }
+    return true;
+}
+
+const char* status_text(int status) {
+    switch (status) {
+    case 200: return "OK";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    default: return "Internal Server Error";
+    }
+}
+
+/**
+ * @brief Готовый ответ: статус, заголовки и тело (уже сжатое, если нужно).
+ */
+struct Response {
+    int status = 200;
+    vector<pair<string, string>> headers;
+    string body;
+};
+
+/**
+ * @brief Задержка ответа с учетом разброса, в микросекундах. С вероятностью slow-rate к ней
+ * добавляется slow-ms: так имитируется хвост задержек (медленный диск, сборка мусора, перегруженный узел).
+ */
+int64_t response_delay(mt19937& random) {
+    normal_distribution<double> jitter(0, options.jitterMs);
+    double delay = options.latencyMs + (options.jitterMs > 0 ? jitter(random) : 0);
+    if (options.slowRate > 0 && uniform_real_distribution<double>(0, 1)(random) < options.slowRate) {
+        delay += options.slowMs;
+    }
+    return delay > 0 ? (int64_t)(delay * 1000) : 0;
+}
+
+/**
+ * @brief Формирует ответ на запрос: маршрут, ETag и 304, сжатие gzip.
+ */
+Response make_response(const Request& request, mt19937& random) {
+    Response response;
+    try {
+        response.status = route(request, response.body, random);
+    }
+    catch (const json::exception& e) {
+        // Поле не того типа в теле запроса не должно ронять весь сервер
+        response.status = 400;
+        response.body = error_body(string("Некорректное тело запроса: ") + e.what());
+    }
+
+    string etag = etag_of(response.body);
+    auto ifNoneMatch = request.headers.find("if-none-match");
+    if (response.status == 200 && ifNoneMatch != request.headers.end() && ifNoneMatch->second == etag) {
+        response.status = 304;
+        response.body.clear();
+    }
+
+    // Картинки, как и в S3, отдаются без сжатия
+    bool avatar = request.path.compare(0, 9, "/avatars/") == 0;
+    response.headers.emplace_back("content-type", avatar ? "image/png" : "application/json; charset=utf-8");
+    if (response.status == 200 || response.status == 304) {
+        response.headers.emplace_back("etag", etag);
+    }
+
+    // Сжимаем, только если клиент согласен на gzip и ответ не слишком мал
+    auto acceptEncoding = request.headers.find("accept-encoding");
+    if (options.gzip && !avatar && response.status == 200 && response.body.size() >= options.gzipMinBytes
+        && acceptEncoding != request.headers.end() && acceptEncoding->second.find("gzip") != string::npos) {
+        string compressed = gzip_compress(response.body);
+        if (!compressed.empty()) {
+            response.body = move(compressed);
+            response.headers.emplace_back("content-encoding", "gzip");
+        }
+    }
+    response.headers.emplace_back("vary", "Accept-Encoding");
+
+    if (options.verbose) {
+        cout << request.method << " " << request.path << " -> " << response.status << " (" << response.body.size() << " Б)" << endl;
+    }
+    return response;
+}
+
+/**
+ * @brief Состояние HTTP/2-соединения (h2c с prior knowledge).
+ *
+ * Запросы всех потоков соединения обслуживаются в одном потоке ОС: ответ на каждый ставится
+ * в очередь со своим сроком (задержка и разброс), поэтому задержка одного потока не блокирует
+ * остальные — как у настоящего сервера с мультиплексированием.
+ */
+struct Http2Connection {
+    struct Stream {
+        Request request;
+        Response response;
+        size_t sent = 0;
+    };
+
+    socket_t client;
+    nghttp2_session* session = nullptr;
+    map<int32_t, Stream> streams;
+    multimap<chrono::steady_clock::time_point, int32_t> due;
+    mt19937 random;
+};
+
+ssize_t http2_send(nghttp2_session*, const uint8_t* data, size_t length, int, void* userData) {
+    Http2Connection* connection = static_cast<Http2Connection*>(userData);
+    if (!send_all(connection->client, string((const char*)data, length))) {
+        return NGHTTP2_ERR_CALLBACK_FAILURE;
+    }
+    return (ssize_t)length;
+}
+
+int http2_begin_headers(nghttp2_session*, const nghttp2_frame* frame, void* userData) {
+    Http2Connection* connection = static_cast<Http2Connection*>(userData);
+    if (frame->hd.type == NGHTTP2_HEADERS && frame->headers.cat == NGHTTP2_HCAT_REQUEST) {
+        connection->streams[frame->hd.stream_id] = Http2Connection::Stream();
+    }
+    return 0;
+}
+
+int http2_header(nghttp2_session*, const nghttp2_frame* frame, const uint8_t* name, size_t nameLength,
+    const uint8_t* value, size_t valueLength, uint8_t, void* userData) {
+    Http2Connection* connection = static_cast<Http2Connection*>(userData);
+    auto it = connection->streams.find(frame->hd.stream_id);
+    if (it == connection->streams.end()) {
+        return 0;
+    }
+
+    Request& request = it->second.request;
+    string key((const char*)name, nameLength);
+    string text((const char*)value, valueLength);
+    if (key == ":method") {
+        request.method = text;
+    }
+    else if (key == ":path") {
+        request.path = text.substr(0, text.find('?'));
+    }
+    else if (key[0] != ':') {
+        request.headers[key] = text;
+    }
+    return 0;
+}
+
+int http2_data_chunk(nghttp2_session*, uint8_t, int32_t streamId, const uint8_t* data, size_t length, void* userData) {
+    Http2Connection* connection = static_cast<Http2Connection*>(userData);
+    auto it = connection->streams.find(streamId);
+    if (it != connection->streams.end()) {
+        it->second.request.body.append((const char*)data, length);
+    }
+    return 0;
+}
+
+int http2_frame_received(nghttp2_session*, const nghttp2_frame* frame, void* userData) {
+    Http2Connection* connection = static_cast<Http2Connection*>(userData);
+    bool requestComplete = (frame->hd.type == NGHTTP2_HEADERS || frame->hd.type == NGHTTP2_DATA)
+        && (frame->hd.flags & NGHTTP2_FLAG_END_STREAM);
+    if (requestComplete && connection->streams.count(frame->hd.stream_id)) {
+        auto when = chrono::steady_clock::now() + chrono::microseconds(response_delay(connection->random));
+        connection->due.emplace(when, frame->hd.stream_id);
+    }
+    return 0;
+}
+
+int http2_stream_closed(nghttp2_session*, int32_t streamId, uint32_t, void* userData) {
+    static_cast<Http2Connection*>(userData)->streams.erase(streamId);
+    return 0;
+}
+
+ssize_t http2_read_body(nghttp2_session*, int32_t streamId, uint8_t* buffer, size_t length, uint32_t* flags,
+    nghttp2_data_source*, void* userData) {
+    Http2Connection* connection = static_cast<Http2Connection*>(userData);
+    auto it = connection->streams.find(streamId);
+    if (it == connection->streams.end()) {
+        *flags |= NGHTTP2_DATA_FLAG_EOF;
+        return 0;
+    }
+
+    Http2Connection::Stream& stream = it->second;
+    size_t count = min(length, stream.response.body.size() - stream.sent);
+    memcpy(buffer, stream.response.body.data() + stream.sent, count);
+    stream.sent += count;
+    if (stream.sent == stream.response.body.size()) {
+        *flags |= NGHTTP2_DATA_FLAG_EOF;
+    }
+    return (ssize_t)count;
+}
+
+/**
+ * @brief Отправляет ответы потоков, срок которых наступил.
+ */
+void http2_submit_due(Http2Connection& connection) {
+    auto now = chrono::steady_clock::now();
+    while (!connection.due.empty() && connection.due.begin()->first <= now) {
+        int32_t streamId = connection.due.begin()->second;
+        connection.due.erase(connection.due.begin());
+
+        auto it = connection.streams.find(streamId);
+        if (it == connection.streams.end()) {
+            continue;
+        }
+
+        Http2Connection::Stream& stream = it->second;
+        stream.response = make_response(stream.request, connection.random);
+
+        // nghttp2 копирует имена и значения при отправке, строки должны жить до submit_response
+        stream.response.headers.emplace(stream.response.headers.begin(), ":status", to_string(stream.response.status));
+        stream.response.headers.emplace_back("content-length", to_string(stream.response.body.size()));
+        vector<nghttp2_nv> headers;
+        for (const auto& header : stream.response.headers) {
+            headers.push_back({ (uint8_t*)header.first.c_str(), (uint8_t*)header.second.c_str(),
+                header.first.size(), header.second.size(), NGHTTP2_NV_FLAG_NONE });
+        }
+
+        bool withBody = stream.request.method != "HEAD" && !stream.response.body.empty();
+        nghttp2_data_provider provider{};
+        provider.read_callback = http2_read_body;
+        nghttp2_submit_response(connection.session, streamId, headers.data(), headers.size(), withBody ? &provider : nullptr);
+    }
+}
+
+/**
+ * @brief Обслуживает HTTP/2-соединение. preface — уже прочитанное начало соединения.
+ */
+void serve_http2(socket_t client, const string& preface, unsigned seed) {
+    Http2Connection connection;
+    connection.client = client;
+    connection.random.seed(seed);
+
+    nghttp2_session_callbacks* callbacks;
+    nghttp2_session_callbacks_new(&callbacks);
+    nghttp2_session_callbacks_set_send_callback(callbacks, http2_send);
+    nghttp2_session_callbacks_set_on_begin_headers_callback(callbacks, http2_begin_headers);
+    nghttp2_session_callbacks_set_on_header_callback(callbacks, http2_header);
+    nghttp2_session_callbacks_set_on_data_chunk_recv_callback(callbacks, http2_data_chunk);
+    nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks, http2_frame_received);
+    nghttp2_session_callbacks_set_on_stream_close_callback(callbacks, http2_stream_closed);
+    nghttp2_session_server_new(&connection.session, callbacks, &connection);
+    nghttp2_session_callbacks_del(callbacks);
+
+    nghttp2_settings_entry settings[] = { { NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, options.maxStreams } };
+    nghttp2_submit_settings(connection.session, NGHTTP2_FLAG_NONE, settings, 1);
+
+    bool alive = nghttp2_session_mem_recv(connection.session, (const uint8_t*)preface.data(), preface.size()) >= 0;
+
+    char chunk[16384];
+    while (alive && (nghttp2_session_want_read(connection.session) || nghttp2_session_want_write(connection.session))) {
+        http2_submit_due(connection);
+        if (nghttp2_session_send(connection.session) != 0) {
+            break;
+        }
+
+        int timeout = -1;
+        if (!connection.due.empty()) {
+            auto wait = chrono::duration_cast<chrono::milliseconds>(connection.due.begin()->first - chrono::steady_clock::now());
+            timeout = (int)max<int64_t>(wait.count() + 1, 0);
+        }
+
+        pollfd descriptor{};
+        descriptor.fd = client;
+        descriptor.events = POLLIN;
+        if (poll(&descriptor, 1, timeout) <= 0) {
+            continue;
+        }
+
+        int received = recv(client, chunk, sizeof(chunk), 0);
+        if (received <= 0 || nghttp2_session_mem_recv(connection.session, (const uint8_t*)chunk, received) < 0) {
+            alive = false;
+        }
+    }
+
+    nghttp2_session_del(connection.session);
+    close_socket(client);
+}
+
+/**
+ * @brief Обслуживает одно keep-alive соединение до его закрытия клиентом.
+ *
+ * Соединение, начатое с преамбулы HTTP/2 ("PRI * HTTP/2.0"), передается в serve_http2.
+ */
+void serve_connection(socket_t client, unsigned seed) {
+    mt19937 random(seed);
+
+    string buffer;
+    Request request;
+    while (read_request(client, buffer, request)) {
+        if (request.method == "PRI" && request.path == "*") {
+            serve_http2(client, "PRI * HTTP/2.0\r\n\r\n" + buffer, seed);
+            return;
+        }
+
+        int64_t delay = response_delay(random);
+        if (delay > 0) {
+            this_thread::sleep_for(chrono::microseconds(delay));
+        }
+
+        Response response = make_response(request, random);
+        auto connectionHeader = request.headers.find("connection");
+        bool keepAlive = request.error.empty()
+            && (connectionHeader == request.headers.end() || connectionHeader->second != "close");
+
+        ostringstream head;
+        head << "HTTP/1.1 " << response.status << " " << status_text(response.status) << "\r\n";
+        for (const auto& header : response.headers) {
+            head << header.first << ": " << header.second << "\r\n";
+        }
+        head << "Content-Length: " << (request.method == "HEAD" ? 0 : response.body.size()) << "\r\n"
+            << "Connection: " << (keepAlive ? "keep-alive" : "close") << "\r\n"
+            << "\r\n";
+
+        string data = head.str();
+        if (request.method != "HEAD") {
+            data += response.body;
+        }
+
+        if (!send_all(client, data) || !keepAlive) {
+            break;
+        }
+    }
+
+    close_socket(client);
+}
+
+/**
+ * @brief Разбирает аргументы командной строки.
+ *
+ * @return false, если аргумент не распознан.
+ */
+bool parse_options(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        string name = argv[i];
+        if (name == "--verbose") {
+            options.verbose = true;
+            continue;
+        }
+        if (name == "--no-gzip") {
+            options.gzip = false;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+
+        string value = argv[++i];
+        if (name == "--port") {
+            options.port = stoi(value);
+        }
+        else if (name == "--latency-ms") {
+            options.latencyMs = stod(value);
+        }
+        else if (name == "--jitter-ms") {
+            options.jitterMs = stod(value);
+        }
+        else if (name == "--error-rate") {
+            options.errorRate = stod(value);
+        }
+        else if (name == "--slow-rate") {
+            options.slowRate = stod(value);
+        }
+        else if (name == "--slow-ms") {
+            options.slowMs = stod(value);
+        }
+        else if (name == "--pad-bytes") {
+            options.padBytes = stoul(value);
+        }
+        else if (name == "--gzip-min-bytes") {
+            options.gzipMinBytes = stoul(value);
+        }
+        else if (name == "--max-streams") {
+            options.maxStreams = (uint32_t)stoul(value);
+        }
+        else if (name == "--fixtures") {
+            options.fixtures = value;
+        }
+        else if (name == "--anime") {
+            options.animeCount = stoul(value);
+        }
+        else if (name == "--users") {
+            options.userCount = stoul(value);
+        }
+        else if (name == "--avatar-bytes") {
+            options.avatarBytes = stoul(value);
+        }
+        else if (name == "--avatar-variants") {
+            options.avatarVariants = stoul(value);
+        }
+        else if (name == "--seed") {
+            options.seed = (unsigned)stoul(value);
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (!parse_options(argc, argv)) {
+        cerr << "Использование: AniMi-MockServer [--port 18080] [--latency-ms N] [--jitter-ms N] [--error-rate 0..1]"
+            << " [--slow-rate 0..1] [--slow-ms N] [--pad-bytes N] [--gzip-min-bytes N] [--no-gzip] [--max-streams N] [--fixtures fixtures.json] [--anime N] [--seed N]"
+            << " [--users N] [--avatar-bytes N] [--avatar-variants N] [--verbose]" << endl;
+        return 1;
+    }
+
+    if (!options.fixtures.empty()) {
+        if (!load_fixtures(options.fixtures)) {
+            cerr << "Не удалось загрузить " << options.fixtures << endl;
+            return 1;
+        }
+    }
+    else {
+        generate_fixtures(options.animeCount);
+    }
+    generate_avatars(options.userCount);
+
+#ifdef _WIN32
+    SetConsoleOutputCP(CP_UTF8);
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2, 2), &wsa);
+#else
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    socket_t server = socket(AF_INET, SOCK_STREAM, 0);
+    if (server == INVALID_SOCKET) {
+        cerr << "Не удалось создать сокет" << endl;
+        return 1;
+    }
+
+    int reuse = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons((unsigned short)options.port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (::bind(server, (sockaddr*)&address, sizeof(address)) != 0 || listen(server, 128) != 0) {
+        cerr << "Не удалось занять порт " << options.port << endl;
+        close_socket(server);
+        return 1;
+    }
+
+    cout << "AniMi mock API: http://127.0.0.1:" << options.port << " (аниме: " << animeFixtures.size()
+        << ", пользователей: " << userFixtures.size() << ", задержка " << options.latencyMs << "±" << options.jitterMs
+        << " мс, ошибок " << options.errorRate * 100 << "%, медленных " << options.slowRate * 100 << "% по "
+        << options.slowMs << " мс)" << endl;
+
+    unsigned connection = 0;
+    while (true) {
+        socket_t client = accept(server, nullptr, nullptr);
+        if (client == INVALID_SOCKET) {
+            continue;
+        }
+
+        int noDelay = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+
+        thread(serve_connection, client, options.seed + connection++).detach();
+    }
+}